@@ -0,0 +1,66 @@
+#include "bench_tools.hpp"
+
+#include <iomanip>
+#include <fstream>
+
+
+
+namespace ubench {
+
+	double Result::seconds() const {
+		return std::chrono::duration<double>(time).count();
+	}
+
+
+	double Result::mbPerSecond() const {
+		auto s = seconds();
+		if(s <= 0.0) return 0.0;
+		return (double(bytes) / (1024.0 * 1024.0)) / s;
+	}
+
+
+	double Result::nsPerOp() const {
+		if(ops == 0) return 0.0;
+		return std::chrono::duration<double, std::nano>(time).count() / double(ops);
+	}
+
+
+	double Result::syscallsPerByte() const {
+		if(bytes == 0) return 0.0;
+		return double(syscalls) / double(bytes);
+	}
+
+
+	size_t countSyscalls() {
+		auto in = std::ifstream("/proc/self/io");
+		std::string key;
+		size_t value;
+		size_t r = 0;
+		while(in >> key >> value) {
+			if(key == "syscr:" || key == "syscw:") r += value;
+		}
+		return r;
+	}
+
+
+	void printHeader(std::ostream& os) {
+		os
+			<< std::left << std::setw(48) << "Benchmark"
+			<< std::right << std::setw(14) << "MB/s"
+			<< std::setw(14) << "ns/op"
+			<< std::setw(14) << "syscalls/B" << '\n';
+	}
+
+
+	void printResult(std::ostream& os, const Result& r) {
+		os
+			<< std::left << std::setw(48) << r.name
+			<< std::right << std::fixed << std::setprecision(1)
+			<< std::setw(14) << r.mbPerSecond()
+			<< std::setw(14) << r.nsPerOp()
+			<< std::scientific << std::setprecision(3)
+			<< std::setw(14) << r.syscallsPerByte()
+			<< std::defaultfloat << std::endl;
+	}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <ostream>
+
+
+
+namespace ubench {
+
+	using Clock = std::chrono::steady_clock;
+
+
+	class Stopwatch {
+	private:
+		Clock::time_point _begin;
+
+	public:
+		Stopwatch(): _begin(Clock::now()) { }
+
+		void reset() { _begin = Clock::now(); }
+
+		Clock::duration elapsed() const { return Clock::now() - _begin; }
+	};
+
+
+	struct Result {
+		std::string name;
+		size_t bytes;
+		size_t ops;
+		Clock::duration time;
+		size_t syscalls = 0;
+
+		double seconds() const;
+		double mbPerSecond() const;
+		double nsPerOp() const;
+		double syscallsPerByte() const;
+	};
+
+
+	/** Returns the number of read-like and write-like system calls performed
+	 * by the process so far, according to `/proc/self/io`; returns 0
+	 * if the count is not available. */
+	size_t countSyscalls();
+
+
+	/** Prints the column names for `printResult`. */
+	void printHeader(std::ostream&);
+
+	/** Prints a row with the throughput (MB/s), latency (ns/op)
+	 * and system calls per byte of a result. */
+	void printResult(std::ostream&, const Result&);
+
+}
@@ -0,0 +1,314 @@
+#include "bench_tools.hpp"
+
+#include "../include/unix/posixfio_tl.hpp"
+#include "../include/unix/posixfio_ex.hpp"
+
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+#include <unistd.h>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	const std::string tmpFile = "bench-tmpfile";
+
+	constexpr size_t recordSize = 64;
+
+	size_t regressions = 0;
+
+
+	std::string capacityName(size_t capacity) {
+		if(capacity >= 1024 * 1024) return std::to_string(capacity / (1024 * 1024)) + " MiB";
+		if(capacity >= 1024)        return std::to_string(capacity / 1024) + " KiB";
+		return std::to_string(capacity) + " B";
+	}
+
+
+	/** Every buffer should perform roughly one system call per `capacity` bytes;
+	 * anything worse than twice that (plus a few calls for EOF and
+	 * `/proc/self/io` itself) is reported as a regression. */
+	void report(ubench::Result r, size_t capacity) {
+		ubench::printResult(std::cout, r);
+		size_t maxSyscalls = ((r.bytes / capacity) * 2) + 16;
+		if(r.syscalls > maxSyscalls) {
+			std::cerr << "REGRESSION: \"" << r.name << "\" performed " << r.syscalls << " system calls, expected at most " << maxSyscalls << std::endl;
+			++ regressions;
+		}
+	}
+
+
+	template<typename Buffer>
+	ubench::Result bench_fwd(const std::string& name, Buffer& buf, size_t fileSize) {
+		size_t checksum = 0;
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		while(1 == buf.fwd()) checksum += *buf.data();
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		if(checksum != fileSize * 'x') {
+			std::cerr << "\"" << name << "\" read unexpected data" << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		return { name, fileSize, fileSize, elapsed, sc };
+	}
+
+
+	template<typename Buffer>
+	ubench::Result bench_read(const std::string& name, Buffer& buf, size_t fileSize) {
+		byte_t record[recordSize];
+		size_t total = 0;
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		ssize_t rd;
+		while(0 < (rd = buf.readAll(record, recordSize))) total += size_t(rd);
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		if(total != fileSize) {
+			std::cerr << "\"" << name << "\" read " << total << '/' << fileSize << " bytes" << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		return { name, fileSize, fileSize / recordSize, elapsed, sc };
+	}
+
+
+	ubench::Result bench_write(const std::string& name, size_t capacity, size_t fileSize) {
+		byte_t record[recordSize];
+		memset(record, 'x', recordSize);
+		File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		{
+			auto buf = OutputBuffer(f, capacity);
+			for(size_t off = 0; off < fileSize; off += recordSize) buf.writeAll(record, recordSize);
+			buf.flush();
+		}
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		return { name, fileSize, fileSize / recordSize, elapsed, sc };
+	}
+
+
+	void bench_dynamic(size_t capacity, size_t fileSize) {
+		auto capName = capacityName(capacity);
+		report(bench_write("OutputBuffer " + capName + ", write 64 B", capacity, fileSize), capacity);
+		{
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = InputBuffer(f, capacity);
+			report(bench_fwd("InputBuffer " + capName + ", fwd", buf, fileSize), capacity);
+		} {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = InputBuffer(f, capacity);
+			report(bench_read("InputBuffer " + capName + ", read 64 B", buf, fileSize), capacity);
+		} {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = RingInputBuffer(f, capacity);
+			report(bench_read("RingInputBuffer " + capName + ", read 64 B", buf, fileSize), capacity);
+		}
+	}
+
+
+	/** Array buffers are allocated on the heap, since the
+	 * largest ones would not fit on the stack. */
+	template<size_t capacity>
+	void bench_array(size_t fileSize) {
+		auto capName = capacityName(capacity);
+		{
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = std::make_unique<ArrayInputBuffer<capacity>>(f);
+			report(bench_fwd("ArrayInputBuffer<" + capName + ">, fwd", *buf, fileSize), capacity);
+		} {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = std::make_unique<ArrayInputBuffer<capacity>>(f);
+			report(bench_read("ArrayInputBuffer<" + capName + ">, read 64 B", *buf, fileSize), capacity);
+		}
+	}
+
+
+	/** Writes lines of 1 to 159 bytes (80 on average), and returns their count. */
+	size_t writeLines(size_t fileSize) {
+		File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		auto buf = OutputBuffer(f, 64 * 1024);
+		std::string line;
+		size_t written = 0;
+		size_t count = 0;
+		for(unsigned rng = 1; written < fileSize; ++ count) {
+			rng = (rng * 1103515245) + 12345;
+			line.assign(((rng >> 16) % 159) + 1, 'x');
+			line.back() = '\n';
+			buf.writeAll(line.data(), line.size());
+			written += line.size();
+		}
+		buf.flush();
+		return count;
+	}
+
+
+	template<typename Fn>
+	ubench::Result bench_lines(const std::string& name, size_t fileSize, size_t lineCount, Fn&& readLines) {
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		size_t count = readLines();
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		if(count != lineCount) {
+			std::cerr << "\"" << name << "\" read " << count << '/' << lineCount << " lines" << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		return { name, fileSize, lineCount, elapsed, sc };
+	}
+
+
+	void bench_lines_sweep(size_t fileSize) {
+		constexpr size_t capacity = 64 * 1024;
+		size_t lineCount = writeLines(fileSize);
+		fileSize = File::open(tmpFile.c_str(), O_RDONLY).lseek(0, SEEK_END);
+		ubench::printResult(std::cout, bench_lines("std::getline (std::ifstream)", fileSize, lineCount, [&]() {
+			auto is = std::ifstream(tmpFile);
+			std::string line;
+			size_t count = 0;
+			while(std::getline(is, line)) ++ count;
+			return count;
+		}));
+		ubench::printResult(std::cout, bench_lines("InputBuffer 64 KiB, fwd", fileSize, lineCount, [&]() {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = InputBuffer(f, capacity);
+			size_t count = 0;
+			while(1 == buf.fwd()) if(*buf.data() == '\n') ++ count;
+			return count;
+		}));
+		ubench::printResult(std::cout, bench_lines("InputBuffer 64 KiB, readLine", fileSize, lineCount, [&]() {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = InputBuffer(f, capacity);
+			std::string_view line;
+			size_t count = 0;
+			while(0 < buf.readLine(&line)) ++ count;
+			return count;
+		}));
+		ubench::printResult(std::cout, bench_lines("InputBuffer 64 KiB, forEachLine", fileSize, lineCount, [&]() {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto buf = InputBuffer(f, capacity);
+			size_t count = 0;
+			buf.forEachLine([&](std::string_view) { ++ count; });
+			return count;
+		}));
+	}
+
+
+	/** Creates and destroys buffers like a connection-per-stream server would,
+	 * writing a single record through each one. */
+	ubench::Result bench_churn(const std::string& name, size_t capacity, size_t count, std::pmr::memory_resource* memory) {
+		byte_t record[recordSize];
+		memset(record, 'x', recordSize);
+		File f = File::open("/dev/null", O_WRONLY);
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		for(size_t i = 0; i < count; ++i) {
+			auto buf = OutputBuffer(f, capacity, memory);
+			buf.writeAll(record, recordSize);
+		}
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		return { name, count * recordSize, count, elapsed, sc };
+	}
+
+
+	/** Compares `new[]` and BufferPool allocations in `bench_churn`; the `write`
+	 * system call in every iteration dominates the cost, so the difference
+	 * between the two is small (BufferPool was 3-15% faster in a Release build). */
+	void bench_churn_sweep(size_t count) {
+		for(size_t capacity : { size_t(4 * 1024), size_t(64 * 1024), size_t(1024 * 1024) }) {
+			auto capName = capacityName(capacity);
+			ubench::printResult(std::cout, bench_churn("OutputBuffer " + capName + ", create (new)", capacity, count, std::pmr::new_delete_resource()));
+			BufferPool pool;
+			ubench::printResult(std::cout, bench_churn("OutputBuffer " + capName + ", create (BufferPool)", capacity, count, &pool));
+		}
+	}
+
+
+	/** Repeats a short positional read, which fails if `fd` is not valid. */
+	template<typename Fn>
+	ubench::Result bench_short_read(const std::string& name, size_t count, Fn&& readFn) {
+		constexpr size_t readSize = 16;
+		byte_t buf[readSize];
+		size_t bytes = 0;
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		for(size_t i = 0; i < count; ++i) bytes += readFn(buf, readSize);
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		return { name, bytes, count, elapsed, sc };
+	}
+
+
+	/** Compares the error channels of File (exceptions) and ex::File (std::expected),
+	 * both when reads succeed and when they fail. */
+	void bench_error_channels(size_t count) {
+		File f = File::open(tmpFile.c_str(), O_RDONLY);
+		auto exf = std::move(ex::File::open(tmpFile.c_str(), O_RDONLY).value());
+		ubench::printResult(std::cout, bench_short_read("::pread 16 B (baseline)", count, [&](byte_t* buf, size_t n) {
+			return size_t(::pread(f, buf, n, 0));
+		}));
+		ubench::printResult(std::cout, bench_short_read("File::pread 16 B", count, [&](byte_t* buf, size_t n) {
+			return size_t(f.pread(buf, n, 0));
+		}));
+		ubench::printResult(std::cout, bench_short_read("ex::File::pread 16 B", count, [&](byte_t* buf, size_t n) {
+			return exf.pread(buf, n, 0).value_or(0);
+		}));
+		FileView bad = File::NULL_FD;
+		auto exBad = ex::File(ex::File::NULL_FD);
+		count /= 16;
+		ubench::printResult(std::cout, bench_short_read("File::pread 16 B (EBADF)", count, [&](byte_t* buf, size_t n) {
+			try { return size_t(bad.pread(buf, n, 0)); } catch(FileError&) { return size_t(0); }
+		}));
+		ubench::printResult(std::cout, bench_short_read("ex::File::pread 16 B (EBADF)", count, [&](byte_t* buf, size_t n) {
+			return exBad.pread(buf, n, 0).value_or(0);
+		}));
+	}
+
+
+	template<size_t... capacities>
+	void bench_sweep(size_t fileSize) {
+		(bench_dynamic(capacities, fileSize), ...);
+		(bench_array<capacities>(fileSize), ...);
+	}
+
+}
+
+
+
+int main(int argc, char** argv) {
+	size_t fileSizeMib = (argc > 1)? std::strtoul(argv[1], nullptr, 10) : 32;
+	size_t fileSize = fileSizeMib * 1024 * 1024;
+	std::cout << "File size: " << fileSizeMib << " MiB, record size: " << recordSize << " B\n";
+	if(ubench::countSyscalls() == 0) {
+		std::cerr << "/proc/self/io is not available, system calls will not be counted" << std::endl;
+	}
+	try {
+		ubench::printHeader(std::cout);
+		bench_sweep<
+			512,
+			4 * 1024,
+			64 * 1024,
+			1024 * 1024,
+			16 * 1024 * 1024
+		>(fileSize);
+		bench_churn_sweep(fileSize / 64);
+		bench_lines_sweep(fileSize);
+		bench_error_channels(fileSize / 16);
+	} catch(FileError& err) {
+		std::cerr << "ERRNO " << err.errcode << std::endl;
+		::unlink(tmpFile.c_str());
+		return EXIT_FAILURE;
+	}
+	::unlink(tmpFile.c_str());
+	return (regressions == 0)? EXIT_SUCCESS : EXIT_FAILURE;
+}
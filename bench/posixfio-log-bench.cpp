@@ -0,0 +1,103 @@
+#include "bench_tools.hpp"
+
+#include "../include/unix/posixfio_log.hpp"
+#include "../include/unix/posixfio_tl.hpp"
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+#include <unistd.h>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	const std::string tmpFile = "bench-tmpfile";
+
+	constexpr size_t recordSize = 128;
+
+
+	/** The journal as it was implemented before MappedAppendLog:
+	 * length-prefixed records through an OutputBuffer, flushed and synced in groups. */
+	ubench::Result bench_output_buffer(size_t recordCount, size_t syncEvery) {
+		std::vector<byte_t> rec(recordSize, 'x');
+		::unlink(tmpFile.c_str());
+		File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		{
+			auto buf = OutputBuffer(f, 64 * 1024);
+			for(size_t i = 0; i < recordCount; ++i) {
+				std::uint32_t size = recordSize;
+				buf.writeAll(&size, sizeof(size));
+				buf.writeAll(rec.data(), rec.size());
+				if(syncEvery > 0 && (i + 1) % syncEvery == 0) {
+					buf.flush();
+					f.fdatasync();
+				}
+			}
+			buf.flush();
+			if(syncEvery > 0) f.fdatasync();
+		}
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		auto name = "OutputBuffer, fdatasync every " + std::to_string(syncEvery);
+		if(syncEvery == 0) name = "OutputBuffer, no sync";
+		return { name, recordCount * recordSize, recordCount, elapsed, sc };
+	}
+
+
+	ubench::Result bench_log(size_t recordCount, size_t syncEvery, LogSyncMode mode) {
+		std::vector<byte_t> rec(recordSize, 'x');
+		::unlink(tmpFile.c_str());
+		auto sc = ubench::countSyscalls();
+		ubench::Stopwatch sw;
+		{
+			auto log = MappedAppendLog::open(tmpFile.c_str());
+			for(size_t i = 0; i < recordCount; ++i) {
+				void* dst = log.reserve(recordSize);
+				memcpy(dst, rec.data(), recordSize);
+				log.commit();
+				if(syncEvery > 0 && (i + 1) % syncEvery == 0) log.sync(mode);
+			}
+			if(syncEvery > 0) log.sync(mode);
+		}
+		auto elapsed = sw.elapsed();
+		sc = ubench::countSyscalls() - sc;
+		std::string name = "MappedAppendLog, ";
+		if(syncEvery == 0) name += "no sync";
+		else name += ((mode == LogSyncMode::eRange)? "msync every " : "fdatasync every ") + std::to_string(syncEvery);
+		return { name, recordCount * recordSize, recordCount, elapsed, sc };
+	}
+
+}
+
+
+
+int main(int argc, char** argv) {
+	size_t recordCount = (argc > 1)? std::strtoul(argv[1], nullptr, 10) : 200000;
+	std::cout << "Records: " << recordCount << ", record size: " << recordSize << " B\n";
+	try {
+		ubench::printHeader(std::cout);
+		for(size_t syncEvery : { size_t(0), size_t(1000), size_t(100) }) {
+			ubench::printResult(std::cout, bench_output_buffer(recordCount, syncEvery));
+			ubench::printResult(std::cout, bench_log(recordCount, syncEvery, LogSyncMode::eRange));
+			if(syncEvery > 0) ubench::printResult(std::cout, bench_log(recordCount, syncEvery, LogSyncMode::eFdatasync));
+		}
+	} catch(FileError& err) {
+		std::cerr << "ERRNO " << err.errcode << std::endl;
+		::unlink(tmpFile.c_str());
+		return EXIT_FAILURE;
+	} catch(Errcode& err) {
+		std::cerr << "ERRNO " << err.errcode << std::endl;
+		::unlink(tmpFile.c_str());
+		return EXIT_FAILURE;
+	}
+	::unlink(tmpFile.c_str());
+	return EXIT_SUCCESS;
+}
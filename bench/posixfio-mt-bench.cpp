@@ -0,0 +1,94 @@
+#include "bench_tools.hpp"
+
+#include "../include/unix/posixfio_mt.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+
+#include <unistd.h>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	const std::string tmpFile = "bench-tmpfile";
+
+	constexpr size_t recordSize = 64;
+	constexpr size_t bufferCapacity = 1024 * 1024;
+
+
+	/** Runs `threadCount` threads, which write `recordCount` records in total. */
+	template<typename WriteFn>
+	ubench::Result runThreads(std::string name, unsigned threadCount, size_t recordCount, WriteFn&& writeRecord) {
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount);
+		ubench::Stopwatch sw;
+		for(unsigned t = 0; t < threadCount; ++t) {
+			size_t count = (recordCount / threadCount) + ((t < recordCount % threadCount)? 1 : 0);
+			threads.emplace_back([&writeRecord, count]() {
+				byte_t rec[recordSize];
+				std::fill(rec, rec + recordSize, 'x');
+				for(size_t i = 0; i < count; ++i) writeRecord(rec);
+			});
+		}
+		for(auto& thread : threads) thread.join();
+		return { std::move(name), recordCount * recordSize, recordCount, sw.elapsed() };
+	}
+
+
+	/** The logging path as it was implemented before ConcurrentOutputBuffer. */
+	ubench::Result bench_mutex(unsigned threadCount, size_t recordCount) {
+		File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		auto sc = ubench::countSyscalls();
+		std::mutex mtx;
+		auto buf = OutputBuffer(f, bufferCapacity);
+		auto r = runThreads("Mutex + OutputBuffer, " + std::to_string(threadCount) + " threads", threadCount, recordCount, [&](const byte_t* rec) {
+			auto lock = std::unique_lock(mtx);
+			buf.writeAll(rec, recordSize);
+		});
+		buf.flush();
+		r.syscalls = ubench::countSyscalls() - sc;
+		return r;
+	}
+
+
+	ubench::Result bench_concurrent(unsigned threadCount, size_t recordCount) {
+		File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		auto sc = ubench::countSyscalls();
+		auto buf = ConcurrentOutputBuffer(f, bufferCapacity / ConcurrentOutputBuffer::defaultSegmentCount);
+		auto r = runThreads("ConcurrentOutputBuffer, " + std::to_string(threadCount) + " threads", threadCount, recordCount, [&](const byte_t* rec) {
+			buf.write(rec, recordSize);
+		});
+		buf.flush();
+		r.syscalls = ubench::countSyscalls() - sc;
+		return r;
+	}
+
+}
+
+
+
+int main(int argc, char** argv) {
+	size_t recordCount = (argc > 1)? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	std::cout << "Records: " << recordCount << ", record size: " << recordSize << " B, hardware threads: " << std::thread::hardware_concurrency() << '\n';
+	try {
+		ubench::printHeader(std::cout);
+		for(unsigned threadCount : { 1, 2, 4, 8, 16, 32, 64 }) {
+			ubench::printResult(std::cout, bench_mutex(threadCount, recordCount));
+			ubench::printResult(std::cout, bench_concurrent(threadCount, recordCount));
+		}
+	} catch(FileError& err) {
+		std::cerr << "ERRNO " << err.errcode << std::endl;
+		::unlink(tmpFile.c_str());
+		return EXIT_FAILURE;
+	}
+	::unlink(tmpFile.c_str());
+	return EXIT_SUCCESS;
+}
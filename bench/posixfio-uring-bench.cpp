@@ -0,0 +1,126 @@
+#include "bench_tools.hpp"
+
+#include "../include/unix/posixfio_uring.hpp"
+#include "../include/unix/posixfio_tl.hpp"
+
+#include <array>
+#include <vector>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+#include <unistd.h>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	const std::string tmpFile = "bench-tmpfile";
+
+	constexpr size_t chunkSize = 128 * 1024;
+	constexpr unsigned queueDepth = 8;
+
+
+	ubench::Result bench_write_all(size_t fileSize) {
+		std::vector<byte_t> buf(chunkSize, 'x');
+		File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		ubench::Stopwatch sw;
+		for(size_t off = 0; off < fileSize; off += chunkSize) {
+			writeAll(f, buf.data(), chunkSize);
+		}
+		f.fdatasync();
+		return { "writeAll", fileSize, fileSize / chunkSize, sw.elapsed() };
+	}
+
+
+	ubench::Result bench_read_all(size_t fileSize) {
+		std::vector<byte_t> buf(chunkSize);
+		File f = File::open(tmpFile.c_str(), O_RDONLY);
+		ubench::Stopwatch sw;
+		for(size_t off = 0; off < fileSize; off += chunkSize) {
+			readAll(f, buf.data(), chunkSize);
+		}
+		return { "readAll", fileSize, fileSize / chunkSize, sw.elapsed() };
+	}
+
+
+	/** Keeps `queueDepth` fixed-buffer operations in flight, each buffer
+	 * being reused as soon as its previous operation completes. */
+	ubench::Result bench_ring(size_t fileSize, bool write) {
+		std::vector<byte_t> bufs(chunkSize * queueDepth, 'x');
+		std::array<struct iovec, queueDepth> iovs;
+		for(unsigned i = 0; i < queueDepth; ++i) iovs[i] = { bufs.data() + (i * chunkSize), chunkSize };
+		File f = write?
+			File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600) :
+			File::open(tmpFile.c_str(), O_RDONLY);
+		fd_t fd = f;
+		Ring ring = Ring::create(queueDepth);
+		ring.registerBuffers(iovs.data(), queueDepth);
+		ring.registerFiles(&fd, 1);
+
+		auto prep = [&](unsigned bufIndex, size_t off) {
+			auto buf = bufs.data() + (bufIndex * chunkSize);
+			if(write) ring.prepWriteFixed(RingFile::registered(0), buf, chunkSize, off, bufIndex, bufIndex);
+			else      ring.prepReadFixed(RingFile::registered(0), buf, chunkSize, off, bufIndex, bufIndex);
+		};
+
+		ubench::Stopwatch sw;
+		size_t nextOff = 0;
+		size_t inFlight = 0;
+		for(unsigned i = 0; i < queueDepth && nextOff < fileSize; ++i) {
+			prep(i, nextOff);
+			nextOff += chunkSize;
+			++ inFlight;
+		}
+		std::array<RingCompletion, queueDepth> cqes;
+		while(inFlight > 0) {
+			ring.submit();
+			auto got = ring.waitCompletions(cqes.data(), queueDepth);
+			for(ssize_t i = 0; i < got; ++i) {
+				if(cqes[i].result < 0) {
+					std::cerr << "Ring operation failed with errno " << -cqes[i].result << std::endl;
+					std::exit(EXIT_FAILURE);
+				}
+				-- inFlight;
+				if(nextOff < fileSize) {
+					prep(unsigned(cqes[i].userData), nextOff);
+					nextOff += chunkSize;
+					++ inFlight;
+				}
+			}
+		}
+		if(write) {
+			RingCompletion cqe;
+			ring.prepFsync(RingFile::registered(0), RingFsyncFlags::eDatasync, 0);
+			ring.submit();
+			ring.waitCompletions(&cqe, 1);
+		}
+		auto elapsed = sw.elapsed();
+		return { write? "Ring write (fixed, QD 8)" : "Ring read (fixed, QD 8)", fileSize, fileSize / chunkSize, elapsed };
+	}
+
+}
+
+
+
+int main(int argc, char** argv) {
+	size_t fileSizeMib = (argc > 1)? std::strtoul(argv[1], nullptr, 10) : 64;
+	size_t fileSize = fileSizeMib * 1024 * 1024;
+	std::cout << "File size: " << fileSizeMib << " MiB, chunk size: " << (chunkSize / 1024) << " KiB\n";
+	try {
+		ubench::printHeader(std::cout);
+		ubench::printResult(std::cout, bench_write_all(fileSize));
+		ubench::printResult(std::cout, bench_ring(fileSize, true));
+		ubench::printResult(std::cout, bench_read_all(fileSize));
+		ubench::printResult(std::cout, bench_ring(fileSize, false));
+	} catch(FileError& err) {
+		std::cerr << "ERRNO " << err.errcode << std::endl;
+		::unlink(tmpFile.c_str());
+		return EXIT_FAILURE;
+	}
+	::unlink(tmpFile.c_str());
+	return EXIT_SUCCESS;
+}
@@ -2,12 +2,20 @@
 
 extern "C" {
 	#include <fcntl.h>
+	#include <signal.h>
 	#include <sys/mman.h>
+	#include <sys/uio.h>
+	#include <sys/eventfd.h>
+	#include <sys/timerfd.h>
+	#include <sys/signalfd.h>
+	#include <sys/epoll.h>
 }
 
+#include <cassert>
 #include <cstdint>
 #include <new>
 #include <type_traits>
+#include <vector>
 
 
 
@@ -58,6 +66,25 @@ namespace posixfio {
 	};
 
 
+	enum class MemAdvice : int {
+		eNormal = MADV_NORMAL,
+		eRandom = MADV_RANDOM,
+		eSequential = MADV_SEQUENTIAL,
+		eWillNeed = MADV_WILLNEED,
+		eDontNeed = MADV_DONTNEED,
+		eHugePage = MADV_HUGEPAGE,
+		eNoHugePage = MADV_NOHUGEPAGE,
+		#ifdef MADV_COLD
+			eCold = MADV_COLD,
+			ePageOut = MADV_PAGEOUT,
+		#endif
+		#ifdef MADV_POPULATE_READ
+			ePopulateRead = MADV_POPULATE_READ,
+			ePopulateWrite = MADV_POPULATE_WRITE,
+		#endif
+	};
+
+
 	class MemMapping {
 	private:
 		friend File;
@@ -87,6 +114,32 @@ namespace posixfio {
 		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs. */
 		bool msync(MemSyncFlags flags = MemSyncFlags::eSync);
 
+		/** Linux-specific: the range is extended to page boundaries.
+		 * Returns `false` exclusively when an error occurs. */
+		bool msync(size_t offset, size_t length, MemSyncFlags flags = MemSyncFlags::eSync);
+
+		/** Linux-specific: the range is extended to page boundaries.
+		 * Returns `false` exclusively when an error occurs. */
+		bool mlock(size_t offset, size_t length);
+
+		/** Linux-specific: the range is extended to page boundaries.
+		 * Returns `false` exclusively when an error occurs. */
+		bool munlock(size_t offset, size_t length);
+
+		/** Linux-specific: returns `false` exclusively when an error occurs. */
+		bool madvise(MemAdvice advice);
+
+		/** Linux-specific: the range is extended to page boundaries.
+		 * Returns `false` exclusively when an error occurs. */
+		bool madvise(size_t offset, size_t length, MemAdvice advice);
+
+		/** Linux-specific: resizes the mapping with `mremap`, which may move it
+		 * unless `mayMove` is `false`; the mapping is still owned by this object,
+		 * but pointers to it are invalidated.
+		 * Returns `false` exclusively when an error occurs, in which case
+		 * the mapping is left unchanged. */
+		bool remap(size_t newLength, bool mayMove = true);
+
 		template<typename T = void> inline T* get() noexcept { return reinterpret_cast<T*>(addr); }
 		template<typename T = void> inline const T* get() const noexcept { return reinterpret_cast<const T*>(addr); }
 
@@ -106,7 +159,104 @@ namespace posixfio {
 		eNone = 0,
 		eShared = MAP_SHARED,
 		ePrivate = MAP_PRIVATE,
-		eFixed = MAP_FIXED
+		eFixed = MAP_FIXED,
+		ePopulate = MAP_POPULATE,
+		eHugeTlb = MAP_HUGETLB,
+		eNoReserve = MAP_NORESERVE,
+		eLocked = MAP_LOCKED
+	};
+
+
+	enum class RwFlags : int {
+		eNone = 0,
+		eHipri = RWF_HIPRI,
+		eDsync = RWF_DSYNC,
+		eSync = RWF_SYNC,
+		eNoWait = RWF_NOWAIT,
+		eAppend = RWF_APPEND
+	};
+
+
+	enum class SpliceFlags : unsigned {
+		eNone = 0,
+		eMove = SPLICE_F_MOVE,
+		eNonblock = SPLICE_F_NONBLOCK,
+		eMore = SPLICE_F_MORE,
+		eGift = SPLICE_F_GIFT
+	};
+
+
+	enum class FileAdvice : int {
+		eNormal = POSIX_FADV_NORMAL,
+		eSequential = POSIX_FADV_SEQUENTIAL,
+		eRandom = POSIX_FADV_RANDOM,
+		eNoReuse = POSIX_FADV_NOREUSE,
+		eWillNeed = POSIX_FADV_WILLNEED,
+		eDontNeed = POSIX_FADV_DONTNEED
+	};
+
+
+	enum class FallocateMode : int {
+		eDefault = 0,
+		eKeepSize = FALLOC_FL_KEEP_SIZE,
+		ePunchHole = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,  // Punching a hole requires FALLOC_FL_KEEP_SIZE
+		eZeroRange = FALLOC_FL_ZERO_RANGE,
+		eZeroRangeKeepSize = FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+		eCollapseRange = FALLOC_FL_COLLAPSE_RANGE,
+		eInsertRange = FALLOC_FL_INSERT_RANGE
+	};
+
+
+	enum class SyncRangeFlags : unsigned {
+		eNone = 0,
+		eWaitBefore = SYNC_FILE_RANGE_WAIT_BEFORE,
+		eWrite = SYNC_FILE_RANGE_WRITE,
+		eWaitAfter = SYNC_FILE_RANGE_WAIT_AFTER,
+		eWriteAndWait = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER
+	};
+
+
+	enum class FileSeals : int {
+		eNone = 0,
+		eSeal = F_SEAL_SEAL,
+		eShrink = F_SEAL_SHRINK,
+		eGrow = F_SEAL_GROW,
+		eWrite = F_SEAL_WRITE,
+		eFutureWrite = F_SEAL_FUTURE_WRITE
+	};
+
+
+	/** Events that a Poller waits for, and registration modes. */
+	enum class PollEvents : std::uint32_t {
+		eNone = 0,
+		eIn = EPOLLIN,
+		eOut = EPOLLOUT,
+		ePri = EPOLLPRI,
+		eRdHup = EPOLLRDHUP,
+		eEdgeTriggered = EPOLLET,
+		eOneShot = EPOLLONESHOT
+	};
+
+
+	/** A ready file, identified by the token it was registered with. */
+	struct PollEvent {
+		std::uint64_t token;
+		std::uint32_t events;  // `EPOLL*` flags
+
+		/** The file may be read without blocking, or has been closed by the other end. */
+		inline bool readable() const { return events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR); }
+
+		/** The file may be written without blocking, or has an error to report. */
+		inline bool writable() const { return events & (EPOLLOUT | EPOLLERR); }
+
+		inline bool hangup() const { return events & (EPOLLRDHUP | EPOLLHUP); }
+	};
+
+
+	/** Alignment constraints of `O_DIRECT` transfers on a file. */
+	struct DirectIoAlignment {
+		size_t memory;  // Alignment of user buffers
+		size_t offset;  // Alignment of file offsets and transfer sizes
 	};
 
 
@@ -128,6 +278,25 @@ namespace posixfio {
 		/** POSIX-compliant. */
 		static File openat(fd_t dirfd, const char* pathname, int flags, mode_t mode = 0);
 
+		/** Linux-specific: creates an anonymous file that lives in memory, and can be
+		 * shared with other processes through its file descriptor;
+		 * `flags` are the `MFD_*` flags, and `MFD_ALLOW_SEALING` is required by `addSeals`. */
+		static File memfdCreate(const char* name, unsigned flags = MFD_CLOEXEC);
+
+		/** Linux-specific: creates an event counter, with the `EFD_*` flags;
+		 * see `eventfdRead` and `eventfdWrite`. */
+		static File eventfd(unsigned initval = 0, int flags = EFD_CLOEXEC);
+
+		/** Linux-specific: creates a disarmed timer, with the `TFD_*` flags;
+		 * see `timerfdSettime`. Reading it yields the number of expirations
+		 * as a `std::uint64_t`. */
+		static File timerfd(clockid_t clockid = CLOCK_MONOTONIC, int flags = TFD_CLOEXEC);
+
+		/** Linux-specific: creates a file that receives the signals in `mask`, with the
+		 * `SFD_*` flags; reading it yields `struct signalfd_siginfo` records.
+		 * The signals must be blocked, or they will still be handled as usual. */
+		static File signalfd(const sigset_t& mask, int flags = SFD_CLOEXEC);
+
 
 		File();
 		File(fd_t);
@@ -156,6 +325,41 @@ namespace posixfio {
 		/** POSIX-compliant. */
 		ssize_t write(const void* buf, size_t count);
 
+		/** POSIX-compliant. */
+		ssize_t readv(const struct iovec* iov, int iovcnt);
+
+		/** POSIX-compliant. */
+		ssize_t writev(const struct iovec* iov, int iovcnt);
+
+		/** POSIX-compliant.
+		 * Positional I/O functions neither use nor change the file offset,
+		 * so any number of threads may use them on the same file descriptor. */
+		ssize_t pread(void* buf, size_t count, off_t offset);
+
+		/** POSIX-compliant. */
+		ssize_t pwrite(const void* buf, size_t count, off_t offset);
+
+		/** Linux-specific: `preadv` with per-call `RWF_*` flags;
+		 * an `offset` of `-1` uses (and updates) the file offset. */
+		ssize_t preadv2(const struct iovec* iov, int iovcnt, off_t offset, RwFlags flags = RwFlags::eNone);
+
+		/** Linux-specific: `pwritev` with per-call `RWF_*` flags;
+		 * an `offset` of `-1` uses (and updates) the file offset. */
+		ssize_t pwritev2(const struct iovec* iov, int iovcnt, off_t offset, RwFlags flags = RwFlags::eNone);
+
+		/** Linux-specific: moves data from this file to `out` without copying it to
+		 * userspace, one of the two files must be a pipe; a null offset pointer
+		 * uses (and updates) the file offset, and must be used for pipes. */
+		ssize_t splice(off_t* offIn, FileView out, off_t* offOut, size_t len, SpliceFlags flags = SpliceFlags::eNone);
+
+		/** Linux-specific: duplicates up to `len` bytes from this pipe
+		 * to the `out` pipe, without consuming them. */
+		ssize_t tee(FileView out, size_t len, SpliceFlags flags = SpliceFlags::eNone);
+
+		/** Linux-specific: moves user memory into this pipe; with `SpliceFlags::eGift`,
+		 * the pages must not be modified by the caller afterwards. */
+		ssize_t vmsplice(const struct iovec* iov, int iovcnt, SpliceFlags flags = SpliceFlags::eNone);
+
 		/** POSIX-compliant. */
 		off_t lseek(off_t offset, int whence);
 
@@ -168,6 +372,56 @@ namespace posixfio {
 		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs. */
 		bool fdatasync();
 
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * A `len` of 0 extends the advice to the end of the file. */
+		bool fadvise(off_t offset, off_t len, FileAdvice advice);
+
+		/** Linux-specific: populates the page cache with the given range, blocking until
+		 * it is read; returns `false` exclusively when an error occurs. */
+		bool readahead(off_t offset, size_t count);
+
+		/** Linux-specific: allocates, deallocates or zeroes the given range,
+		 * depending on `mode`; returns `false` exclusively when an error occurs. */
+		bool fallocate(FallocateMode mode, off_t offset, off_t len);
+
+		/** Linux-specific: starts and/or waits for the writeback of the given range,
+		 * which does NOT make it durable, since neither metadata nor the device cache
+		 * are flushed; a `nbytes` of 0 extends the range to the end of the file.
+		 * Returns `false` exclusively when an error occurs. */
+		bool syncFileRange(off_t offset, off_t nbytes, SyncRangeFlags flags);
+
+		/** Linux-specific: adds seals to a file created by `memfdCreate`;
+		 * returns `false` exclusively when an error occurs. */
+		bool addSeals(FileSeals seals);
+
+		/** Linux-specific: returns the seals of a file created by `memfdCreate`,
+		 * or -1 if an error occurs. */
+		int getSeals();
+
+		/** Linux-specific: adds `value` to the counter of an eventfd;
+		 * returns `false` exclusively when an error occurs. */
+		bool eventfdWrite(std::uint64_t value);
+
+		/** Linux-specific: reads and resets the counter of an eventfd (or decrements
+		 * it, with `EFD_SEMAPHORE`), blocking until it is not zero unless the file
+		 * is non-blocking; returns `false` exclusively when an error occurs. */
+		bool eventfdRead(std::uint64_t* value);
+
+		/** Linux-specific: arms (or disarms, with a zero `it_value`) a timerfd;
+		 * `flags` may be `TFD_TIMER_ABSTIME`.
+		 * Returns `false` exclusively when an error occurs. */
+		bool timerfdSettime(const struct itimerspec& newValue, int flags = 0, struct itimerspec* oldValue = nullptr);
+
+		/** Linux-specific: returns `false` exclusively when an error occurs. */
+		bool timerfdGettime(struct itimerspec* currValue);
+
+		/** Linux-specific: returns the alignment required by `O_DIRECT` transfers,
+		 * as reported by `statx` with `STATX_DIOALIGN`; falls back to the
+		 * preferred I/O block size on kernels and filesystems that don't report it.
+		 * Returns a zero alignment exclusively when an error occurs
+		 * (EINVAL if the file does not support direct I/O). */
+		DirectIoAlignment directIoAlignment();
+
 		/** POSIX-compliant. */
 		[[nodiscard]]
 		MemMapping mmap(void* addr, size_t len, MemProtFlags prot, MemMapFlags flags, off_t off);
@@ -188,6 +442,10 @@ namespace posixfio {
 		/** POSIX-compliant. */
 		static Pipe create();
 
+		/** Linux-specific: `flags` may include `O_NONBLOCK`, `O_CLOEXEC`
+		 * and `O_DIRECT` (packet mode), and apply to both ends. */
+		static Pipe create2(int flags);
+
 		inline Pipe() { }
 		Pipe(const Pipe&) = default;
 		Pipe(Pipe&&) = default;
@@ -199,11 +457,73 @@ namespace posixfio {
 		inline ssize_t read(void* buf, size_t count) { return rd.read(buf, count); };
 		inline ssize_t write(void* buf, size_t count) { return wr.write(buf, count); };
 
+		/** Linux-specific: returns the capacity of the pipe, in bytes. */
+		ssize_t capacity() const;
+
+		/** Linux-specific: resizes the pipe, which fails if it holds more data than
+		 * `cap` (or with EINVAL, if `cap` doesn't fit in an `int`);
+		 * returns the actual capacity, which may be rounded up by the kernel. */
+		ssize_t setCapacity(size_t cap);
+
+		/** Linux-specific: splices up to `count` bytes from `src` into the pipe. */
+		ssize_t spliceFrom(FileView src, off_t* srcOffset, size_t count, SpliceFlags flags = SpliceFlags::eNone);
+
+		/** Linux-specific: splices up to `count` bytes from the pipe into `dst`. */
+		ssize_t spliceTo(FileView dst, off_t* dstOffset, size_t count, SpliceFlags flags = SpliceFlags::eNone);
+
+		/** Linux-specific: duplicates up to `count` bytes from this pipe
+		 * into `dst`; the data can still be read from this pipe. */
+		ssize_t tee(Pipe& dst, size_t count, SpliceFlags flags = SpliceFlags::eNone);
+
+		/** Linux-specific: equivalent to `wr.vmsplice`. */
+		inline ssize_t vmsplice(const struct iovec* iov, int iovcnt, SpliceFlags flags = SpliceFlags::eNone) { return wr.vmsplice(iov, iovcnt, flags); }
+
 		inline operator bool() const { return rd && wr; }
 		inline bool operator!() const { return ! operator bool(); }
 	};
 
 
+	/** Fixed-capacity list of `iovec`s, to build scatter/gather
+	 * I/O requests without allocating memory. */
+	template<size_t capacity>
+	class IoVecList {
+		static_assert(capacity > 0);
+	private:
+		struct iovec vecs_[capacity];
+		size_t size_;
+
+	public:
+		IoVecList(): size_(0) { }
+
+		/** Appends a buffer to the list; the list must not be full. */
+		IoVecList& add(void* base, size_t len) {
+			assert(size_ < capacity);
+			vecs_[size_++] = { base, len };
+			return *this;
+		}
+
+		/** Appends a buffer to the list; the list must not be full.
+		 * `iovec` is not const-qualified, but `writev` does not modify the buffer. */
+		IoVecList& add(const void* base, size_t len) { return add(const_cast<void*>(base), len); }
+
+		inline void clear() { size_ = 0; }
+
+		/** Returns the sum of the lengths of all buffers. */
+		size_t bytes() const {
+			size_t r = 0;
+			for(size_t i = 0; i < size_; ++i) r += vecs_[i].iov_len;
+			return r;
+		}
+
+		inline struct iovec* data() { return vecs_; }
+		inline const struct iovec* data() const { return vecs_; }
+		inline int size() const { return int(size_); }
+		inline bool full() const { return size_ >= capacity; }
+		inline struct iovec& operator[](size_t i) { assert(i < size_); return vecs_[i]; }
+		inline const struct iovec& operator[](size_t i) const { assert(i < size_); return vecs_[i]; }
+	};
+
+
 	class FileView : public File {
 	public:
 		using File::File;
@@ -220,6 +540,55 @@ namespace posixfio {
 	};
 
 
+	/** Linux-specific: waits for many files to be ready at once, using `epoll`.
+	 * Files are registered with a user token, which is returned along with
+	 * their events; a file must be unregistered before it is closed.
+	 *
+	 * Edge-triggered files must be read (or written) until they would
+	 * block before the next `wait`: InputBuffer::fill and OutputBuffer::flush
+	 * report EAGAIN without throwing, so that they can be used to drain
+	 * non-blocking files. */
+	class Poller {
+	private:
+		File epoll_;
+		std::vector<struct epoll_event> events_;
+
+	public:
+		/** Linux-specific: `flags` may be `EPOLL_CLOEXEC`. */
+		static Poller create(int flags = EPOLL_CLOEXEC);
+
+		inline Poller() { }
+		Poller(const Poller&) = delete;
+		Poller(Poller&&) = default;
+		~Poller() = default;
+
+		Poller& operator=(const Poller&) = delete;
+		Poller& operator=(Poller&&) = default;
+
+		inline const FileView file() const { return epoll_; }
+
+		/** Linux-specific: returns `false` exclusively when an error occurs.
+		 * `events` may be combined with `EPOLLET` and `EPOLLONESHOT`. */
+		bool add(FileView file, PollEvents events, std::uint64_t token);
+
+		/** Linux-specific: returns `false` exclusively when an error occurs.
+		 * Also re-arms `EPOLLONESHOT` registrations. */
+		bool modify(FileView file, PollEvents events, std::uint64_t token);
+
+		/** Linux-specific: returns `false` exclusively when an error occurs. */
+		bool remove(FileView file);
+
+		/** Linux-specific: waits up to `timeoutMs` milliseconds (indefinitely if
+		 * negative) for at least one registered file to be ready, and stores up
+		 * to `maxEvents` events in `events`; returns the number of stored events,
+		 * which is 0 if the timeout expires or a signal interrupts the call. */
+		ssize_t wait(PollEvent* events, size_t maxEvents, int timeoutMs = -1);
+
+		inline operator bool() const { return bool(epoll_); }
+		inline bool operator!() const { return ! epoll_; }
+	};
+
+
 	#ifdef POSIXFIO_NOTHROW
 		}
 	#endif
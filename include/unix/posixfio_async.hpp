@@ -0,0 +1,350 @@
+#pragma once
+
+#include <posixfio.hpp>
+#include <posixfio_tl.hpp>
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <semaphore>
+#include <unordered_map>
+
+
+
+namespace posixfio {
+
+	#ifdef POSIXFIO_NOTHROW
+		inline namespace no_throw {
+	#endif
+
+
+	class Reactor;
+
+
+	enum class IoDirection { eIn, eOut };
+
+
+	/** An I/O operation that a Reactor performs on behalf of a suspended coroutine.
+	 *
+	 * The operation itself is a synchronous function (for example `File::read`,
+	 * or `InputBuffer::read`): the Reactor only decides when and where it is
+	 * called, so that it never blocks the thread that awaited it. */
+	class AsyncOp {
+	private:
+		fd_t fd_;
+		IoDirection direction_;
+		ssize_t result_;
+		int errcode_;
+		std::exception_ptr exception_;
+
+	protected:
+		virtual ssize_t perform() = 0;
+
+		/** Follows `File::read` semantics, but never throws a FileError:
+		 * the error is rethrown (or stored in `errno`) when the awaiting coroutine resumes. */
+		ssize_t takeResult();
+
+	public:
+		std::coroutine_handle<> continuation;
+
+		AsyncOp(fd_t fd, IoDirection direction):
+				fd_(fd), direction_(direction), result_(-1), errcode_(0)
+		{ }
+
+		AsyncOp(const AsyncOp&) = delete;
+		AsyncOp& operator=(const AsyncOp&) = delete;
+
+		/** Performs the operation, retrying on `EINTR`; returns `false` if it
+		 * would block, and `true` if it completed (successfully or not). */
+		bool attempt() noexcept;
+
+		inline fd_t fd() const { return fd_; }
+		inline IoDirection direction() const { return direction_; }
+	};
+
+
+	/** Awaitable wrapper around a synchronous I/O function, which
+	 * returns a `ssize_t` following `File::read` semantics. */
+	template<typename Fn>
+	class IoAwaitable : public AsyncOp {
+	private:
+		Reactor* reactor_;
+		Fn fn_;
+
+	protected:
+		ssize_t perform() override { return fn_(); }
+
+	public:
+		IoAwaitable(Reactor& reactor, fd_t fd, IoDirection direction, Fn fn):
+				AsyncOp(fd, direction), reactor_(&reactor), fn_(std::move(fn))
+		{ }
+
+		bool await_ready() const noexcept { return false; }
+		inline bool await_suspend(std::coroutine_handle<> h);
+		ssize_t await_resume() { return takeResult(); }
+	};
+
+
+	/** Performs AsyncOps and resumes their continuations. */
+	class Reactor {
+	public:
+		virtual ~Reactor() = default;
+
+		/** Takes care of performing `op`, then resuming `op.continuation`.
+		 * Returns `false` if `op` completed immediately, in which case
+		 * the continuation must be resumed by the caller. */
+		virtual bool post(AsyncOp& op) = 0;
+	};
+
+
+	template<typename Fn>
+	bool IoAwaitable<Fn>::await_suspend(std::coroutine_handle<> h) {
+		continuation = h;
+		return reactor_->post(*this);
+	}
+
+
+	/** Reactor for pollable files (pipes, sockets, terminals...), which should be non-blocking.
+	 *
+	 * Operations are attempted immediately, and are only queued when they would block;
+	 * queued operations are performed by the threads that call `run` or `runOnce`.
+	 * Files that cannot be polled (such as regular files) are operated on synchronously.
+	 * At most one operation per direction may be queued for the same file at any time. */
+	class EpollReactor : public Reactor {
+	private:
+		struct FdState {
+			AsyncOp* in;
+			AsyncOp* out;
+		};
+
+		File epoll_;
+		File wakeup_;
+		std::mutex mtx_;
+		std::unordered_map<fd_t, FdState> fds_;
+		std::atomic_size_t pending_;
+		std::atomic_bool stop_;
+
+		bool arm(fd_t, const FdState&);
+
+	public:
+		EpollReactor();
+		~EpollReactor();
+
+		bool post(AsyncOp&) override;
+
+		/** Waits up to `timeoutMs` milliseconds (or indefinitely, if negative) for queued
+		 * operations to become ready, then performs them; returns the number of resumed coroutines. */
+		size_t runOnce(int timeoutMs = -1);
+
+		/** Repeatedly calls `runOnce`, until `stop` is called. */
+		void run();
+
+		/** Makes every current and future `run` call return as soon as possible;
+		 * stopping is final, and `run` can't be restarted (`runOnce` still works). */
+		void stop();
+
+		/** Returns the number of queued operations. */
+		inline size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+	};
+
+
+	/** Reactor that performs blocking operations on a pool of threads,
+	 * which is the only way to avoid blocking on regular files.
+	 * Continuations are resumed on the pool threads. */
+	class ThreadPoolReactor : public Reactor {
+	private:
+		struct Impl;
+		Impl* impl_;
+
+	public:
+		ThreadPoolReactor(unsigned threadCount);
+		ThreadPoolReactor(const ThreadPoolReactor&) = delete;
+		~ThreadPoolReactor();
+
+		ThreadPoolReactor& operator=(const ThreadPoolReactor&) = delete;
+
+		bool post(AsyncOp&) override;
+	};
+
+
+	/** Dispatches operations on regular files and block devices to
+	 * a ThreadPoolReactor, and every other operation to an EpollReactor. */
+	class DefaultReactor : public Reactor {
+	private:
+		EpollReactor epoll_;
+		ThreadPoolReactor pool_;
+
+	public:
+		DefaultReactor(unsigned poolThreadCount = 4);
+
+		bool post(AsyncOp&) override;
+
+		inline EpollReactor& epoll() { return epoll_; }
+	};
+
+
+	/** Lazily started coroutine, which produces a value of type `T`
+	 * (or an exception) when awaited. */
+	template<typename T>
+	class AsyncTask {
+	public:
+		struct promise_type {
+			std::optional<T> value;
+			std::exception_ptr exception;
+			std::coroutine_handle<> continuation = std::noop_coroutine();
+
+			AsyncTask get_return_object() { return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return { }; }
+			void return_value(T v) { value.emplace(std::move(v)); }
+			void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+			auto final_suspend() noexcept {
+				struct FinalAwaiter {
+					bool await_ready() noexcept { return false; }
+					void await_resume() noexcept { }
+					std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+						return h.promise().continuation;
+					}
+				};
+				return FinalAwaiter { };
+			}
+		};
+
+	private:
+		std::coroutine_handle<promise_type> handle_;
+
+		explicit AsyncTask(std::coroutine_handle<promise_type> h): handle_(h) { }
+
+	public:
+		AsyncTask(): handle_(nullptr) { }
+		AsyncTask(const AsyncTask&) = delete;
+		AsyncTask(AsyncTask&& mv) noexcept: handle_(std::exchange(mv.handle_, nullptr)) { }
+		~AsyncTask() { if(handle_) handle_.destroy(); }
+
+		AsyncTask& operator=(AsyncTask&& mv) noexcept {
+			this->~AsyncTask();
+			return * new (this) AsyncTask(std::move(mv));
+		}
+
+		bool await_ready() const noexcept { return handle_.done(); }
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept {
+			handle_.promise().continuation = h;
+			return handle_;
+		}
+
+		T await_resume() { return result(); }
+
+		/** Starts the task without awaiting it; its completion can be checked with `done`,
+		 * and the task must not be destroyed before then. */
+		void start() { handle_.resume(); }
+
+		/** Returns the produced value, or rethrows the exception; the task must be done. */
+		T result() {
+			auto& p = handle_.promise();
+			if(p.exception) std::rethrow_exception(p.exception);
+			return std::move(*p.value);
+		}
+
+		inline bool done() const { return handle_.done(); }
+		inline operator bool() const { return bool(handle_); }
+	};
+
+
+	namespace _async_impl {
+
+		/* This namespace is only to be used internally by this library,
+		 * and its signatures may change at any time in any way.
+		 * */
+
+		struct Detached {
+			struct promise_type {
+				Detached get_return_object() noexcept { return { }; }
+				std::suspend_never initial_suspend() noexcept { return { }; }
+				std::suspend_never final_suspend() noexcept { return { }; }
+				void return_void() noexcept { }
+				void unhandled_exception() noexcept { std::terminate(); }
+			};
+		};
+
+		/** Awaits the task without consuming its result, then calls `fn`. */
+		template<typename T, typename Fn>
+		Detached awaitThen(AsyncTask<T>& task, Fn fn) {
+			struct Awaiter {
+				AsyncTask<T>& task;
+				bool await_ready() const noexcept { return task.await_ready(); }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept { return task.await_suspend(h); }
+				void await_resume() noexcept { }
+			};
+			co_await Awaiter { task };
+			fn();
+		}
+
+	}
+
+
+	/** Starts the task, then blocks until it is done; the reactors used
+	 * by the task must be run by other threads. */
+	template<typename T>
+	T syncWait(AsyncTask<T> task) {
+		std::binary_semaphore done(0);
+		_async_impl::awaitThen(task, [&]() { done.release(); });
+		done.acquire();
+		return task.result();
+	}
+
+	/** Starts the task, then runs the reactor on the calling thread until the task is done. */
+	template<typename T>
+	T runUntilDone(EpollReactor& reactor, AsyncTask<T> task) {
+		bool done = false;
+		_async_impl::awaitThen(task, [&]() { done = true; });
+		while(! done) reactor.runOnce();
+		return task.result();
+	}
+
+
+	/** Awaitable equivalent of File::read. */
+	inline auto asyncRead(Reactor& r, FileView file, void* buf, size_t count) {
+		return IoAwaitable(r, file.fd(), IoDirection::eIn, [file, buf, count]() mutable { return file.read(buf, count); });
+	}
+
+	/** Awaitable equivalent of File::write. */
+	inline auto asyncWrite(Reactor& r, FileView file, const void* buf, size_t count) {
+		return IoAwaitable(r, file.fd(), IoDirection::eOut, [file, buf, count]() mutable { return file.write(buf, count); });
+	}
+
+	/** Awaitable equivalent of InputBuffer::read. */
+	inline auto asyncRead(Reactor& r, InputBuffer& in, void* buf, size_t count) {
+		return IoAwaitable(r, in.file().fd(), IoDirection::eIn, [&in, buf, count]() { return in.read(buf, count); });
+	}
+
+	/** Awaitable equivalent of OutputBuffer::write. */
+	inline auto asyncWrite(Reactor& r, OutputBuffer& out, const void* buf, size_t count) {
+		return IoAwaitable(r, out.file().fd(), IoDirection::eOut, [&out, buf, count]() { return out.write(buf, count); });
+	}
+
+	/** Asynchronous equivalent of readAll. */
+	AsyncTask<ssize_t> asyncReadAll(Reactor&, FileView, void* buf, size_t count);
+
+	/** Asynchronous equivalent of writeAll. */
+	AsyncTask<ssize_t> asyncWriteAll(Reactor&, FileView, const void* buf, size_t count);
+
+	/** Asynchronous equivalent of InputBuffer::readAll. */
+	AsyncTask<ssize_t> asyncReadAll(Reactor&, InputBuffer&, void* buf, size_t count);
+
+	/** Asynchronous equivalent of OutputBuffer::writeAll. */
+	AsyncTask<ssize_t> asyncWriteAll(Reactor&, OutputBuffer&, const void* buf, size_t count);
+
+	/** Asynchronous equivalent of OutputBuffer::flush;
+	 * returns the number of flushed bytes. */
+	AsyncTask<ssize_t> asyncFlush(Reactor&, OutputBuffer&);
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <posixfio.hpp>
+
+#include <expected>
+
+
+
+namespace posixfio::ex {
+
+	/* This namespace is declared outside of `no_throw`, and its signatures
+	 * don't depend on `POSIXFIO_NOTHROW`: it is compiled into the library
+	 * regardless of how errors are handled elsewhere, and every function
+	 * reports errors through its return value.
+	 * */
+
+
+	/** The `errno` value of a failed call; equivalent to posixfio::Errcode. */
+	struct Errcode {
+		int errcode;
+
+		constexpr Errcode(int errcode): errcode(errcode) { }
+		constexpr operator int() const { return errcode; }
+	};
+
+	template<typename T>
+	using Result = std::expected<T, Errcode>;
+
+
+	/** Owning file descriptor, similar to posixfio::File; it can't be copied,
+	 * since `dup` can fail and copy constructors can't report it. */
+	class File {
+	private:
+		fd_t fd_;
+
+	public:
+		static constexpr fd_t NULL_FD = -1;
+
+		/** POSIX-compliant. */
+		static Result<File> open(const char* pathname, int flags, mode_t mode = 0) noexcept;
+
+		/** POSIX-compliant. */
+		static Result<File> openat(fd_t dirfd, const char* pathname, int flags, mode_t mode = 0) noexcept;
+
+		inline File() noexcept: fd_(NULL_FD) { }
+		inline explicit File(fd_t fd) noexcept: fd_(fd) { }
+		inline File(File&& mv) noexcept: fd_(mv.fd_) { mv.fd_ = NULL_FD; }
+		File(const File&) = delete;
+
+		/** Closes the file descriptor, ignoring errors. */
+		~File();
+
+		File& operator=(File&&) noexcept;
+		File& operator=(const File&) = delete;
+
+		/** POSIX-compliant. */
+		Result<size_t> read(void* buf, size_t count) noexcept;
+
+		/** POSIX-compliant. */
+		Result<size_t> write(const void* buf, size_t count) noexcept;
+
+		/** POSIX-compliant. */
+		Result<size_t> pread(void* buf, size_t count, off_t offset) noexcept;
+
+		/** POSIX-compliant. */
+		Result<size_t> pwrite(const void* buf, size_t count, off_t offset) noexcept;
+
+		/** POSIX-compliant. */
+		Result<off_t> lseek(off_t offset, int whence) noexcept;
+
+		/** POSIX-compliant. */
+		Result<void> fsync() noexcept;
+
+		/** POSIX-compliant. */
+		Result<void> fdatasync() noexcept;
+
+		/** POSIX-compliant. */
+		Result<void> ftruncate(off_t length) noexcept;
+
+		/** POSIX-compliant; the file descriptor is released even if an error occurs,
+		 * since retrying `close` is unsafe on Linux. */
+		Result<void> close() noexcept;
+
+		/** Sets the internal file descriptor to `NULL_FD`, then returns its old value;
+		 * it can be used to hand the descriptor to a posixfio::File. */
+		inline fd_t disown() noexcept { fd_t r = fd_;  fd_ = NULL_FD;  return r; }
+
+		inline fd_t fd() const noexcept { return fd_; }
+		inline operator fd_t() const noexcept { return fd_; }
+		inline operator bool() const noexcept { return fd_ >= 0; }
+		inline bool operator!() const noexcept { return fd_ < 0; }
+	};
+
+
+	/** Similar to posixfio::readAll: stops at EOF, and returns the number of bytes read.
+	 * Bytes read before an error are lost, like with posixfio::readAll. */
+	Result<size_t> readAll(fd_t, void* buf, size_t count) noexcept;
+
+	/** Similar to posixfio::writeAll. */
+	Result<size_t> writeAll(fd_t, const void* buf, size_t count) noexcept;
+
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <posixfio.hpp>
+
+#include <cstdint>
+
+
+
+namespace posixfio {
+
+	#ifdef POSIXFIO_NOTHROW
+		inline namespace no_throw {
+	#endif
+
+
+	namespace _log_impl {
+
+		/* This namespace is only to be used internally by this library,
+		 * and its signatures may change at any time in any way.
+		 * */
+
+		/** Precedes every record; a record whose size is 0 marks the end of the log. */
+		struct RecordHeader {
+			std::uint32_t size;
+			std::uint32_t checksum;
+		};
+
+		constexpr size_t recordAlignment = alignof(std::uint64_t);
+
+		constexpr size_t alignRecord(size_t size) {
+			return (size + (recordAlignment - 1)) & ~(recordAlignment - 1);
+		}
+
+		std::uint32_t checksum(const void* data, std::uint32_t size);
+
+	}
+
+
+	enum class LogSyncMode {
+		eRange,     // `msync` of the records appended since the last sync
+		eFdatasync  // `fdatasync` of the whole file
+	};
+
+
+	/** Describes what `MappedAppendLog::open` found in an existing log. */
+	struct LogRecovery {
+		size_t records;
+		off_t validSize;
+
+		/** Number of bytes after the last valid record, which were discarded:
+		 * 0 if the log was closed cleanly, otherwise a torn record
+		 * and (or) the unused part of the last extent. */
+		off_t truncatedSize;
+	};
+
+
+	/** Append-only journal of variable-size records, which are written directly into
+	 * a shared mapping of the file, instead of going through `write` calls.
+	 *
+	 * The file grows in extents of (at least) `extentSize` bytes, allocated with
+	 * `fallocate` and mapped with `mremap`; when the log is closed, the file is
+	 * truncated to the end of the last record.
+	 * Each record is preceded by its size and checksum, so that opening a log after
+	 * a crash discards a torn tail, and only records that were fully written survive.
+	 *
+	 * A MappedAppendLog is not thread-safe. */
+	class MappedAppendLog {
+	private:
+		File file_;
+		MemMapping map_;
+		size_t extentSize_;
+		size_t end_;
+		size_t syncedEnd_;
+		size_t reserved_;
+		size_t recordCount_;
+		LogRecovery recovery_;
+
+		bool grow(size_t minSize);
+
+	public:
+		static constexpr size_t defaultExtentSize = 64 * 1024 * 1024;
+
+		/** Takes ownership of `file`, which must be open for reading and writing,
+		 * and recovers the records it contains. */
+		static MappedAppendLog open(File file, size_t extentSize = defaultExtentSize);
+
+		/** Opens or creates the file at `pathname`, and recovers the records it contains. */
+		static MappedAppendLog open(const char* pathname, size_t extentSize = defaultExtentSize);
+
+		MappedAppendLog() noexcept;
+		MappedAppendLog(const MappedAppendLog&) = delete;
+		MappedAppendLog(MappedAppendLog&&) noexcept;
+		~MappedAppendLog();
+
+		MappedAppendLog& operator=(const MappedAppendLog&) = delete;
+		MappedAppendLog& operator=(MappedAppendLog&&) noexcept;
+
+		/** Returns a pointer to `size` bytes at the end of the log, where the next record
+		 * can be written; the record is only appended by `commit`, and any previous
+		 * uncommitted reservation is abandoned.
+		 * The pointer is invalidated by the next `reserve` or `append` call.
+		 * Returns `nullptr` exclusively when an error occurs. */
+		[[nodiscard]]
+		void* reserve(size_t size);
+
+		/** Appends the reserved record, which may be shorter than the reservation. */
+		void commit(size_t size);
+
+		/** Appends the reserved record. */
+		inline void commit() { commit(reserved_); }
+
+		/** Copies `size` bytes into a new record; returns `false` exclusively when an error occurs. */
+		bool append(const void* buf, size_t size);
+
+		/** Makes every committed record durable; returns `false` exclusively when an error occurs. */
+		bool sync(LogSyncMode mode = LogSyncMode::eRange);
+
+		/** Unmaps the log, and truncates the file to the end of the last record;
+		 * returns `false` exclusively when an error occurs. */
+		bool close();
+
+		/** Calls `fn(const void* data, size_t size)` for every committed record, in order. */
+		template<typename Fn>
+		void forEach(Fn&& fn) const {
+			auto base = map_.get<const unsigned char>();
+			size_t pos = 0;
+			while(pos < end_) {
+				auto hdr = reinterpret_cast<const _log_impl::RecordHeader*>(base + pos);
+				fn(static_cast<const void*>(hdr + 1), size_t(hdr->size));
+				pos += sizeof(*hdr) + _log_impl::alignRecord(hdr->size);
+			}
+		}
+
+		/** Returns the number of committed records. */
+		inline size_t recordCount() const { return recordCount_; }
+
+		/** Returns the size of the committed records, including their headers. */
+		inline size_t size() const { return end_; }
+
+		/** Returns what was found when the log was opened. */
+		inline const LogRecovery& recovery() const { return recovery_; }
+
+		inline const File& file() const { return file_; }
+		inline operator bool() const { return bool(map_); }
+	};
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
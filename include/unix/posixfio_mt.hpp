@@ -0,0 +1,349 @@
+#pragma once
+
+#include <posixfio.hpp>
+#include <posixfio_tl.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <future>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+
+namespace posixfio {
+
+	#ifdef POSIXFIO_NOTHROW
+		inline namespace no_throw {
+	#endif
+
+
+	enum class GroupSyncMode {
+		eFdatasync,  // Data and the metadata required to read it back
+		eFsync       // Data and all metadata
+	};
+
+
+	struct GroupCommitOptions {
+		/** How long the thread that syncs a batch waits for more appends,
+		 * counting from the first append of the batch; with 0, a batch is made
+		 * of the appends that happened while the previous one was being synced. */
+		std::chrono::microseconds maxLatency = std::chrono::microseconds(0);
+
+		/** A batch is synced as soon as it reaches this size, and appends
+		 * block (or sync the batch themselves) while the staged data exceeds it. */
+		size_t maxBytes = 1024 * 1024;
+
+		GroupSyncMode syncMode = GroupSyncMode::eFdatasync;
+	};
+
+
+	struct GroupCommitStats {
+		std::uint64_t commits;  // Appends that were made durable
+		std::uint64_t syncs;    // Batches, each written and synced at once
+		std::uint64_t bytes;    // Bytes that were made durable
+
+		inline double commitsPerSync() const { return (syncs == 0)? 0.0 : double(commits) / double(syncs); }
+	};
+
+
+	/** Thread-safe writer, which makes data durable in batches: every thread
+	 * appends its data to a shared staging area, then waits for a ticket;
+	 * the first waiting thread writes the whole batch and syncs the file once,
+	 * on behalf of every append in the batch.
+	 *
+	 * Data is written at the file offset, in the order it was appended.
+	 * After a write or sync error the writer is unusable, and every
+	 * current and future wait fails with the same error. */
+	class GroupCommitWriter {
+	public:
+		/** Identifies the end of an append; tickets grow monotonically. */
+		using Ticket = std::uint64_t;
+
+	private:
+		FileView file_;
+		GroupCommitOptions opts_;
+		mutable std::mutex mtx_;
+		std::condition_variable batchFull_;
+		std::condition_variable batchDone_;
+		std::vector<byte_t> staging_;
+		std::vector<byte_t> flushing_;
+		std::chrono::steady_clock::time_point batchStart_;
+		Ticket appended_;
+		Ticket durable_;
+		std::uint64_t stagedCommits_;
+		GroupCommitStats stats_;
+		int errcode_;
+		bool leading_;
+
+		void lead(std::unique_lock<std::mutex>&);
+		bool waitLocked(std::unique_lock<std::mutex>&, Ticket);
+
+	public:
+		GroupCommitWriter(FileView, GroupCommitOptions = { });
+		GroupCommitWriter(const GroupCommitWriter&) = delete;
+
+		/** Makes every appended byte durable, ignoring errors. */
+		~GroupCommitWriter();
+
+		GroupCommitWriter& operator=(const GroupCommitWriter&) = delete;
+
+		inline const FileView file() const { return file_; }
+
+		/** Stages a copy of `count` bytes, and returns the ticket to wait for;
+		 * never blocks on I/O, unless the staging area is full and no other
+		 * thread is syncing it. */
+		Ticket append(const void* buf, size_t count);
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * Blocks until the append that returned `ticket` is durable; the calling
+		 * thread may write and sync a batch on behalf of other threads. */
+		bool wait(Ticket ticket);
+
+		/** Appends the data, and waits for it to be durable. */
+		inline bool commit(const void* buf, size_t count) { return wait(append(buf, count)); }
+
+		/** Waits for every byte appended so far to be durable. */
+		bool sync();
+
+		GroupCommitStats stats() const;
+	};
+
+
+	/** Thread-safe output buffer, which never locks: producers reserve their
+	 * bytes with an atomic increment of the buffer's tail, and copy them into
+	 * a ring of fixed-size segments; a dedicated flusher thread writes every
+	 * completed segment (or a flushed partial one) with `writev`.
+	 *
+	 * Every `write` call is written to the file contiguously, in the order
+	 * in which the calls reserved their space, so that the writes of a
+	 * single thread are never reordered.
+	 * Errors occurring on the flusher thread are reported by every
+	 * subsequent `write` and `flush` call, and the data that could
+	 * not be written is discarded. */
+	class ConcurrentOutputBuffer {
+	private:
+		static constexpr size_t cacheLine = 64;
+
+		FileView file_;
+		size_t segmentSize_;
+		size_t segmentCount_;
+		byte_t* ring_;
+		std::atomic_size_t* committed_;
+		std::thread flusher_;
+		alignas(cacheLine) std::atomic_uint64_t tail_;
+		alignas(cacheLine) std::atomic_uint64_t flushed_;
+		std::atomic_uint32_t drained_;
+		alignas(cacheLine) std::atomic_uint32_t wake_;
+		std::atomic_uint32_t flushWaiters_;
+		std::atomic_int errcode_;
+		std::atomic_bool stop_;
+
+		void notifyFlusher();
+		void waitFlushed(std::uint64_t position);
+		void drain();
+		void runFlusher();
+		bool checkError();
+
+	public:
+		static constexpr size_t defaultSegmentSize = 64 * 1024;
+		static constexpr size_t defaultSegmentCount = 16;
+
+		ConcurrentOutputBuffer(FileView, size_t segmentSize = defaultSegmentSize, size_t segmentCount = defaultSegmentCount);
+		ConcurrentOutputBuffer(const ConcurrentOutputBuffer&) = delete;
+
+		/** Writes every buffered byte, then stops the flusher thread. */
+		~ConcurrentOutputBuffer();
+
+		ConcurrentOutputBuffer& operator=(const ConcurrentOutputBuffer&) = delete;
+
+		inline const FileView file() const { return file_; }
+
+		/** Copies `count` bytes into the buffer, blocking only while the
+		 * ring is full; returns `count`, following writeAll semantics.
+		 * Writes larger than `capacity()` (minus a segment) are split, and their parts may be
+		 * interleaved with other threads' writes. */
+		ssize_t write(const void* buf, size_t count);
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * Blocks until every byte written before the call has been written to the file. */
+		bool flush();
+
+		inline size_t capacity() const { return segmentSize_ * segmentCount_; }
+	};
+
+
+	/** What an AsyncOutputBuffer does when every buffer is waiting to be written. */
+	enum class BackpressurePolicy {
+		eBlock,  // Wait for the writer thread to release a buffer
+		eDrop,   // Discard the whole `write` call, and count its bytes as dropped
+		eGrow    // Allocate another buffer
+	};
+
+
+	/** Output buffer that hands full buffers to a dedicated writer thread,
+	 * so that the producer never waits for `write` calls on the file
+	 * (unless the policy is BackpressurePolicy::eBlock, and the writer thread
+	 * is too slow to keep up).
+	 *
+	 * Like OutputBuffer, an AsyncOutputBuffer must only be used by one thread
+	 * at a time; data is written at the file offset, in order.
+	 * Errors occurring on the writer thread are reported by the next `write`
+	 * call that needs another buffer, or by the next `flush`; the data that
+	 * could not be written is discarded. */
+	class AsyncOutputBuffer {
+	private:
+		struct Job {
+			byte_t* buffer;  // `nullptr` for jobs that only fulfill a `flush`
+			size_t size;
+			std::optional<std::promise<ssize_t>> done;
+		};
+
+		FileView file_;
+		size_t capacity_;
+		BackpressurePolicy policy_;
+		std::vector<byte_t*> buffers_;
+		std::vector<byte_t*> free_;
+		std::deque<Job> queue_;
+		byte_t* current_;
+		size_t currentSize_;
+		size_t dropped_;
+		size_t written_;
+		int errcode_;
+		bool stop_;
+		std::mutex mtx_;
+		std::condition_variable queueCond_;
+		std::condition_variable freeCond_;
+		std::thread writer_;
+
+		void runWriter();
+		void handOff(std::unique_lock<std::mutex>&, std::optional<std::promise<ssize_t>> done = std::nullopt);
+		bool checkError(std::unique_lock<std::mutex>&);
+
+	public:
+		AsyncOutputBuffer(FileView, size_t capacity, size_t bufferCount = 2, BackpressurePolicy = BackpressurePolicy::eBlock);
+		AsyncOutputBuffer(const AsyncOutputBuffer&) = delete;
+
+		/** Writes every buffered byte, then stops the writer thread;
+		 * errors are ignored. */
+		~AsyncOutputBuffer();
+
+		AsyncOutputBuffer& operator=(const AsyncOutputBuffer&) = delete;
+
+		inline const FileView file() const { return file_; }
+
+		/** Copies `count` bytes into the buffers, handing each full buffer
+		 * to the writer thread; returns `count`, following writeAll semantics,
+		 * or 0 if the policy is BackpressurePolicy::eDrop and the data
+		 * did not fit in the available buffers. */
+		ssize_t write(const void* buf, size_t count);
+
+		/** Hands the current buffer to the writer thread; the returned future
+		 * becomes ready when every byte written before the call has been
+		 * written to the file, and holds the number of bytes written to the file
+		 * so far.
+		 * A write error is rethrown by `std::future::get` as a FileError
+		 * (or reported as -1, if exceptions are disabled). */
+		std::future<ssize_t> flush();
+
+		/** Returns the number of bytes discarded by BackpressurePolicy::eDrop. */
+		inline size_t dropped() const { return dropped_; }
+
+		/** Returns the number of allocated buffers, which only
+		 * grows with BackpressurePolicy::eGrow. */
+		inline size_t bufferCount() const { return buffers_.size(); }
+
+		inline size_t capacity() const { return capacity_; }
+	};
+
+
+	/** Input buffer whose data is read ahead of the consumer by a dedicated
+	 * reader thread, which keeps up to `depth` buffers filled, so that parsing
+	 * and I/O overlap; it exposes the same interface as InputBuffer.
+	 *
+	 * Reading starts from the file offset as soon as the buffer is
+	 * constructed, and the offset is moved ahead of the consumer.
+	 * Reads that block indefinitely (for example on an idle pipe) also
+	 * block the destructor, which waits for the reader thread. */
+	class PrefetchInputBuffer {
+	private:
+		struct Block {
+			byte_t* data;
+			size_t begin;
+			size_t end;
+		};
+
+		FileView file_;
+		size_t capacity_;
+		std::vector<byte_t*> buffers_;
+		std::vector<byte_t*> free_;
+		std::deque<Block> ready_;
+		Block pending_;  // Next block, partially consumed by `fill`
+		byte_t* buffer_;
+		size_t begin_;
+		size_t end_;
+		int errcode_;
+		bool eof_;
+		bool stop_;
+		std::mutex mtx_;
+		std::condition_variable readyCond_;
+		std::condition_variable freeCond_;
+		std::thread reader_;
+
+		void runReader();
+		ssize_t nextBlock(Block*);
+
+	public:
+		static constexpr size_t defaultDepth = 4;
+
+		PrefetchInputBuffer(FileView, size_t capacity, size_t depth = defaultDepth);
+		PrefetchInputBuffer(const PrefetchInputBuffer&) = delete;
+		~PrefetchInputBuffer();
+
+		PrefetchInputBuffer& operator=(const PrefetchInputBuffer&) = delete;
+
+		inline const FileView file() const { return file_; }
+
+		/** Similar to File::read, but may fail after a partial read. */
+		ssize_t read(void* buf, size_t count);
+
+		/** Similar to readAll, but may fail after a partial read. */
+		ssize_t readAll(void* buf, size_t count);
+
+		/** Similar to readLeast, but may fail after a partial read. */
+		ssize_t readLeast(void* buf, size_t least, size_t count);
+
+		/** Try to fill the buffer with prefetched data, if it isn't already full,
+		 * waiting for the reader thread if necessary; returns the number of bytes
+		 * that became available, following File::read semantics.
+		 * Pointers returned by `data` are invalidated. */
+		ssize_t fill();
+
+		/** If the buffer is empty, try to fill it; then discard one byte.
+		 * The return value follows File::read semantics. */
+		ssize_t fwd();
+
+		/** Returns a pointer to the first ready-to-read byte in the buffer. */
+		inline byte_t* data() { return buffer_ + begin_; }
+
+		/** Returns a pointer to the first ready-to-read byte in the buffer. */
+		inline const byte_t* data() const { return buffer_ + begin_; }
+
+		/** Returns the number of ready-to-read bytes. */
+		inline size_t size() const { return end_ - begin_; }
+
+		/** Discard the entire buffer; the next read will take the next prefetched block. */
+		inline void discard() { begin_ = 0;  end_ = 0; }
+	};
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
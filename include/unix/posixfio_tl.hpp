@@ -5,19 +5,70 @@
 #include <utility>
 #include <cstddef>
 #include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <span>
+#include <memory>
+#include <chrono>
 
 
 
 namespace posixfio {
 
+	/** How the file of a buffer is going to be accessed; buffers use it
+	 * to give hints to the kernel about read-ahead and the page cache,
+	 * and ignore any error that the hints may cause. */
+	enum class AccessPattern {
+		eDefault,     // No hint
+		eSequential,  // From start to end, with aggressive read-ahead
+		eRandom,      // Without read-ahead
+		eOnce         // Sequentially, and only once: pages are dropped from the page cache as soon as they're used
+	};
+
+
 	namespace _buffer_op_impl {
 
 		/* This namespace is only to be used internally by this library,
 		 * and its signatures may change at any time in any way.
 		 * */
 
-		ssize_t bfRead(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr, void* dst, size_t count);
+		/** Tracks the file range that a buffer has transferred, for AccessPattern::eOnce. */
+		struct CacheHints {
+			AccessPattern pattern;
+			off_t offset;     // File offset after the last transfer
+			off_t writeback;  // Written bytes before this offset are being written back
+			off_t dropped;    // Bytes before this offset have been dropped from the page cache
+		};
+
+		constexpr off_t cacheDropInterval = 1024 * 1024;
+
+		CacheHints hintOpen(FileView, AccessPattern);
+		void hintTransferred(FileView, CacheHints*, size_t count, bool output);
+		void hintClose(FileView, CacheHints*, bool output);
+
+		ssize_t bfRead(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr, size_t bufCapacity, void* dst, size_t count);
 		ssize_t bfWrite(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr, size_t bufCapacity, const void* src, size_t count);
+		ssize_t bfFlush(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr);
+
+		/** Similar to File::read and File::write, but EAGAIN never throws. */
+		ssize_t readReady(FileView, void* buf, size_t count);
+		ssize_t writeReady(FileView, const void* buf, size_t count);
+
+		/** Delimiter scanning kernel; returns `nullptr` if the byte is not found. */
+		using FindByteFn = const unsigned char* (*)(const unsigned char* src, size_t count, unsigned char b);
+
+		struct FindByteKernel {
+			const char* name;
+			FindByteFn fn;
+		};
+
+		/** Returns the kernels that the CPU supports, starting with the one used by `findByte`. */
+		std::span<const FindByteKernel> findByteKernels();
+
+		const unsigned char* findByte(const unsigned char* src, size_t count, unsigned char b);
 
 	};
 
@@ -46,6 +97,121 @@ namespace posixfio {
 	ssize_t writeLeast(FileView, const void* buf, size_t least, size_t count);
 
 
+	/** Repeatedly reads data from the given FileView at the given offset,
+	 * until `count` bytes have been read, EOF is reached or an error occurs;
+	 * the file offset is neither used nor changed. */
+	ssize_t preadAll(FileView, void* buf, size_t count, off_t offset);
+
+	/** Repeatedly writes data to the given FileView at the given offset,
+	 * until `count` bytes have been written or an error occurs;
+	 * the file offset is neither used nor changed. */
+	ssize_t pwriteAll(FileView, const void* buf, size_t count, off_t offset);
+
+
+	/** Repeatedly reads data from the given FileView into the given buffers,
+	 * until all of them have been filled, EOF is reached or an error occurs;
+	 * partial reads are resumed from the first byte that hasn't been read. */
+	ssize_t readAllV(FileView, const struct iovec* iov, int iovcnt);
+
+	/** Repeatedly writes the given buffers to the given FileView,
+	 * until all of them have been written or an error occurs;
+	 * partial writes are resumed from the first byte that hasn't been written. */
+	ssize_t writeAllV(FileView, const struct iovec* iov, int iovcnt);
+
+	template<size_t capacity>
+	ssize_t readAllV(FileView file, const IoVecList<capacity>& iov) { return readAllV(file, iov.data(), iov.size()); }
+
+	template<size_t capacity>
+	ssize_t writeAllV(FileView file, const IoVecList<capacity>& iov) { return writeAllV(file, iov.data(), iov.size()); }
+
+
+	/** Why a transfer that follows an IoPolicy stopped. */
+	enum class IoStatus {
+		eComplete,     // Enough bytes were transferred
+		eEof,          // The file ended before enough bytes were read
+		eWouldBlock,   // The file is non-blocking and isn't ready (EAGAIN)
+		eInterrupted,  // A signal interrupted a call (EINTR)
+		eTimeout,      // The deadline expired
+		eError         // Any other error
+	};
+
+	/** How readAll, readLeast, writeAll and writeLeast react to files
+	 * that aren't ready, or to signals. */
+	struct IoPolicy {
+		/** Restart calls that are interrupted by a signal, instead of stopping with IoStatus::eInterrupted. */
+		bool retryInterrupted = true;
+
+		/** Wait for non-blocking files to become ready with `poll`, instead of
+		 * stopping with IoStatus::eWouldBlock. */
+		bool waitReady = false;
+
+		/** Stop with IoStatus::eTimeout after this time point; it is checked
+		 * between calls and bounds the waits of `waitReady`, but a single
+		 * call on a blocking file may still overrun it. */
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	};
+
+	struct IoResult {
+		size_t count;     // Bytes transferred before stopping, regardless of the status
+		IoStatus status;
+		int errcode;      // The `errno` value that stopped the transfer, or 0
+
+		inline bool complete() const { return status == IoStatus::eComplete; }
+	};
+
+	/** Linux-specific: similar to readAll, but never throws; the number of bytes
+	 * read is reported along with the reason why reading stopped. */
+	IoResult readAll(FileView, void* buf, size_t count, const IoPolicy&);
+
+	/** Linux-specific: similar to readLeast, but never throws; the number of bytes
+	 * read is reported along with the reason why reading stopped. */
+	IoResult readLeast(FileView, void* buf, size_t least, size_t count, const IoPolicy&);
+
+	/** Linux-specific: similar to writeAll, but never throws; the number of bytes
+	 * written is reported along with the reason why writing stopped. */
+	IoResult writeAll(FileView, const void* buf, size_t count, const IoPolicy&);
+
+	/** Linux-specific: similar to writeLeast, but never throws; the number of bytes
+	 * written is reported along with the reason why writing stopped. */
+	IoResult writeLeast(FileView, const void* buf, size_t least, size_t count, const IoPolicy&);
+
+
+	/** The mechanism used by `transfer` to move data between two files. */
+	enum class TransferStrategy {
+		eNone,           // No data was transferred
+		eCopyFileRange,  // In-kernel copy, or reflink on filesystems that support it
+		eSendfile,       // In-kernel copy from a file to any other file
+		eSplice,         // In-kernel copy through a pipe, either given or internal
+		eBuffered        // `read` and `write` through a userspace buffer
+	};
+
+	struct TransferHints {
+		/** Size of each kernel request, and of the buffer used by the buffered fallback. */
+		size_t chunkSize = 1024 * 1024;
+		bool allowCopyFileRange = true;
+		bool allowSendfile = true;
+		bool allowSplice = true;
+	};
+
+	struct TransferResult {
+		/** Follows readAll semantics. */
+		ssize_t count;
+
+		/** The strategy that completed the transfer; if the kernel refused
+		 * a faster strategy after some data was transferred, the remaining
+		 * data may have been transferred by another one. */
+		TransferStrategy strategy;
+	};
+
+	/** Copies data from `src` to `dst` until `count` bytes have been
+	 * copied, EOF is reached or an error occurs, without moving the data
+	 * to userspace whenever the kernel allows it; both file offsets are used
+	 * and changed, like `read` and `write` would.
+	 * Strategies are attempted in the order they are listed in by TransferStrategy,
+	 * and the next one is used only if the kernel refuses the previous one. */
+	TransferResult transfer(FileView src, FileView dst, size_t count, TransferHints = { });
+
+
 	class InputBuffer {
 	private:
 		FileView file_;
@@ -53,12 +219,24 @@ namespace posixfio {
 		size_t end_;
 		size_t capacity_;
 		byte_t* buffer_;
+		std::pmr::memory_resource* memory_;
+		_buffer_op_impl::CacheHints hints_;
+		std::string spill_;  // Lines that don't fit in the buffer
+		bool spillPending_;  // Whether `spill_` holds the beginning of an unfinished line
 
 	public:
 		InputBuffer() noexcept;
 		InputBuffer(const InputBuffer&) = delete;
 		InputBuffer(InputBuffer&&) noexcept;
-		InputBuffer(FileView, size_t capacity);
+
+		/** The buffer is allocated from the given memory resource,
+		 * which must outlive it. */
+		InputBuffer(FileView, size_t capacity, AccessPattern = AccessPattern::eDefault, std::pmr::memory_resource* = std::pmr::get_default_resource());
+
+		inline InputBuffer(FileView file, size_t capacity, std::pmr::memory_resource* memory):
+			InputBuffer(file, capacity, AccessPattern::eDefault, memory)
+		{ }
+
 		~InputBuffer();
 
 		InputBuffer& operator=(InputBuffer&&) noexcept;
@@ -74,9 +252,45 @@ namespace posixfio {
 		/** Similar to readLeast, but may fail after a partial read. */
 		ssize_t readLeast(void* buf, size_t least, size_t count);
 
+		/** Reads bytes until `delim` (which is read too), until `count` bytes
+		 * have been read, EOF is reached or an error occurs;
+		 * may fail after a partial read. */
+		ssize_t readUntil(void* buf, size_t count, byte_t delim);
+
+		/** Reads a line terminated by `delim`, which is consumed but not
+		 * included in the line; returns the number of bytes consumed,
+		 * following File::read semantics (0 means EOF).
+		 * The line points into the buffer, unless it's longer than the buffer,
+		 * in which case it's copied into a separate string; either way,
+		 * it's only valid until the next call.
+		 * If reading fails in the middle of a line (including EAGAIN, for
+		 * non-blocking files), the next call resumes the same line. */
+		ssize_t readLine(std::string_view* line, byte_t delim = '\n');
+
+		/** Calls `fn(std::string_view)` for each line until EOF, or until `fn`
+		 * returns `false` (if it returns `bool`); returns the number of bytes
+		 * consumed, or -1 if an error occurs. */
+		template<typename Fn>
+		ssize_t forEachLine(Fn&& fn, byte_t delim = '\n') {
+			ssize_t total = 0;
+			std::string_view line;
+			ssize_t rd;
+			while(0 < (rd = readLine(&line, delim))) {
+				total += rd;
+				if constexpr(std::is_same_v<std::invoke_result_t<Fn&, std::string_view>, bool>) {
+					if(! fn(line)) return total;
+				} else {
+					fn(line);
+				}
+			}
+			return (rd < 0)? rd : total;
+		}
+
 		/** Try to fill the buffer, if it isn't already full;
 		 * returns the number of characters read by the attempt
-		 * (not the total capacity), following File::read semantics. */
+		 * (not the total capacity), following File::read semantics.
+		 * If the file is non-blocking and has no data, returns -1 and sets
+		 * `errno` to EAGAIN, without throwing. */
 		ssize_t fill();
 
 		/** If the buffer is empty, try to fill it; then discard one byte.
@@ -94,6 +308,24 @@ namespace posixfio {
 
 		/** Discard the entire buffer; the next read will try to fill the buffer. */
 		inline void discard() { begin_ = 0;  end_ = 0; }
+
+		/** Moves the ready-to-read bytes to the beginning of the buffer,
+		 * unless `n` bytes already fit between the first one and the end
+		 * of the buffer; returns `false` if `n` exceeds the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		bool reserveContiguous(size_t n);
+
+		/** Fills the buffer until at least `n` contiguous bytes are ready to be read,
+		 * or EOF is reached; returns the number of ready-to-read bytes, which
+		 * is smaller than `n` only on EOF, or -1 if an error occurs.
+		 * `n` must not exceed the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		ssize_t peek(size_t n);
+
+		/** Discards `n` ready-to-read bytes, which must have been made available by `peek` or `fill`. */
+		inline void consume(size_t n) { assert(n <= size());  begin_ += n; }
+
+		inline size_t capacity() const { return capacity_; }
 	};
 
 
@@ -104,12 +336,22 @@ namespace posixfio {
 		size_t end_;
 		size_t capacity_;
 		byte_t* buffer_;
+		std::pmr::memory_resource* memory_;
+		_buffer_op_impl::CacheHints hints_;
 
 	public:
 		OutputBuffer() noexcept;
 		OutputBuffer(const OutputBuffer&) = delete;
 		OutputBuffer(OutputBuffer&&) noexcept;
-		OutputBuffer(FileView, size_t capacity);
+
+		/** The buffer is allocated from the given memory resource,
+		 * which must outlive it. */
+		OutputBuffer(FileView, size_t capacity, AccessPattern = AccessPattern::eDefault, std::pmr::memory_resource* = std::pmr::get_default_resource());
+
+		inline OutputBuffer(FileView file, size_t capacity, std::pmr::memory_resource* memory):
+			OutputBuffer(file, capacity, AccessPattern::eDefault, memory)
+		{ }
+
 		~OutputBuffer();
 
 		OutputBuffer& operator=(OutputBuffer&&) noexcept;
@@ -125,8 +367,426 @@ namespace posixfio {
 		/** Similar to writeLeast, but may fail after a partial write. */
 		ssize_t writeLeast(const void* buf, size_t least, size_t count);
 
-		/** Write all the ready-to-write bytes. */
-		void flush();
+		/** Try to write the ready-to-write bytes with a single File::write call;
+		 * returns the number of bytes written, following File::write semantics.
+		 * If the file is non-blocking and full, returns -1 and sets
+		 * `errno` to EAGAIN, without throwing. */
+		ssize_t flushSome();
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs,
+		 * or when the file is non-blocking and full; in the latter case `errno`
+		 * is set to EAGAIN (without throwing), and the bytes that could not
+		 * be written stay in the buffer.
+		 * Writes all the ready-to-write bytes. */
+		bool flush();
+
+		/** Write all the ready-to-write bytes, followed by the `count` bytes of `buf`,
+		 * using as few `writev` calls as possible; returns `count`,
+		 * following writeAll semantics.
+		 * If an error occurs, the ready-to-write bytes that could not
+		 * be written stay in the buffer. */
+		ssize_t flush(const void* buf, size_t count);
+
+		/** Returns a span of at least `n` writable bytes inside the buffer,
+		 * writing the ready-to-write bytes first if they don't leave enough room;
+		 * returns an empty span if `n` exceeds the capacity, or if an error occurs.
+		 * The bytes are only written after being published by `commit`. */
+		std::span<byte_t> reserve(size_t n);
+
+		/** Publishes the first `n` bytes of the last span returned by `reserve`,
+		 * which become ready to be written. */
+		inline void commit(size_t n) { assert(n <= capacity_ - end_);  end_ += n; }
+
+		/** Returns the number of ready-to-write bytes. */
+		inline size_t size() const { return end_ - begin_; }
+
+		inline size_t capacity() const { return capacity_; }
+	};
+
+
+	/** Input buffer that maps a sliding window of a file, instead of copying
+	 * its contents: `data` and `size` expose the whole unread part of the
+	 * window, which lets parsers work directly on the page cache.
+	 * The file must support `mmap` (regular files and block devices do);
+	 * reading starts from its offset at construction time, but the offset is
+	 * never changed, and data appended to the file is seen by `fill`. */
+	class MappedInputBuffer {
+	private:
+		FileView file_;
+		MemMapping window_;
+		off_t windowOffset_;
+		size_t begin_;
+		size_t end_;
+		size_t released_;
+		size_t windowSize_;
+
+		void releaseConsumed();
+
+	public:
+		MappedInputBuffer() noexcept;
+		MappedInputBuffer(const MappedInputBuffer&) = delete;
+		MappedInputBuffer(MappedInputBuffer&&) noexcept = default;
+
+		/** If an error occurs, the buffer is left default-constructed,
+		 * and `file` returns an empty FileView. */
+		MappedInputBuffer(FileView, size_t windowSize);
+
+		MappedInputBuffer& operator=(MappedInputBuffer&&) noexcept = default;
+
+		inline const FileView file() const { return file_; }
+
+		/** Similar to File::read, but may fail after a partial read. */
+		ssize_t read(void* buf, size_t count);
+
+		/** Similar to readAll, but may fail after a partial read. */
+		ssize_t readAll(void* buf, size_t count);
+
+		/** Similar to readLeast, but may fail after a partial read. */
+		ssize_t readLeast(void* buf, size_t least, size_t count);
+
+		/** Moves the window forward, so that it starts at the page of the
+		 * first unread byte; returns the number of bytes that became
+		 * available, following File::read semantics.
+		 * Pointers returned by `data` are invalidated. */
+		ssize_t fill();
+
+		/** If the window is empty, try to move it forward; then discard one byte.
+		 * The return value follows File::read semantics. */
+		ssize_t fwd();
+
+		/** Returns a pointer to the first ready-to-read byte in the window. */
+		inline const byte_t* data() const { return window_.get<byte_t>() + begin_; }
+
+		/** Returns the number of ready-to-read bytes. */
+		inline size_t size() const { return end_ - begin_; }
+
+		/** Discard the rest of the window; the next read will move the window forward. */
+		inline void discard() { begin_ = end_; }
+
+		/** Returns the file offset of the first ready-to-read byte. */
+		inline off_t tell() const { return windowOffset_ + off_t(begin_); }
+	};
+
+
+	/** Input buffer for files opened with `O_DIRECT`, which bypass the page cache:
+	 * the buffer is allocated with the alignment reported by File::directIoAlignment,
+	 * and every read is block-aligned and a multiple of the block size,
+	 * so that reads at unaligned offsets (including the tail of the file)
+	 * read the whole surrounding blocks.
+	 * Reading starts from the file offset at construction time, but the
+	 * offset is never changed, and data appended to the file is seen by `fill`. */
+	class DirectInputBuffer {
+	private:
+		FileView file_;
+		off_t bufferOffset_;  // File offset of the first byte of the buffer, always aligned
+		size_t begin_;
+		size_t end_;
+		size_t capacity_;
+		size_t alignment_;
+		byte_t* buffer_;
+
+	public:
+		DirectInputBuffer() noexcept;
+		DirectInputBuffer(const DirectInputBuffer&) = delete;
+		DirectInputBuffer(DirectInputBuffer&&) noexcept;
+
+		/** The capacity is rounded up to a multiple of the alignment.
+		 * If an error occurs, the buffer is left default-constructed,
+		 * and `file` returns an empty FileView. */
+		DirectInputBuffer(FileView, size_t capacity);
+
+		~DirectInputBuffer();
+
+		DirectInputBuffer& operator=(DirectInputBuffer&&) noexcept;
+
+		inline const FileView file() const { return file_; }
+
+		/** Similar to File::read, but may fail after a partial read. */
+		ssize_t read(void* buf, size_t count);
+
+		/** Similar to readAll, but may fail after a partial read. */
+		ssize_t readAll(void* buf, size_t count);
+
+		/** Similar to readLeast, but may fail after a partial read. */
+		ssize_t readLeast(void* buf, size_t least, size_t count);
+
+		/** Try to fill the buffer, if it isn't already full, moving the
+		 * unread bytes to the beginning of the buffer; returns the number of
+		 * bytes that became available, following File::read semantics.
+		 * Pointers returned by `data` are invalidated. */
+		ssize_t fill();
+
+		/** If the buffer is empty, try to fill it; then discard one byte.
+		 * The return value follows File::read semantics. */
+		ssize_t fwd();
+
+		/** Returns a pointer to the first ready-to-read byte in the buffer. */
+		inline const byte_t* data() const { return buffer_ + begin_; }
+
+		/** Returns the number of ready-to-read bytes. */
+		inline size_t size() const { return end_ - begin_; }
+
+		/** Discard the rest of the buffer; the next read will try to fill the buffer. */
+		inline void discard() { begin_ = end_; }
+
+		/** Returns the file offset of the first ready-to-read byte. */
+		inline off_t tell() const { return bufferOffset_ + off_t(begin_); }
+
+		inline size_t alignment() const { return alignment_; }
+		inline size_t capacity() const { return capacity_; }
+	};
+
+
+	/** Output buffer for files opened with `O_DIRECT`, which bypass the page cache:
+	 * the buffer is allocated with the alignment reported by File::directIoAlignment,
+	 * and every write is block-aligned and a multiple of the block size.
+	 * An unaligned tail is written as a whole block, padded with the
+	 * data that follows it in the file (or with zeroes, after which
+	 * the file is truncated to its actual size).
+	 * Writing starts from the file offset at construction time, but the offset
+	 * is never changed, so `O_APPEND` must not be used; starting at an unaligned offset,
+	 * or writing before the end of the file, requires the file to be readable. */
+	class DirectOutputBuffer {
+	private:
+		FileView file_;
+		off_t bufferOffset_;  // File offset of the first byte of the buffer, always aligned
+		size_t end_;
+		size_t capacity_;
+		size_t alignment_;
+		byte_t* buffer_;  // One block larger than the capacity, to read the data after the tail
+
+		bool flushBlocks();
+
+	public:
+		DirectOutputBuffer() noexcept;
+		DirectOutputBuffer(const DirectOutputBuffer&) = delete;
+		DirectOutputBuffer(DirectOutputBuffer&&) noexcept;
+
+		/** The capacity is rounded up to a multiple of the alignment.
+		 * If an error occurs, the buffer is left default-constructed,
+		 * and `file` returns an empty FileView. */
+		DirectOutputBuffer(FileView, size_t capacity);
+
+		/** Flushes the buffer, ignoring errors. */
+		~DirectOutputBuffer();
+
+		DirectOutputBuffer& operator=(DirectOutputBuffer&&) noexcept;
+
+		inline const FileView file() const { return file_; }
+
+		/** Similar to File::write, but may fail after a partial write. */
+		ssize_t write(const void* buf, size_t count);
+
+		/** Similar to writeAll, but may fail after a partial write. */
+		ssize_t writeAll(const void* buf, size_t count);
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * Writes all the ready-to-write bytes, including the unaligned tail,
+		 * which is kept in the buffer and rewritten by the next flush. */
+		bool flush();
+
+		/** Returns the file offset of the next byte to be written. */
+		inline off_t tell() const { return bufferOffset_ + off_t(end_); }
+
+		inline size_t alignment() const { return alignment_; }
+		inline size_t capacity() const { return capacity_; }
+	};
+
+
+	/** Input buffer whose memory is a ring, mapped twice back-to-back, so that
+	 * the ready-to-read bytes are always contiguous even when they wrap around:
+	 * the buffer never needs to move them, neither to `peek` nor to `fill`.
+	 * The capacity is rounded up to a multiple of the page size. */
+	class RingInputBuffer {
+	private:
+		FileView file_;
+		MemMapping ring_;
+		size_t begin_;  // Always smaller than the capacity
+		size_t end_;    // At most `begin_` plus the capacity
+		size_t capacity_;
+
+	public:
+		RingInputBuffer() noexcept;
+		RingInputBuffer(const RingInputBuffer&) = delete;
+		RingInputBuffer(RingInputBuffer&&) noexcept = default;
+		RingInputBuffer(FileView, size_t capacity);
+
+		RingInputBuffer& operator=(RingInputBuffer&&) noexcept = default;
+
+		inline const FileView file() const { return file_; }
+
+		/** Similar to File::read, but may fail after a partial read. */
+		ssize_t read(void* buf, size_t count);
+
+		/** Similar to readAll, but may fail after a partial read. */
+		ssize_t readAll(void* buf, size_t count);
+
+		/** Similar to readLeast, but may fail after a partial read. */
+		ssize_t readLeast(void* buf, size_t least, size_t count);
+
+		/** Try to fill the buffer, if it isn't already full;
+		 * returns the number of characters read by the attempt
+		 * (not the total capacity), following File::read semantics.
+		 * If the file is non-blocking and has no data, returns -1 and sets
+		 * `errno` to EAGAIN, without throwing. */
+		ssize_t fill();
+
+		/** If the buffer is empty, try to fill it; then discard one byte.
+		 * The return value follows File::read semantics. */
+		ssize_t fwd();
+
+		/** Fills the buffer until at least `n` bytes are ready to be read,
+		 * or EOF is reached; returns the number of ready-to-read bytes, which
+		 * is smaller than `n` only on EOF, or -1 if an error occurs.
+		 * `n` must not exceed the capacity; pointers returned by `data` stay valid. */
+		ssize_t peek(size_t n);
+
+		/** Discards `n` ready-to-read bytes. */
+		inline void consume(size_t n) {
+			assert(n <= size());
+			begin_ += n;
+			if(begin_ >= capacity_) { begin_ -= capacity_;  end_ -= capacity_; }
+		}
+
+		/** Returns a pointer to the first ready-to-read byte in the buffer. */
+		inline byte_t* data() { return ring_.get<byte_t>() + begin_; }
+
+		/** Returns a pointer to the first ready-to-read byte in the buffer. */
+		inline const byte_t* data() const { return ring_.get<byte_t>() + begin_; }
+
+		/** Returns the number of ready-to-read bytes. */
+		inline size_t size() const { return end_ - begin_; }
+
+		/** Discard the entire buffer; the next read will try to fill the buffer. */
+		inline void discard() { begin_ = 0;  end_ = 0; }
+
+		inline size_t capacity() const { return capacity_; }
+	};
+
+
+	/** Output buffer whose memory is a ring, mapped twice back-to-back, so that
+	 * the ready-to-write bytes are always contiguous even when they wrap around:
+	 * partial writes never cause the rest of them to be moved.
+	 * The capacity is rounded up to a multiple of the page size. */
+	class RingOutputBuffer {
+	private:
+		FileView file_;
+		MemMapping ring_;
+		size_t begin_;  // Always smaller than the capacity
+		size_t end_;    // At most `begin_` plus the capacity
+		size_t capacity_;
+
+		void advance(size_t n);
+
+	public:
+		RingOutputBuffer() noexcept;
+		RingOutputBuffer(const RingOutputBuffer&) = delete;
+		RingOutputBuffer(RingOutputBuffer&&) noexcept;
+		RingOutputBuffer(FileView, size_t capacity);
+
+		/** Writes the ready-to-write bytes, ignoring errors. */
+		~RingOutputBuffer();
+
+		RingOutputBuffer& operator=(RingOutputBuffer&&) noexcept;
+
+		inline const FileView file() const { return file_; }
+
+		/** Similar to File::write, but may fail after a partial write. */
+		ssize_t write(const void* buf, size_t count);
+
+		/** Similar to writeAll, but may fail after a partial write. */
+		ssize_t writeAll(const void* buf, size_t count);
+
+		/** Try to write the ready-to-write bytes with a single File::write call;
+		 * returns the number of bytes written, following File::write semantics.
+		 * If the file is non-blocking and full, returns -1 and sets
+		 * `errno` to EAGAIN, without throwing. */
+		ssize_t flushSome();
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs,
+		 * or when the file is non-blocking and full (see OutputBuffer::flush).
+		 * Writes all the ready-to-write bytes. */
+		bool flush();
+
+		/** Returns a span of at least `n` writable bytes inside the buffer,
+		 * writing some of the ready-to-write bytes first if they don't leave
+		 * enough room; returns an empty span if `n` exceeds the capacity,
+		 * or if an error occurs.
+		 * The bytes are only written after being published by `commit`. */
+		std::span<byte_t> reserve(size_t n);
+
+		/** Publishes the first `n` bytes of the last span returned by `reserve`,
+		 * which become ready to be written. */
+		inline void commit(size_t n) { assert(n <= capacity_ - size());  end_ += n; }
+
+		/** Returns the number of ready-to-write bytes. */
+		inline size_t size() const { return end_ - begin_; }
+
+		inline size_t capacity() const { return capacity_; }
+	};
+
+
+	namespace _buffer_pool_impl {
+
+		/* This namespace is only to be used internally by this library,
+		 * and its signatures may change at any time in any way.
+		 * */
+
+		struct PoolState;
+
+	}
+
+
+	struct BufferPoolOptions {
+		/** Smaller requests are rounded up to this size; rounded up to a power of 2. */
+		size_t minBlockSize = 4096;
+
+		/** Larger requests bypass the pool; rounded up to a power of 2. */
+		size_t maxBlockSize = 4 * 1024 * 1024;
+
+		/** How many blocks of each size each thread keeps for itself, before
+		 * moving half of them to the blocks shared by every thread. */
+		size_t threadCacheSize = 16;
+
+		/** Blocks of 2 MiB or more are mapped with huge pages (if the kernel has
+		 * any reserved) or transparent huge pages, instead of being allocated
+		 * by the upstream resource. */
+		bool hugePages = false;
+	};
+
+
+	/** Memory resource that recycles blocks of power-of-2 sizes, so that
+	 * buffers that are frequently created and destroyed (one per connection,
+	 * for example) don't hit the global allocator: each thread keeps
+	 * per-size free lists that are used without locking, and only falls back to
+	 * a shared (locked) free list, or to the upstream resource, when they're
+	 * empty or full.
+	 * Memory is only returned to the upstream resource by `trim`, or when the
+	 * pool and every thread that used it are gone: the upstream resource must
+	 * outlive them. */
+	class BufferPool : public std::pmr::memory_resource {
+	private:
+		std::shared_ptr<_buffer_pool_impl::PoolState> state_;
+
+	protected:
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	public:
+		BufferPool(BufferPoolOptions = { }, std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+		BufferPool(const BufferPool&) = delete;
+		~BufferPool();
+
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		/** Releases the blocks cached by the calling thread, and the
+		 * shared ones; blocks cached by other threads are unaffected. */
+		void trim();
+
+		/** Returns the number of blocks that were allocated upstream (or mapped),
+		 * and are yet to be released. */
+		size_t blockCount() const;
 	};
 
 
@@ -168,14 +828,14 @@ namespace posixfio {
 
 		/** Similar to File::read, but may fail after a partial read. */
 		ssize_t read(void* buf, size_t count) {
-			return _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, buf, count);
+			return _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, buf, count);
 		}
 
 		/** Similar to readLeast, but may fail after a partial read. */
 		ssize_t readLeast(void* buf, size_t least, size_t count) {
 			ssize_t total = 0;
 			while(total < ssize_t(least)) {
-				auto rd = _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, buf, ssize_t(count) - total);
+				auto rd = _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, reinterpret_cast<byte_t*>(buf) + total, ssize_t(count) - total);
 				if(rd == 0) [[unlikely]] return total;
 				if(rd < 0) [[unlikely]] return -1;
 				total += rd;
@@ -188,10 +848,12 @@ namespace posixfio {
 			return readLeast(buf, count, count);
 		}
 
-		/** Try to fill the buffer, if it isn't already full. */
+		/** Try to fill the buffer, if it isn't already full.
+		 * If the file is non-blocking and has no data, returns -1 and sets
+		 * `errno` to EAGAIN, without throwing. */
 		ssize_t fill() {
 			if(bufferEnd_ < capacity) {
-				ssize_t rd = file_.read(buffer_ + bufferEnd_, capacity - bufferEnd_);
+				ssize_t rd = _buffer_op_impl::readReady(file_, buffer_ + bufferEnd_, capacity - bufferEnd_);
 				if(rd >= 0) [[likely]]  bufferEnd_ += rd;
 				return rd;
 			} else {
@@ -202,11 +864,47 @@ namespace posixfio {
 		/** Discard the entire buffer; the next read will try to fill the buffer. */
 		inline void discard() { bufferBegin_ = 0;  bufferEnd_ = 0; }
 
+		/** Moves the ready-to-read bytes to the beginning of the buffer,
+		 * unless `n` bytes already fit between the first one and the end
+		 * of the buffer; returns `false` if `n` exceeds the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		bool reserveContiguous(size_t n) {
+			if(n > capacity) [[unlikely]] return false;
+			if(capacity - bufferBegin_ < n) {
+				memmove(buffer_, buffer_ + bufferBegin_, bufferEnd_ - bufferBegin_);
+				bufferEnd_ -= bufferBegin_;
+				bufferBegin_ = 0;
+			}
+			return true;
+		}
+
+		/** Fills the buffer until at least `n` contiguous bytes are ready to be read,
+		 * or EOF is reached; returns the number of ready-to-read bytes, which
+		 * is smaller than `n` only on EOF, or -1 if an error occurs.
+		 * `n` must not exceed the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		ssize_t peek(size_t n) {
+			assert(n <= capacity);
+			if(size() >= n) [[likely]] return size();
+			reserveContiguous(std::min(n, capacity));
+			while(size() < n) {
+				ssize_t rd = fill();
+				if(rd < 0) [[unlikely]] return -1;
+				if(rd == 0) break;
+			}
+			return size();
+		}
+
+		/** Discards `n` ready-to-read bytes, which must have been made available by `peek` or `fill`. */
+		inline void consume(size_t n) { assert(n <= size());  bufferBegin_ += n; }
+
 		/** If the buffer is empty, try to fill it; then discard one byte.
 		 * The return value follows File::read semantics. */
 		ssize_t fwd() {
 			if(bufferBegin_ + 1 >= bufferEnd_) {
+				// Drop the current byte (if any) before filling, or it would be served twice
 				if(bufferEnd_ >= capacity)  discard();
+				else  bufferBegin_ = bufferEnd_;
 				ssize_t fl = fill();
 				if(fl <= 0)  return fl;
 			} else {
@@ -278,7 +976,7 @@ namespace posixfio {
 		ssize_t writeLeast(const void* buf, size_t least, size_t count) {
 			ssize_t total = 0;
 			while(total < ssize_t(least)) {
-				auto rd = _buffer_op_impl::bfWrite(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, buf, ssize_t(count) - total);
+				auto rd = _buffer_op_impl::bfWrite(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, reinterpret_cast<const byte_t*>(buf) + total, ssize_t(count) - total);
 				if(rd == 0) [[unlikely]] return total;
 				if(rd < 0) [[unlikely]] return -1;
 				total += rd;
@@ -291,14 +989,40 @@ namespace posixfio {
 			return writeLeast(buf, count, count);
 		}
 
-		/** Write all the ready-to-write bytes. */
-		void flush() {
-			posixfio::writeAll(file_,
-				reinterpret_cast<byte_t*>(buffer_) + bufferBegin_,
-				bufferEnd_ - bufferBegin_ );
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs,
+		 * or when the file is non-blocking and full (see OutputBuffer::flush).
+		 * Writes all the ready-to-write bytes. */
+		bool flush() {
+			while(bufferEnd_ > bufferBegin_) {
+				ssize_t wr = _buffer_op_impl::writeReady(file_, buffer_ + bufferBegin_, bufferEnd_ - bufferBegin_);
+				if(wr < 0) [[unlikely]] return false;
+				bufferBegin_ += wr;
+			}
 			bufferBegin_ = 0;
 			bufferEnd_ = 0;
+			return true;
+		}
+
+		/** Returns a span of at least `n` writable bytes inside the buffer,
+		 * writing the ready-to-write bytes first if they don't leave enough room;
+		 * returns an empty span if `n` exceeds the capacity, or if an error occurs.
+		 * The bytes are only written after being published by `commit`. */
+		std::span<byte_t> reserve(size_t n) {
+			if(n > capacity) [[unlikely]] return { };
+			if(capacity - bufferEnd_ < n) {
+				if(0 > posixfio::writeAll(file_, buffer_ + bufferBegin_, bufferEnd_ - bufferBegin_)) [[unlikely]] return { };
+				bufferBegin_ = 0;
+				bufferEnd_ = 0;
+			}
+			return { buffer_ + bufferEnd_, capacity - bufferEnd_ };
 		}
+
+		/** Publishes the first `n` bytes of the last span returned by `reserve`,
+		 * which become ready to be written. */
+		inline void commit(size_t n) { assert(n <= capacity - bufferEnd_);  bufferEnd_ += n; }
+
+		/** Returns the number of ready-to-write bytes. */
+		inline size_t size() const { return bufferEnd_ - bufferBegin_; }
 	};
 
 }
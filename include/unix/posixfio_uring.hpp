@@ -0,0 +1,171 @@
+#pragma once
+
+#include <posixfio.hpp>
+
+extern "C" {
+	#include <sys/uio.h>
+	#include <linux/io_uring.h>
+}
+
+#include <cstdint>
+
+
+
+namespace posixfio {
+
+	#ifdef POSIXFIO_NOTHROW
+		inline namespace no_throw {
+	#endif
+
+
+	class Ring;
+
+
+	/** The file operand of a Ring operation: either a plain file descriptor,
+	 * or the index of a file registered with `Ring::registerFiles`. */
+	class RingFile {
+		friend Ring;
+
+	private:
+		fd_t fd_;
+		bool registered_;
+
+		constexpr RingFile(fd_t fd, bool registered): fd_(fd), registered_(registered) { }
+
+	public:
+		constexpr RingFile(fd_t fd): fd_(fd), registered_(false) { }
+		inline RingFile(const File& file): fd_(file.fd()), registered_(false) { }
+
+		/** Refers to the `index`-th file of the last `Ring::registerFiles` call. */
+		static constexpr RingFile registered(unsigned index) { return RingFile(fd_t(index), true); }
+
+		inline fd_t fd() const { return fd_; }
+		inline bool isRegistered() const { return registered_; }
+	};
+
+
+	struct RingCompletion {
+		std::uint64_t userData;
+		std::int32_t result;  // Same as the equivalent syscall's return value, or `-errno` on failure
+		std::uint32_t flags;
+	};
+
+
+	enum class RingFsyncFlags : unsigned {
+		eNone = 0,
+		eDatasync = IORING_FSYNC_DATASYNC
+	};
+
+
+	/** Submission/completion engine built on io_uring.
+	 *
+	 * Operations are queued with the `prep*` functions, which never block
+	 * and return `false` when the submission queue is full; queued operations
+	 * are handed to the kernel by `submit`, and their results are collected
+	 * in batches by `peekCompletions` or `waitCompletions`.
+	 *
+	 * Buffers and file descriptors given to an operation must remain valid
+	 * until its completion has been collected; the Ring never takes ownership
+	 * of them, so a File closed with `prepClose` should be `disown`ed first. */
+	class Ring {
+	private:
+		File fd_;
+		MemMapping sqRingMap_;
+		MemMapping cqRingMap_;
+		MemMapping sqesMap_;
+		unsigned* sqHead_;
+		unsigned* sqTail_;
+		unsigned* sqArray_;
+		io_uring_sqe* sqes_;
+		unsigned* cqHead_;
+		unsigned* cqTail_;
+		io_uring_cqe* cqes_;
+		unsigned sqMask_;
+		unsigned sqEntries_;
+		unsigned cqMask_;
+		unsigned sqLocalTail_;
+		unsigned sqSubmitted_;
+
+		io_uring_sqe* nextSqe();
+		int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+	public:
+		/** Creates a Ring with (at least) `entries` submission queue slots;
+		 * `flags` are forwarded to `io_uring_setup` as `IORING_SETUP_*` bits. */
+		static Ring create(unsigned entries, unsigned flags = 0);
+
+		Ring() noexcept;
+		Ring(const Ring&) = delete;
+		Ring(Ring&&) = default;
+		~Ring() = default;
+
+		Ring& operator=(const Ring&) = delete;
+		Ring& operator=(Ring&&) = default;
+
+		/** Queues a `read`; an `offset` of `-1` reads from the current file offset. */
+		bool prepRead(RingFile, void* buf, size_t count, off_t offset, std::uint64_t userData);
+
+		/** Queues a `write`; an `offset` of `-1` writes at the current file offset. */
+		bool prepWrite(RingFile, const void* buf, size_t count, off_t offset, std::uint64_t userData);
+
+		/** Same as `prepRead`, but `buf` must lie within the `bufIndex`-th registered buffer. */
+		bool prepReadFixed(RingFile, void* buf, size_t count, off_t offset, unsigned bufIndex, std::uint64_t userData);
+
+		/** Same as `prepWrite`, but `buf` must lie within the `bufIndex`-th registered buffer. */
+		bool prepWriteFixed(RingFile, const void* buf, size_t count, off_t offset, unsigned bufIndex, std::uint64_t userData);
+
+		/** Queues an `fsync`, or an `fdatasync` if `RingFsyncFlags::eDatasync` is given. */
+		bool prepFsync(RingFile, RingFsyncFlags, std::uint64_t userData);
+
+		/** Queues an `openat`; the completion result is the new file descriptor.
+		 * `pathname` must remain valid until the operation is submitted. */
+		bool prepOpenat(fd_t dirfd, const char* pathname, int flags, mode_t mode, std::uint64_t userData);
+
+		/** Queues a `close` of a plain (non-registered) file descriptor. */
+		bool prepClose(fd_t, std::uint64_t userData);
+
+		/** Submits all queued operations, then waits for at least `waitNr` completions;
+		 * returns the number of submitted operations. */
+		ssize_t submit(unsigned waitNr = 0);
+
+		/** Collects up to `maxNr` completions without blocking,
+		 * and returns the number of collected completions. */
+		unsigned peekCompletions(RingCompletion* dst, unsigned maxNr);
+
+		/** Collects up to `maxNr` completions, blocking until at least `minNr` are available
+		 * (or until an error occurs); returns the number of collected completions. */
+		ssize_t waitCompletions(RingCompletion* dst, unsigned maxNr, unsigned minNr = 1);
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * Registers (and pins) the given buffers for use with `prepReadFixed` and `prepWriteFixed`. */
+		bool registerBuffers(const struct iovec* buffers, unsigned count);
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs. */
+		bool unregisterBuffers();
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * Registers the given file descriptors, which can then be referred
+		 * to with `RingFile::registered`. */
+		bool registerFiles(const fd_t* fds, unsigned count);
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs. */
+		bool unregisterFiles();
+
+		/** Returns the number of operations that can be queued before the next `submit`. */
+		unsigned sqSpace() const;
+
+		/** Returns the number of operations that have been queued, but not yet submitted. */
+		inline unsigned sqPending() const { return sqLocalTail_ - sqSubmitted_; }
+
+		inline unsigned sqCapacity() const { return sqEntries_; }
+
+		inline fd_t fd() const { return fd_.fd(); }
+		inline operator bool() const { return bool(fd_); }
+	};
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
@@ -5,19 +5,68 @@
 #include <utility>
 #include <cstddef>
 #include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <span>
 
 
 
 namespace posixfio {
 
+	/** How the file of a buffer is going to be accessed; buffers use it
+	 * to give hints to the kernel about read-ahead and the page cache,
+	 * and ignore any error that the hints may cause. */
+	enum class AccessPattern {
+		eDefault,     // No hint
+		eSequential,  // From start to end, with aggressive read-ahead
+		eRandom,      // Without read-ahead
+		eOnce         // Sequentially, and only once: pages are dropped from the page cache as soon as they're used
+	};
+
+
 	namespace _buffer_op_impl {
 
 		/* This namespace is only to be used internally by this library,
 		 * and its signatures may change at any time in any way.
 		 * */
 
-		ssize_t bfRead(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr, void* dst, size_t count);
+		/** Tracks the file range that a buffer has transferred, for AccessPattern::eOnce. */
+		struct CacheHints {
+			AccessPattern pattern;
+			off_t offset;     // File offset after the last transfer
+			off_t writeback;  // Written bytes before this offset are being written back
+			off_t dropped;    // Bytes before this offset have been dropped from the page cache
+		};
+
+		constexpr off_t cacheDropInterval = 1024 * 1024;
+
+		CacheHints hintOpen(FileView, AccessPattern);
+		void hintTransferred(FileView, CacheHints*, size_t count, bool output);
+		void hintClose(FileView, CacheHints*, bool output);
+
+		ssize_t bfRead(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr, size_t bufCapacity, void* dst, size_t count);
 		ssize_t bfWrite(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr, size_t bufCapacity, const void* src, size_t count);
+		ssize_t bfFlush(FileView, void* buf, size_t* bufBegPtr, size_t* bufEndPtr);
+
+		/** Similar to File::read and File::write, but EAGAIN never throws. */
+		ssize_t readReady(FileView, void* buf, size_t count);
+		ssize_t writeReady(FileView, const void* buf, size_t count);
+
+		/** Delimiter scanning kernel; returns `nullptr` if the byte is not found. */
+		using FindByteFn = const unsigned char* (*)(const unsigned char* src, size_t count, unsigned char b);
+
+		struct FindByteKernel {
+			const char* name;
+			FindByteFn fn;
+		};
+
+		/** Returns the kernels that the CPU supports, starting with the one used by `findByte`. */
+		std::span<const FindByteKernel> findByteKernels();
+
+		const unsigned char* findByte(const unsigned char* src, size_t count, unsigned char b);
 
 	};
 
@@ -53,12 +102,24 @@ namespace posixfio {
 		size_t end_;
 		size_t capacity_;
 		byte_t* buffer_;
+		std::pmr::memory_resource* memory_;
+		_buffer_op_impl::CacheHints hints_;
+		std::string spill_;  // Lines that don't fit in the buffer
+		bool spillPending_;  // Whether `spill_` holds the beginning of an unfinished line
 
 	public:
 		InputBuffer() noexcept;
 		InputBuffer(const InputBuffer&) = delete;
 		InputBuffer(InputBuffer&&) noexcept;
-		InputBuffer(FileView, size_t capacity);
+
+		/** The buffer is allocated from the given memory resource,
+		 * which must outlive it. */
+		InputBuffer(FileView, size_t capacity, AccessPattern = AccessPattern::eDefault, std::pmr::memory_resource* = std::pmr::get_default_resource());
+
+		inline InputBuffer(FileView file, size_t capacity, std::pmr::memory_resource* memory):
+			InputBuffer(file, capacity, AccessPattern::eDefault, memory)
+		{ }
+
 		~InputBuffer();
 
 		InputBuffer& operator=(InputBuffer&&) noexcept;
@@ -74,6 +135,40 @@ namespace posixfio {
 		/** Similar to readLeast, but may fail after a partial read. */
 		ssize_t readLeast(void* buf, size_t least, size_t count);
 
+		/** Reads bytes until `delim` (which is read too), until `count` bytes
+		 * have been read, EOF is reached or an error occurs;
+		 * may fail after a partial read. */
+		ssize_t readUntil(void* buf, size_t count, byte_t delim);
+
+		/** Reads a line terminated by `delim`, which is consumed but not
+		 * included in the line; returns the number of bytes consumed,
+		 * following File::read semantics (0 means EOF).
+		 * The line points into the buffer, unless it's longer than the buffer,
+		 * in which case it's copied into a separate string; either way,
+		 * it's only valid until the next call.
+		 * If reading fails in the middle of a line (including EAGAIN, for
+		 * non-blocking files), the next call resumes the same line. */
+		ssize_t readLine(std::string_view* line, byte_t delim = '\n');
+
+		/** Calls `fn(std::string_view)` for each line until EOF, or until `fn`
+		 * returns `false` (if it returns `bool`); returns the number of bytes
+		 * consumed, or -1 if an error occurs. */
+		template<typename Fn>
+		ssize_t forEachLine(Fn&& fn, byte_t delim = '\n') {
+			ssize_t total = 0;
+			std::string_view line;
+			ssize_t rd;
+			while(0 < (rd = readLine(&line, delim))) {
+				total += rd;
+				if constexpr(std::is_same_v<std::invoke_result_t<Fn&, std::string_view>, bool>) {
+					if(! fn(line)) return total;
+				} else {
+					fn(line);
+				}
+			}
+			return (rd < 0)? rd : total;
+		}
+
 		/** Try to fill the buffer, if it isn't already full. */
 		ssize_t fill();
 
@@ -92,6 +187,24 @@ namespace posixfio {
 
 		/** Discard the entire buffer; the next read will try to fill the buffer. */
 		inline void discard() { begin_ = 0;  end_ = 0; }
+
+		/** Moves the ready-to-read bytes to the beginning of the buffer,
+		 * unless `n` bytes already fit between the first one and the end
+		 * of the buffer; returns `false` if `n` exceeds the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		bool reserveContiguous(size_t n);
+
+		/** Fills the buffer until at least `n` contiguous bytes are ready to be read,
+		 * or EOF is reached; returns the number of ready-to-read bytes, which
+		 * is smaller than `n` only on EOF, or -1 if an error occurs.
+		 * `n` must not exceed the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		ssize_t peek(size_t n);
+
+		/** Discards `n` ready-to-read bytes, which must have been made available by `peek` or `fill`. */
+		inline void consume(size_t n) { assert(n <= size());  begin_ += n; }
+
+		inline size_t capacity() const { return capacity_; }
 	};
 
 
@@ -102,12 +215,22 @@ namespace posixfio {
 		size_t end_;
 		size_t capacity_;
 		byte_t* buffer_;
+		std::pmr::memory_resource* memory_;
+		_buffer_op_impl::CacheHints hints_;
 
 	public:
 		OutputBuffer() noexcept;
 		OutputBuffer(const OutputBuffer&) = delete;
 		OutputBuffer(OutputBuffer&&) noexcept;
-		OutputBuffer(FileView, size_t capacity);
+
+		/** The buffer is allocated from the given memory resource,
+		 * which must outlive it. */
+		OutputBuffer(FileView, size_t capacity, AccessPattern = AccessPattern::eDefault, std::pmr::memory_resource* = std::pmr::get_default_resource());
+
+		inline OutputBuffer(FileView file, size_t capacity, std::pmr::memory_resource* memory):
+			OutputBuffer(file, capacity, AccessPattern::eDefault, memory)
+		{ }
+
 		~OutputBuffer();
 
 		OutputBuffer& operator=(OutputBuffer&&) noexcept;
@@ -123,8 +246,28 @@ namespace posixfio {
 		/** Similar to writeLeast, but may fail after a partial write. */
 		ssize_t writeLeast(const void* buf, size_t least, size_t count);
 
-		/** Write all the ready-to-write bytes. */
-		void flush();
+		/** Try to write the ready-to-write bytes with a single File::write call;
+		 * returns the number of bytes written, following File::write semantics. */
+		ssize_t flushSome();
+
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * Writes all the ready-to-write bytes. */
+		bool flush();
+
+		/** Returns a span of at least `n` writable bytes inside the buffer,
+		 * writing the ready-to-write bytes first if they don't leave enough room;
+		 * returns an empty span if `n` exceeds the capacity, or if an error occurs.
+		 * The bytes are only written after being published by `commit`. */
+		std::span<byte_t> reserve(size_t n);
+
+		/** Publishes the first `n` bytes of the last span returned by `reserve`,
+		 * which become ready to be written. */
+		inline void commit(size_t n) { assert(n <= capacity_ - end_);  end_ += n; }
+
+		/** Returns the number of ready-to-write bytes. */
+		inline size_t size() const { return end_ - begin_; }
+
+		inline size_t capacity() const { return capacity_; }
 	};
 
 
@@ -166,14 +309,14 @@ namespace posixfio {
 
 		/** Similar to File::read, but may fail after a partial read. */
 		ssize_t read(void* buf, size_t count) {
-			return _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, buf, count);
+			return _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, buf, count);
 		}
 
 		/** Similar to readLeast, but may fail after a partial read. */
 		ssize_t readLeast(void* buf, size_t least, size_t count) {
 			ssize_t total = 0;
 			while(total < ssize_t(least)) {
-				auto rd = _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, buf, ssize_t(count) - total);
+				auto rd = _buffer_op_impl::bfRead(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, reinterpret_cast<byte_t*>(buf) + total, ssize_t(count) - total);
 				if(rd == 0) [[unlikely]] return total;
 				if(rd < 0) [[unlikely]] return -1;
 				total += rd;
@@ -189,7 +332,7 @@ namespace posixfio {
 		/** Try to fill the buffer, if it isn't already full. */
 		ssize_t fill() {
 			if(bufferEnd_ < capacity) {
-				ssize_t rd = file_.read(buffer_ + bufferEnd_, capacity - bufferEnd_);
+				ssize_t rd = _buffer_op_impl::readReady(file_, buffer_ + bufferEnd_, capacity - bufferEnd_);
 				if(rd >= 0) [[likely]]  bufferEnd_ += rd;
 				return rd;
 			} else {
@@ -200,11 +343,47 @@ namespace posixfio {
 		/** Discard the entire buffer; the next read will try to fill the buffer. */
 		inline void discard() { bufferBegin_ = 0;  bufferEnd_ = 0; }
 
+		/** Moves the ready-to-read bytes to the beginning of the buffer,
+		 * unless `n` bytes already fit between the first one and the end
+		 * of the buffer; returns `false` if `n` exceeds the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		bool reserveContiguous(size_t n) {
+			if(n > capacity) [[unlikely]] return false;
+			if(capacity - bufferBegin_ < n) {
+				memmove(buffer_, buffer_ + bufferBegin_, bufferEnd_ - bufferBegin_);
+				bufferEnd_ -= bufferBegin_;
+				bufferBegin_ = 0;
+			}
+			return true;
+		}
+
+		/** Fills the buffer until at least `n` contiguous bytes are ready to be read,
+		 * or EOF is reached; returns the number of ready-to-read bytes, which
+		 * is smaller than `n` only on EOF, or -1 if an error occurs.
+		 * `n` must not exceed the capacity.
+		 * Pointers returned by `data` are invalidated. */
+		ssize_t peek(size_t n) {
+			assert(n <= capacity);
+			if(size() >= n) [[likely]] return size();
+			reserveContiguous(std::min(n, capacity));
+			while(size() < n) {
+				ssize_t rd = fill();
+				if(rd < 0) [[unlikely]] return -1;
+				if(rd == 0) break;
+			}
+			return size();
+		}
+
+		/** Discards `n` ready-to-read bytes, which must have been made available by `peek` or `fill`. */
+		inline void consume(size_t n) { assert(n <= size());  bufferBegin_ += n; }
+
 		/** If the buffer is empty, try to fill it; then discard one byte.
 		 * The return value follows File::read semantics. */
 		ssize_t fwd() {
 			if(bufferBegin_ + 1 >= bufferEnd_) {
+				// Drop the current byte (if any) before filling, or it would be served twice
 				if(bufferEnd_ >= capacity)  discard();
+				else  bufferBegin_ = bufferEnd_;
 				ssize_t fl = fill();
 				if(fl <= 0)  return fl;
 			} else {
@@ -276,7 +455,7 @@ namespace posixfio {
 		ssize_t writeLeast(const void* buf, size_t least, size_t count) {
 			ssize_t total = 0;
 			while(total < ssize_t(least)) {
-				auto rd = _buffer_op_impl::bfWrite(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, buf, ssize_t(count) - total);
+				auto rd = _buffer_op_impl::bfWrite(file_, buffer_, &bufferBegin_, &bufferEnd_, capacity, reinterpret_cast<const byte_t*>(buf) + total, ssize_t(count) - total);
 				if(rd == 0) [[unlikely]] return total;
 				if(rd < 0) [[unlikely]] return -1;
 				total += rd;
@@ -289,14 +468,39 @@ namespace posixfio {
 			return writeLeast(buf, count, count);
 		}
 
-		/** Write all the ready-to-write bytes. */
-		void flush() {
-			posixfio::writeAll(file_,
-				reinterpret_cast<byte_t*>(buffer_) + bufferBegin_,
-				bufferEnd_ - bufferBegin_ );
+		/** Almost POSIX-compliant: returns `false` exclusively when an error occurs.
+		 * Writes all the ready-to-write bytes. */
+		bool flush() {
+			while(bufferEnd_ > bufferBegin_) {
+				ssize_t wr = _buffer_op_impl::writeReady(file_, buffer_ + bufferBegin_, bufferEnd_ - bufferBegin_);
+				if(wr < 0) [[unlikely]] return false;
+				bufferBegin_ += wr;
+			}
 			bufferBegin_ = 0;
 			bufferEnd_ = 0;
+			return true;
 		}
+
+		/** Returns a span of at least `n` writable bytes inside the buffer,
+		 * writing the ready-to-write bytes first if they don't leave enough room;
+		 * returns an empty span if `n` exceeds the capacity, or if an error occurs.
+		 * The bytes are only written after being published by `commit`. */
+		std::span<byte_t> reserve(size_t n) {
+			if(n > capacity) [[unlikely]] return { };
+			if(capacity - bufferEnd_ < n) {
+				if(0 > posixfio::writeAll(file_, buffer_ + bufferBegin_, bufferEnd_ - bufferBegin_)) [[unlikely]] return { };
+				bufferBegin_ = 0;
+				bufferEnd_ = 0;
+			}
+			return { buffer_ + bufferEnd_, capacity - bufferEnd_ };
+		}
+
+		/** Publishes the first `n` bytes of the last span returned by `reserve`,
+		 * which become ready to be written. */
+		inline void commit(size_t n) { assert(n <= capacity - bufferEnd_);  bufferEnd_ += n; }
+
+		/** Returns the number of ready-to-write bytes. */
+		inline size_t size() const { return bufferEnd_ - bufferBegin_; }
 	};
 
 }
@@ -6,6 +6,15 @@
 #include <new>
 #include <algorithm>
 
+#ifdef POSIXFIO_UNIX
+	#include <unistd.h>
+#endif
+
+#if (defined __x86_64__) && ((defined __GNUC__) || (defined __clang__))
+	#define POSIXFIO_X86_SIMD
+	#include <immintrin.h>
+#endif
+
 
 
 // Use the next four lines to limit I/O request sizes, ONLY FOR DEBUGGING OR MANUAL TESTING;
@@ -22,9 +31,104 @@ namespace posixfio {
 
 	namespace _buffer_op_impl {
 
+		// Delimiter scanning kernels, selected at runtime by `findByte`;
+		// each of them returns `nullptr` if the byte is not found
+
+		#ifndef POSIXFIO_X86_SIMD
+
+			const byte_t* findByteScalar(const byte_t* src, size_t count, byte_t b) {
+				return reinterpret_cast<const byte_t*>(memchr(src, b, count));
+			}
+
+		#else
+
+			const byte_t* findByteSse2(const byte_t* src, size_t count, byte_t b) {
+				const __m128i needle = _mm_set1_epi8(char(b));
+				size_t i = 0;
+				for(; i + 16 <= count; i += 16) {
+					auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+					unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+					if(mask != 0) return src + i + __builtin_ctz(mask);
+				}
+				for(; i < count; ++i) if(src[i] == b) return src + i;
+				return nullptr;
+			}
+
+
+			[[gnu::target("avx2")]]
+			const byte_t* findByteAvx2(const byte_t* src, size_t count, byte_t b) {
+				const __m256i needle = _mm256_set1_epi8(char(b));
+				size_t i = 0;
+				// Two vectors per iteration, since most lines span several of them
+				for(; i + 64 <= count; i += 64) {
+					auto block0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+					auto block1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+					auto eq0 = _mm256_cmpeq_epi8(block0, needle);
+					auto eq1 = _mm256_cmpeq_epi8(block1, needle);
+					if(! _mm256_testz_si256(_mm256_or_si256(eq0, eq1), _mm256_or_si256(eq0, eq1))) {
+						unsigned mask0 = _mm256_movemask_epi8(eq0);
+						if(mask0 != 0) return src + i + __builtin_ctz(mask0);
+						return src + i + 32 + __builtin_ctz(unsigned(_mm256_movemask_epi8(eq1)));
+					}
+				}
+				for(; i + 32 <= count; i += 32) {
+					auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+					unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+					if(mask != 0) return src + i + __builtin_ctz(mask);
+				}
+				for(; i < count; ++i) if(src[i] == b) return src + i;
+				return nullptr;
+			}
+
+
+			[[gnu::target("avx512f,avx512bw")]]
+			const byte_t* findByteAvx512(const byte_t* src, size_t count, byte_t b) {
+				const __m512i needle = _mm512_set1_epi8(char(b));
+				size_t i = 0;
+				for(; i + 64 <= count; i += 64) {
+					auto block = _mm512_loadu_si512(src + i);
+					auto mask = _mm512_cmpeq_epi8_mask(block, needle);
+					if(mask != 0) return src + i + __builtin_ctzll(mask);
+				}
+				if(i < count) {
+					// Masked loads don't fault on the bytes past the end
+					__mmask64 tail = (__mmask64(1) << (count - i)) - 1;
+					auto block = _mm512_maskz_loadu_epi8(tail, src + i);
+					auto mask = _mm512_mask_cmpeq_epi8_mask(tail, block, needle);
+					if(mask != 0) return src + i + __builtin_ctzll(mask);
+				}
+				return nullptr;
+			}
+
+		#endif
+
+
+		std::span<const FindByteKernel> findByteKernels() {
+			#ifdef POSIXFIO_X86_SIMD
+				static constexpr FindByteKernel kernels[] = {
+					{ "AVX-512", findByteAvx512 },
+					{ "AVX2", findByteAvx2 },
+					{ "SSE2", findByteSse2 } };
+				__builtin_cpu_init();
+				if(__builtin_cpu_supports("avx512bw")) return std::span(kernels);
+				if(__builtin_cpu_supports("avx2")) return std::span(kernels).subspan(1);
+				return std::span(kernels).subspan(2);
+			#else
+				static constexpr FindByteKernel kernels[] = { { "scalar", findByteScalar } };
+				return std::span(kernels);
+			#endif
+		}
+
+
+		const byte_t* findByte(const byte_t* src, size_t count, byte_t b) {
+			static const FindByteFn fn = findByteKernels().front().fn;
+			return fn(src, count, b);
+		}
+
+
 		ssize_t bfRead(
 				FileView file,
-				void* buf, size_t* bufBeginPtr, size_t* bufEndPtr,
+				void* buf, size_t* bufBeginPtr, size_t* bufEndPtr, size_t bufCapacity,
 				void* dst, size_t count
 		) {
 			//         | ..... | DataDataDataDataData | .......................... |
@@ -38,7 +142,7 @@ namespace posixfio {
 			auto initBufEnd = *bufEndPtr;
 			auto initBufBegin = *bufBeginPtr;
 			auto initWindowSize = initBufEnd - initBufBegin;  assert(initBufEnd >= initBufBegin);
-			if(count < initWindowSize) {
+			if(count <= initWindowSize) {
 				// Enough available bytes
 				memcpy(dst, BYTES_(buf) + initBufBegin, count);
 				*bufBeginPtr += count;
@@ -51,6 +155,16 @@ namespace posixfio {
 				#endif
 				size_t directRdCount = count - initWindowSize;
 				memcpy(dst, BYTES_(buf) + initBufBegin, initWindowSize);
+				if(directRdCount < bufCapacity) {
+					// Refill the whole buffer, and only hand out what was requested
+					ssize_t rd = file.read(buf, bufCapacity);
+					CHECK_ERR_
+					size_t cpCount = std::min(size_t(rd), directRdCount);
+					memcpy(BYTES_(dst) + initWindowSize, buf, cpCount);
+					*bufBeginPtr = cpCount;
+					*bufEndPtr = rd;
+					return cpCount + initWindowSize;
+				}
 				#ifdef POSIXFIO_DBG_LIMIT_DIRECT_RD
 					directRdCount = std::min(directRdCount, decltype(directRdCount)(POSIXFIO_DBG_LIMIT_DIRECT_RD));
 				#endif
@@ -97,6 +211,37 @@ namespace posixfio {
 				#else
 					#define CHECK_ERR_ { assert(wr > 0); }
 				#endif
+				#ifdef POSIXFIO_UNIX
+				// The same, but A and B+C are written by a single `writev`,
+				// so that nothing needs to be copied into the buffer:
+				// [     | ..A.. | ........................ ]   ........B+C.........
+				size_t prevQueued = initBufEnd - initBufBegin;
+				size_t directWrCount = count;
+				#ifdef POSIXFIO_DBG_LIMIT_DIRECT_WR
+					directWrCount = std::min(directWrCount, decltype(directWrCount)(POSIXFIO_DBG_LIMIT_DIRECT_WR));
+				#endif
+				struct iovec iov[2] = {
+					{ BYTES_(buf) + initBufBegin, prevQueued },
+					{ const_cast<byte_t*>(CBYTES_(src)), directWrCount } };
+				ssize_t wr = (prevQueued > 0)? file.writev(iov, 2) : file.writev(iov + 1, 1);
+				CHECK_ERR_
+				assert(size_t(wr) <= prevQueued + directWrCount);
+				if(size_t(wr) > prevQueued) {
+					*bufBeginPtr = 0;
+					*bufEndPtr = 0;
+					return wr - prevQueued;
+				} else {
+					// None of the user-requested bytes have been written (implying incomplete write):
+					// move the leftover bytes to the beginning of the buffer, then queue as many as possible
+					size_t leftover = prevQueued - wr;
+					size_t queuedSrcCount = std::min(count, bufCapacity - leftover);
+					memmove(buf, BYTES_(buf) + initBufBegin + wr, leftover);
+					memcpy(BYTES_(buf) + leftover, src, queuedSrcCount);
+					*bufBeginPtr = 0;
+					*bufEndPtr = leftover + queuedSrcCount;
+					return queuedSrcCount;
+				}
+				#else
 				size_t bufferedWrCount = bufCapacity - initBufBegin;
 				size_t prevQueued = initBufEnd - initBufBegin;
 				size_t directWrCount = count + prevQueued - bufferedWrCount;
@@ -123,13 +268,28 @@ namespace posixfio {
 					#ifdef POSIXFIO_DBG_LIMIT_DIRECT_WR
 						directWrCount = std::min(directWrCount, decltype(directWrCount)(POSIXFIO_DBG_LIMIT_DIRECT_WR));
 					#endif
-					wr = file.write(CBYTES_(src) + (bufferedWrCount - prevQueued), directWrCount);
-					CHECK_ERR_
-					assert(size_t(wr) <= directWrCount);
+					// The buffer must be reset before the direct write, so that a failure
+					// (such as EAGAIN) does not cause the buffered bytes to be written twice;
+					// if it fails, the bytes copied into the buffer are reported as a partial write.
+					const size_t bufferedSrcCount = bufferedWrCount - prevQueued;
 					*bufBeginPtr = 0;
 					*bufEndPtr = 0;
-					return wr + bufferedWrCount - prevQueued;
+					#ifdef POSIXFIO_NOTHROW
+						wr = file.write(CBYTES_(src) + bufferedSrcCount, directWrCount);
+						if(wr < 0 && bufferedSrcCount > 0) [[unlikely]] return bufferedSrcCount;
+					#else
+						try {
+							wr = file.write(CBYTES_(src) + bufferedSrcCount, directWrCount);
+						} catch(FileError&) {
+							if(bufferedSrcCount > 0) return bufferedSrcCount;
+							throw;
+						}
+					#endif
+					CHECK_ERR_
+					assert(size_t(wr) <= directWrCount);
+					return wr + bufferedSrcCount;
 				}
+				#endif
 				#undef CHECK_ERR_
 			}
 
@@ -137,6 +297,131 @@ namespace posixfio {
 			#undef CBYTES_
 		}
 
+		ssize_t readReady(FileView file, void* buf, size_t count) {
+			#ifdef POSIXFIO_UNIX
+				// EAGAIN is reported without throwing, since it only means that
+				// a non-blocking file (usually a pipe) has no data yet
+				ssize_t rd = ::read(file, buf, count);
+				if(rd < 0) [[unlikely]] {
+					if(errno == EAGAIN || errno == EWOULDBLOCK) return -1;
+					#ifndef POSIXFIO_NOTHROW
+						throw FileError(file, errno);
+					#endif
+				}
+				return rd;
+			#else
+				return file.read(buf, count);
+			#endif
+		}
+
+
+		ssize_t writeReady(FileView file, const void* buf, size_t count) {
+			#ifdef POSIXFIO_UNIX
+				ssize_t wr = ::write(file, buf, count);
+				if(wr < 0) [[unlikely]] {
+					if(errno == EAGAIN || errno == EWOULDBLOCK) return -1;
+					#ifndef POSIXFIO_NOTHROW
+						throw FileError(file, errno);
+					#endif
+				}
+				return wr;
+			#else
+				return file.write(buf, count);
+			#endif
+		}
+
+
+		ssize_t bfFlush(
+				FileView file,
+				void* buf, size_t* bufBeginPtr, size_t* bufEndPtr
+		) {
+			assert(buf);
+			assert(bufEndPtr);
+			assert(bufBeginPtr);
+			assert(*bufEndPtr >= *bufBeginPtr);
+			if(*bufEndPtr == *bufBeginPtr) return 0;
+			ssize_t wr = writeReady(file, reinterpret_cast<byte_t*>(buf) + *bufBeginPtr, *bufEndPtr - *bufBeginPtr);
+			if(wr < 0) [[unlikely]] return wr;
+			*bufBeginPtr += wr;
+			if(*bufBeginPtr == *bufEndPtr) {
+				*bufBeginPtr = 0;
+				*bufEndPtr = 0;
+			}
+			return wr;
+		}
+
+
+		CacheHints hintOpen(FileView file, AccessPattern pattern) {
+			CacheHints r = { pattern, 0, 0, 0 };
+			#ifdef POSIXFIO_UNIX
+				switch(pattern) {
+					case AccessPattern::eDefault: break;
+					case AccessPattern::eSequential:
+						(void) ::posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+						break;
+					case AccessPattern::eRandom:
+						(void) ::posix_fadvise(file, 0, 0, POSIX_FADV_RANDOM);
+						break;
+					case AccessPattern::eOnce: {
+						// Pages can only be dropped if the file offset can be tracked
+						off_t offset = ::lseek(file, 0, SEEK_CUR);
+						if(offset < 0) {
+							r.pattern = AccessPattern::eSequential;
+						} else {
+							r.offset = r.writeback = r.dropped = offset;
+							(void) ::posix_fadvise(file, 0, 0, POSIX_FADV_NOREUSE);
+						}
+						(void) ::posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+					} break;
+				}
+			#else
+				(void) file;
+			#endif
+			return r;
+		}
+
+
+		void hintTransferred(FileView file, CacheHints* hints, size_t count, bool output) {
+			assert(hints->pattern == AccessPattern::eOnce);
+			hints->offset += count;
+			#ifdef POSIXFIO_UNIX
+				if(! output) {
+					if(hints->offset - hints->dropped >= cacheDropInterval) {
+						(void) ::posix_fadvise(file, hints->dropped, hints->offset - hints->dropped, POSIX_FADV_DONTNEED);
+						hints->dropped = hints->offset;
+					}
+				} else if(hints->offset - hints->writeback >= cacheDropInterval) {
+					// Dirty pages can't be dropped: start writing back the latest range,
+					// then wait for the previous one (which should be done by now) and drop it
+					(void) ::sync_file_range(file, hints->writeback, hints->offset - hints->writeback, SYNC_FILE_RANGE_WRITE);
+					if(hints->writeback > hints->dropped) {
+						constexpr unsigned waitFlags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+						(void) ::sync_file_range(file, hints->dropped, hints->writeback - hints->dropped, waitFlags);
+						(void) ::posix_fadvise(file, hints->dropped, hints->writeback - hints->dropped, POSIX_FADV_DONTNEED);
+						hints->dropped = hints->writeback;
+					}
+					hints->writeback = hints->offset;
+				}
+			#else
+				(void) file;  (void) output;
+			#endif
+		}
+
+
+		void hintClose(FileView file, CacheHints* hints, bool output) {
+			assert(hints->pattern == AccessPattern::eOnce);
+			#ifdef POSIXFIO_UNIX
+				if(hints->offset <= hints->dropped) return;
+				// The last written pages are only dropped if they are already clean,
+				// since waiting for them would make closing the buffer as slow as `fdatasync`
+				if(output) (void) ::sync_file_range(file, hints->writeback, hints->offset - hints->writeback, SYNC_FILE_RANGE_WRITE);
+				(void) ::posix_fadvise(file, hints->dropped, hints->offset - hints->dropped, POSIX_FADV_DONTNEED);
+				hints->dropped = hints->offset;
+			#else
+				(void) file;  (void) output;
+			#endif
+		}
+
 	}
 
 
@@ -267,7 +552,11 @@ namespace posixfio {
 				CP_(begin_),
 				CP_(end_),
 				CP_(capacity_),
-				CP_(buffer_)
+				CP_(buffer_),
+				CP_(memory_),
+				CP_(hints_),
+				MV_(spill_),
+				CP_(spillPending_)
 			#undef MV_
 			#undef CP_
 	{
@@ -275,12 +564,15 @@ namespace posixfio {
 	}
 
 
-	InputBuffer::InputBuffer(FileView file, size_t cap):
+	InputBuffer::InputBuffer(FileView file, size_t cap, AccessPattern pattern, std::pmr::memory_resource* memory):
 			file_(file),
 			begin_(0),
 			end_(0),
-			capacity_(cap > 1? size_t(1) : cap),
-			buffer_((byte_t*) operator new[](capacity_ * sizeof(capacity_)))
+			capacity_(cap),
+			buffer_(reinterpret_cast<byte_t*>(memory->allocate(cap, alignof(std::max_align_t)))),
+			memory_(memory),
+			hints_(_buffer_op_impl::hintOpen(file, pattern)),
+			spillPending_(false)
 	{
 		assert(cap > 0);
 	}
@@ -288,7 +580,8 @@ namespace posixfio {
 
 	InputBuffer::~InputBuffer() {
 		if(file_) {
-			delete[] buffer_;
+			if(hints_.pattern == AccessPattern::eOnce) _buffer_op_impl::hintClose(file_, &hints_, false);
+			if(buffer_ != nullptr) memory_->deallocate(buffer_, capacity_, alignof(std::max_align_t));
 			file_.close();
 			#ifndef NDEBUG
 				buffer_ = nullptr;
@@ -304,14 +597,21 @@ namespace posixfio {
 
 
 	ssize_t InputBuffer::read(void* userBuf, size_t count) {
-		return _buffer_op_impl::bfRead(file_, buffer_, &begin_, &end_, userBuf, count);
+		if(hints_.pattern == AccessPattern::eOnce) [[unlikely]] {
+			// Whatever was read from the file is either in the user buffer or in the window
+			size_t initWindow = end_ - begin_;
+			auto rd = _buffer_op_impl::bfRead(file_, buffer_, &begin_, &end_, capacity_, userBuf, count);
+			if(rd > 0) _buffer_op_impl::hintTransferred(file_, &hints_, (size_t(rd) + (end_ - begin_)) - initWindow, false);
+			return rd;
+		}
+		return _buffer_op_impl::bfRead(file_, buffer_, &begin_, &end_, capacity_, userBuf, count);
 	}
 
 
 	ssize_t InputBuffer::readLeast(void* buf, size_t least, size_t count) {
 		ssize_t total = 0;
 		while(size_t(total) < least) {
-			auto rd = _buffer_op_impl::bfRead(file_, buffer_, &begin_, &end_, buf, ssize_t(count) - total);
+			auto rd = read(reinterpret_cast<byte_t*>(buf) + total, ssize_t(count) - total);
 			if(rd == 0) [[unlikely]] return total;
 			if(rd < 0) [[unlikely]] return -1;
 			total += rd;
@@ -325,10 +625,112 @@ namespace posixfio {
 	}
 
 
+	bool InputBuffer::reserveContiguous(size_t n) {
+		if(n > capacity_) [[unlikely]] return false;
+		if(capacity_ - begin_ < n) {
+			memmove(buffer_, buffer_ + begin_, end_ - begin_);
+			end_ -= begin_;
+			begin_ = 0;
+		}
+		return true;
+	}
+
+
+	ssize_t InputBuffer::peek(size_t n) {
+		assert(n <= capacity_);
+		if(end_ - begin_ >= n) [[likely]] return end_ - begin_;
+		reserveContiguous(std::min(n, capacity_));
+		while(end_ - begin_ < n) {
+			ssize_t rd = fill();
+			if(rd < 0) [[unlikely]] return -1;
+			if(rd == 0) break;
+		}
+		return end_ - begin_;
+	}
+
+
+	ssize_t InputBuffer::readUntil(void* buf, size_t count, byte_t delim) {
+		auto dst = reinterpret_cast<byte_t*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			if(begin_ >= end_) {
+				discard();
+				ssize_t rd = fill();
+				if(rd < 0) [[unlikely]] return -1;
+				if(rd == 0) break;
+			}
+			size_t n = std::min(end_ - begin_, count - total);
+			auto found = _buffer_op_impl::findByte(buffer_ + begin_, n, delim);
+			if(found != nullptr) n = (found - (buffer_ + begin_)) + 1;
+			memcpy(dst + total, buffer_ + begin_, n);
+			begin_ += n;
+			total += n;
+			if(found != nullptr) break;
+		}
+		return total;
+	}
+
+
+	ssize_t InputBuffer::readLine(std::string_view* line, byte_t delim) {
+		auto lineView = [](const void* ptr, size_t size) { return std::string_view(reinterpret_cast<const char*>(ptr), size); };
+		size_t scanned = 0;  // Bytes of the window that are known not to be `delim`
+		while(true) {
+			const byte_t* window = buffer_ + begin_;
+			size_t windowSize = end_ - begin_;
+			auto found = _buffer_op_impl::findByte(window + scanned, windowSize - scanned, delim);
+			if(found != nullptr) {
+				size_t lineSize = found - window;
+				begin_ += lineSize + 1;
+				if(! spillPending_) [[likely]] {
+					*line = lineView(window, lineSize);
+					return lineSize + 1;
+				}
+				spill_.append(lineView(window, lineSize));
+				spillPending_ = false;
+				*line = spill_;
+				return spill_.size() + 1;
+			}
+			scanned = windowSize;
+
+			// The line continues past the window: move it to the beginning of the buffer
+			// if it has reached the end, or move it to `spill_` if it fills the whole buffer
+			if(end_ >= capacity_) {
+				if(begin_ > 0) {
+					memmove(buffer_, window, windowSize);
+					begin_ = 0;
+					end_ = windowSize;
+				} else {
+					if(! spillPending_) spill_.clear();
+					spill_.append(lineView(window, windowSize));
+					spillPending_ = true;
+					discard();
+					scanned = 0;
+				}
+			}
+			ssize_t rd = fill();
+			if(rd < 0) [[unlikely]] return -1;
+			if(rd == 0) {
+				// EOF: the rest of the file is the last line, which may be empty
+				windowSize = end_ - begin_;
+				begin_ = end_;
+				if(! spillPending_) {
+					*line = lineView(buffer_ + end_ - windowSize, windowSize);
+					return windowSize;
+				}
+				spill_.append(lineView(buffer_ + end_ - windowSize, windowSize));
+				spillPending_ = false;
+				*line = spill_;
+				return spill_.size();
+			}
+		}
+	}
+
+
 	ssize_t InputBuffer::fill() {
 		if(end_ < capacity_) {
-			ssize_t rd = file_.read(buffer_ + end_, capacity_ - end_);
+			ssize_t rd = _buffer_op_impl::readReady(file_, buffer_ + end_, capacity_ - end_);
 			if(rd >= 0) [[likely]] end_ += rd;
+			if(hints_.pattern == AccessPattern::eOnce && rd > 0) [[unlikely]] _buffer_op_impl::hintTransferred(file_, &hints_, rd, false);
 			return rd;
 		} else {
 			return 0;
@@ -338,7 +740,9 @@ namespace posixfio {
 
 	ssize_t InputBuffer::fwd() {
 		if(begin_ + 1 >= end_) {
+			// Drop the current byte (if any) before filling, or it would be served twice
 			if(end_ >= capacity_)  discard();
+			else  begin_ = end_;
 			ssize_t fl = fill();
 			if(fl <= 0)  return fl;
 		} else {
@@ -364,7 +768,9 @@ namespace posixfio {
 				CP_(begin_),
 				CP_(end_),
 				CP_(capacity_),
-				CP_(buffer_)
+				CP_(buffer_),
+				CP_(memory_),
+				CP_(hints_)
 			#undef MV_
 			#undef CP_
 	{
@@ -372,12 +778,14 @@ namespace posixfio {
 	}
 
 
-	OutputBuffer::OutputBuffer(FileView file, size_t cap):
+	OutputBuffer::OutputBuffer(FileView file, size_t cap, AccessPattern pattern, std::pmr::memory_resource* memory):
 			file_(file),
 			begin_(0),
 			end_(0),
-			capacity_(cap > 1? size_t(1) : cap),
-			buffer_((byte_t*) operator new[](capacity_ * sizeof(capacity_)))
+			capacity_(cap),
+			buffer_(reinterpret_cast<byte_t*>(memory->allocate(cap, alignof(std::max_align_t)))),
+			memory_(memory),
+			hints_(_buffer_op_impl::hintOpen(file, pattern))
 	{
 		assert(cap > 0);
 	}
@@ -387,7 +795,11 @@ namespace posixfio {
 		if(file_) {
 			assert(end_ >= begin_);
 			if(end_ > begin_)  posixfio::writeAll(file_, reinterpret_cast<byte_t*>(buffer_) + begin_, end_ - begin_);
-			delete[] buffer_;
+			if(hints_.pattern == AccessPattern::eOnce) {
+				_buffer_op_impl::hintTransferred(file_, &hints_, end_ - begin_, true);
+				_buffer_op_impl::hintClose(file_, &hints_, true);
+			}
+			if(buffer_ != nullptr) memory_->deallocate(buffer_, capacity_, alignof(std::max_align_t));
 			#ifndef NDEBUG
 				buffer_ = nullptr;
 			#endif
@@ -402,6 +814,13 @@ namespace posixfio {
 
 
 	ssize_t OutputBuffer::write(const void* userBuf, size_t count) {
+		if(hints_.pattern == AccessPattern::eOnce) [[unlikely]] {
+			// Whatever was not written to the file is still in the window
+			size_t initWindow = end_ - begin_;
+			auto wr = _buffer_op_impl::bfWrite(file_, buffer_, &begin_, &end_, capacity_, userBuf, count);
+			if(wr > 0) _buffer_op_impl::hintTransferred(file_, &hints_, (initWindow + size_t(wr)) - (end_ - begin_), true);
+			return wr;
+		}
 		return _buffer_op_impl::bfWrite(file_, buffer_, &begin_, &end_, capacity_, userBuf, count);
 	}
 
@@ -409,7 +828,7 @@ namespace posixfio {
 	ssize_t OutputBuffer::writeLeast(const void* buf, size_t least, size_t count) {
 		ssize_t total = 0;
 		while(size_t(total) < least) {
-			auto wr = _buffer_op_impl::bfWrite(file_, buffer_, &begin_, &end_, capacity_, buf, ssize_t(count) - total);
+			auto wr = write(reinterpret_cast<const byte_t*>(buf) + total, ssize_t(count) - total);
 			if(wr == 0) [[unlikely]] return total;
 			if(wr < 0) [[unlikely]] return -1;
 			total += wr;
@@ -423,10 +842,35 @@ namespace posixfio {
 	}
 
 
-	void OutputBuffer::flush() {
-		posixfio::writeAll(file_, reinterpret_cast<byte_t*>(buffer_) + begin_, end_ - begin_);
+	ssize_t OutputBuffer::flushSome() {
+		auto wr = _buffer_op_impl::bfFlush(file_, buffer_, &begin_, &end_);
+		if(hints_.pattern == AccessPattern::eOnce && wr > 0) [[unlikely]] _buffer_op_impl::hintTransferred(file_, &hints_, wr, true);
+		return wr;
+	}
+
+
+	std::span<byte_t> OutputBuffer::reserve(size_t n) {
+		if(n > capacity_) [[unlikely]] return { };
+		if(capacity_ - end_ < n) {
+			if(0 > posixfio::writeAll(file_, buffer_ + begin_, end_ - begin_)) [[unlikely]] return { };
+			if(hints_.pattern == AccessPattern::eOnce) [[unlikely]] _buffer_op_impl::hintTransferred(file_, &hints_, end_ - begin_, true);
+			begin_ = 0;
+			end_ = 0;
+		}
+		return { buffer_ + end_, capacity_ - end_ };
+	}
+
+
+	bool OutputBuffer::flush() {
+		while(end_ > begin_) {
+			ssize_t wr = _buffer_op_impl::writeReady(file_, buffer_ + begin_, end_ - begin_);
+			if(wr < 0) [[unlikely]] return false;
+			if(hints_.pattern == AccessPattern::eOnce) [[unlikely]] _buffer_op_impl::hintTransferred(file_, &hints_, wr, true);
+			begin_ += wr;
+		}
 		begin_ = 0;
 		end_ = 0;
+		return true;
 	}
 
 }
@@ -5,8 +5,11 @@
 #include <cassert>
 #include <utility> // std::move
 #include <new>
+#include <limits>
+#include <algorithm>
 
 #include <unistd.h>
+#include <sys/stat.h>
 
 
 
@@ -98,6 +101,99 @@ namespace posixfio {
 	}
 
 
+	namespace {
+
+		/** Extends a range within a mapping to page boundaries, as most memory
+		 * management functions require a page-aligned address. */
+		void pageAlignRange(void* mapping, size_t* offset, size_t* length, void** alignedAddr) {
+			size_t page = ::sysconf(_SC_PAGESIZE);
+			size_t misalignment = *offset % page;
+			*alignedAddr = reinterpret_cast<char*>(mapping) + (*offset - misalignment);
+			*length += misalignment;
+			*offset -= misalignment;
+		}
+
+	}
+
+
+	bool MemMapping::msync(size_t offset, size_t length, MemSyncFlags flags) {
+		assert(addr != nullptr);
+		assert(offset + length <= len);
+		void* rangeAddr;
+		pageAlignRange(addr, &offset, &length, &rangeAddr);
+		#ifdef POSIXFIO_NOTHROW
+			return 0 == ::msync(rangeAddr, length, int(flags));
+		#else
+			if(0 != ::msync(rangeAddr, length, int(flags))) [[unlikely]] throw Errcode(errno);
+			return true;
+		#endif
+	}
+
+
+	bool MemMapping::mlock(size_t offset, size_t length) {
+		assert(addr != nullptr);
+		assert(offset + length <= len);
+		void* rangeAddr;
+		pageAlignRange(addr, &offset, &length, &rangeAddr);
+		#ifdef POSIXFIO_NOTHROW
+			return 0 == ::mlock(rangeAddr, length);
+		#else
+			if(0 != ::mlock(rangeAddr, length)) [[unlikely]] throw Errcode(errno);
+			return true;
+		#endif
+	}
+
+
+	bool MemMapping::munlock(size_t offset, size_t length) {
+		assert(addr != nullptr);
+		assert(offset + length <= len);
+		void* rangeAddr;
+		pageAlignRange(addr, &offset, &length, &rangeAddr);
+		#ifdef POSIXFIO_NOTHROW
+			return 0 == ::munlock(rangeAddr, length);
+		#else
+			if(0 != ::munlock(rangeAddr, length)) [[unlikely]] throw Errcode(errno);
+			return true;
+		#endif
+	}
+
+
+	bool MemMapping::madvise(MemAdvice advice) {
+		return madvise(0, len, advice);
+	}
+
+
+	bool MemMapping::madvise(size_t offset, size_t length, MemAdvice advice) {
+		assert(addr != nullptr);
+		assert(offset + length <= len);
+		void* rangeAddr;
+		pageAlignRange(addr, &offset, &length, &rangeAddr);
+		#ifdef POSIXFIO_NOTHROW
+			return 0 == ::madvise(rangeAddr, length, int(advice));
+		#else
+			if(0 != ::madvise(rangeAddr, length, int(advice))) [[unlikely]] throw Errcode(errno);
+			return true;
+		#endif
+	}
+
+
+	bool MemMapping::remap(size_t newLength, bool mayMove) {
+		assert(addr != nullptr);
+		assert(newLength > 0);
+		void* newAddr = ::mremap(addr, len, newLength, mayMove? MREMAP_MAYMOVE : 0);
+		if(newAddr == MAP_FAILED) [[unlikely]] {
+			#ifdef POSIXFIO_NOTHROW
+				return false;
+			#else
+				throw Errcode(errno);
+			#endif
+		}
+		addr = newAddr;
+		len = newLength;
+		return true;
+	}
+
+
 	File File::open(const char* pathname, int flags, posixfio::mode_t mode) {
 		File r = ::open(pathname, flags, mode);
 		if(! r) POSIXFIO_THROWERRNO(NULL_FD, (void) 0);
@@ -117,6 +213,31 @@ namespace posixfio {
 	}
 
 
+	File File::memfdCreate(const char* name, unsigned flags) {
+		File r = ::memfd_create(name, flags);
+		if(! r) POSIXFIO_THROWERRNO(NULL_FD, (void) 0);
+		return r;
+	}
+
+	File File::eventfd(unsigned initval, int flags) {
+		File r = ::eventfd(initval, flags);
+		if(! r) POSIXFIO_THROWERRNO(NULL_FD, (void) 0);
+		return r;
+	}
+
+	File File::timerfd(clockid_t clockid, int flags) {
+		File r = ::timerfd_create(clockid, flags);
+		if(! r) POSIXFIO_THROWERRNO(NULL_FD, (void) 0);
+		return r;
+	}
+
+	File File::signalfd(const sigset_t& mask, int flags) {
+		File r = ::signalfd(-1, &mask, flags);
+		if(! r) POSIXFIO_THROWERRNO(NULL_FD, (void) 0);
+		return r;
+	}
+
+
 	File::File(): fd_(NULL_FD) { }
 
 	File::File(fd_t fd): fd_(fd) { }
@@ -210,6 +331,81 @@ namespace posixfio {
 	}
 
 
+	posixfio::ssize_t File::readv(const struct iovec* iov, int iovcnt) {
+		posixfio::ssize_t rd = ::readv(fd_, iov, iovcnt);
+		if(rd < 0) {
+			POSIXFIO_THROWERRNO(fd_, return rd);
+		}
+		return rd;
+	}
+
+	posixfio::ssize_t File::writev(const struct iovec* iov, int iovcnt) {
+		posixfio::ssize_t wr = ::writev(fd_, iov, iovcnt);
+		if(wr < 0) {
+			POSIXFIO_THROWERRNO(fd_, return wr);
+		}
+		return wr;
+	}
+
+
+	posixfio::ssize_t File::pread(void* buf, size_t count, off_t offset) {
+		posixfio::ssize_t rd = ::pread(fd_, buf, count, offset);
+		if(rd < 0) {
+			POSIXFIO_THROWERRNO(fd_, return rd);
+		}
+		return rd;
+	}
+
+	posixfio::ssize_t File::pwrite(const void* buf, size_t count, off_t offset) {
+		posixfio::ssize_t wr = ::pwrite(fd_, buf, count, offset);
+		if(wr < 0) {
+			POSIXFIO_THROWERRNO(fd_, return wr);
+		}
+		return wr;
+	}
+
+	posixfio::ssize_t File::preadv2(const struct iovec* iov, int iovcnt, off_t offset, RwFlags flags) {
+		posixfio::ssize_t rd = ::preadv2(fd_, iov, iovcnt, offset, int(flags));
+		if(rd < 0) {
+			POSIXFIO_THROWERRNO(fd_, return rd);
+		}
+		return rd;
+	}
+
+	posixfio::ssize_t File::pwritev2(const struct iovec* iov, int iovcnt, off_t offset, RwFlags flags) {
+		posixfio::ssize_t wr = ::pwritev2(fd_, iov, iovcnt, offset, int(flags));
+		if(wr < 0) {
+			POSIXFIO_THROWERRNO(fd_, return wr);
+		}
+		return wr;
+	}
+
+	posixfio::ssize_t File::splice(off_t* offIn, FileView out, off_t* offOut, size_t len, SpliceFlags flags) {
+		static_assert(sizeof(off_t) == sizeof(loff_t));
+		posixfio::ssize_t r = ::splice(fd_, reinterpret_cast<loff_t*>(offIn), out.fd(), reinterpret_cast<loff_t*>(offOut), len, unsigned(flags));
+		if(r < 0) {
+			POSIXFIO_THROWERRNO(fd_, return r);
+		}
+		return r;
+	}
+
+	posixfio::ssize_t File::tee(FileView out, size_t len, SpliceFlags flags) {
+		posixfio::ssize_t r = ::tee(fd_, out.fd(), len, unsigned(flags));
+		if(r < 0) {
+			POSIXFIO_THROWERRNO(fd_, return r);
+		}
+		return r;
+	}
+
+	posixfio::ssize_t File::vmsplice(const struct iovec* iov, int iovcnt, SpliceFlags flags) {
+		posixfio::ssize_t r = ::vmsplice(fd_, iov, iovcnt, unsigned(flags));
+		if(r < 0) {
+			POSIXFIO_THROWERRNO(fd_, return r);
+		}
+		return r;
+	}
+
+
 	off_t File::lseek(off_t offset, int whence) {
 		posixfio::ssize_t seek = ::lseek(fd_, offset, whence);
 		if(seek < 0) {
@@ -249,6 +445,118 @@ namespace posixfio {
 	}
 
 
+	bool File::fadvise(off_t offset, off_t len, FileAdvice advice) {
+		// posix_fadvise returns the error number instead of setting errno
+		int res = ::posix_fadvise(fd_, offset, len, int(advice));
+		if(res != 0) {
+			errno = res;
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	bool File::readahead(off_t offset, size_t count) {
+		if(0 != ::readahead(fd_, offset, count)) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	bool File::fallocate(FallocateMode mode, off_t offset, off_t len) {
+		if(0 != ::fallocate(fd_, int(mode), offset, len)) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	bool File::syncFileRange(off_t offset, off_t nbytes, SyncRangeFlags flags) {
+		if(0 != ::sync_file_range(fd_, offset, nbytes, unsigned(flags))) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	bool File::addSeals(FileSeals seals) {
+		if(0 != ::fcntl(fd_, F_ADD_SEALS, int(seals))) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	int File::getSeals() {
+		int r = ::fcntl(fd_, F_GET_SEALS);
+		if(r < 0) POSIXFIO_THROWERRNO(fd_, return r);
+		return r;
+	}
+
+
+	bool File::eventfdWrite(std::uint64_t value) {
+		if(0 != ::eventfd_write(fd_, value)) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	bool File::eventfdRead(std::uint64_t* value) {
+		eventfd_t v;
+		if(0 != ::eventfd_read(fd_, &v)) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		*value = v;
+		return true;
+	}
+
+
+	bool File::timerfdSettime(const struct itimerspec& newValue, int flags, struct itimerspec* oldValue) {
+		if(0 != ::timerfd_settime(fd_, flags, &newValue, oldValue)) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	bool File::timerfdGettime(struct itimerspec* currValue) {
+		if(0 != ::timerfd_gettime(fd_, currValue)) {
+			POSIXFIO_THROWERRNO(fd_, return false);
+		}
+		return true;
+	}
+
+
+	DirectIoAlignment File::directIoAlignment() {
+		struct statx stx;
+		unsigned mask = STATX_BASIC_STATS;
+		#ifdef STATX_DIOALIGN
+			mask |= STATX_DIOALIGN;
+		#endif
+		if(0 != ::statx(fd_, "", AT_EMPTY_PATH, mask, &stx)) [[unlikely]] {
+			POSIXFIO_THROWERRNO(fd_, return { });
+		}
+		#ifdef STATX_DIOALIGN
+			if(stx.stx_mask & STATX_DIOALIGN) {
+				if(stx.stx_dio_offset_align == 0) [[unlikely]] {
+					errno = EINVAL;
+					POSIXFIO_THROWERRNO(fd_, return { });
+				}
+				return { stx.stx_dio_mem_align, stx.stx_dio_offset_align };
+			}
+		#endif
+		// The preferred block size is a multiple of the logical block size
+		// on every filesystem that supports O_DIRECT, so it's a safe fallback
+		if(stx.stx_blksize == 0) [[unlikely]] {
+			errno = EINVAL;
+			POSIXFIO_THROWERRNO(fd_, return { });
+		}
+		return { stx.stx_blksize, stx.stx_blksize };
+	}
+
+
 	MemMapping File::mmap(void* addr, size_t len, MemProtFlags prot, MemMapFlags flags, off_t off) {
 		if(len < 1) return MemMapping();
 		MemMapping r;
@@ -275,6 +583,111 @@ namespace posixfio {
 	}
 
 
+	Pipe Pipe::create2(int flags) {
+		fd_t fd[2];
+		Pipe r;
+		auto result = ::pipe2(fd, flags);
+		assert(result == 0 || result == -1);
+		if(result < 0) {
+			POSIXFIO_THROWERRNO(File::NULL_FD, (void) 0);
+		} else {
+			r.rd = fd[0];
+			r.wr = fd[1];
+		}
+		return r;
+	}
+
+
+	posixfio::ssize_t Pipe::capacity() const {
+		int r = ::fcntl(wr, F_GETPIPE_SZ);
+		if(r < 0) {
+			POSIXFIO_THROWERRNO(wr, return r);
+		}
+		return r;
+	}
+
+
+	posixfio::ssize_t Pipe::setCapacity(size_t cap) {
+		// `fcntl` takes an `int`, which would silently truncate the capacity
+		if(cap > size_t(std::numeric_limits<int>::max())) [[unlikely]] {
+			errno = EINVAL;
+			POSIXFIO_THROWERRNO(wr, return -1);
+		}
+		int r = ::fcntl(wr, F_SETPIPE_SZ, int(cap));
+		if(r < 0) {
+			POSIXFIO_THROWERRNO(wr, return r);
+		}
+		return r;
+	}
+
+
+	posixfio::ssize_t Pipe::spliceFrom(FileView src, off_t* srcOffset, size_t count, SpliceFlags flags) {
+		return src.splice(srcOffset, wr, nullptr, count, flags);
+	}
+
+
+	posixfio::ssize_t Pipe::spliceTo(FileView dst, off_t* dstOffset, size_t count, SpliceFlags flags) {
+		return rd.splice(nullptr, dst, dstOffset, count, flags);
+	}
+
+
+	posixfio::ssize_t Pipe::tee(Pipe& dst, size_t count, SpliceFlags flags) {
+		return rd.tee(dst.wr, count, flags);
+	}
+
+
+	Poller Poller::create(int flags) {
+		Poller r;
+		r.epoll_ = ::epoll_create1(flags);
+		if(! r.epoll_) POSIXFIO_THROWERRNO(File::NULL_FD, (void) 0);
+		return r;
+	}
+
+
+	namespace {
+
+		bool pollerCtl(fd_t epfd, int op, fd_t fd, PollEvents events, std::uint64_t token) {
+			struct epoll_event ev = { };
+			ev.events = std::uint32_t(events);
+			ev.data.u64 = token;
+			if(0 != ::epoll_ctl(epfd, op, fd, &ev)) {
+				POSIXFIO_THROWERRNO(epfd, return false);
+			}
+			return true;
+		}
+
+	}
+
+
+	bool Poller::add(FileView file, PollEvents events, std::uint64_t token) {
+		return pollerCtl(epoll_, EPOLL_CTL_ADD, file, events, token);
+	}
+
+
+	bool Poller::modify(FileView file, PollEvents events, std::uint64_t token) {
+		return pollerCtl(epoll_, EPOLL_CTL_MOD, file, events, token);
+	}
+
+
+	bool Poller::remove(FileView file) {
+		return pollerCtl(epoll_, EPOLL_CTL_DEL, file, PollEvents::eNone, 0);
+	}
+
+
+	posixfio::ssize_t Poller::wait(PollEvent* events, size_t maxEvents, int timeoutMs) {
+		assert(maxEvents > 0);
+		maxEvents = std::min<size_t>(maxEvents, std::numeric_limits<int>::max());
+		if(events_.size() < maxEvents) events_.resize(maxEvents);
+		int r = ::epoll_wait(epoll_, events_.data(), int(maxEvents), timeoutMs);
+		if(r < 0) {
+			if(errno == EINTR) return 0;
+			POSIXFIO_THROWERRNO(epoll_, return r);
+		}
+		for(int i = 0; i < r; ++i) events[i] = { events_[i].data.u64, events_[i].events };
+		return r;
+	}
+
+
 	#ifdef POSIXFIO_NOTHROW
 		}
 	#endif
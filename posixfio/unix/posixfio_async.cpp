@@ -0,0 +1,340 @@
+#include "../../include/unix/posixfio_async.hpp"
+
+#include <cerrno>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <condition_variable>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+
+
+
+namespace posixfio {
+
+	namespace {
+
+		bool isWouldBlock(int errcode) {
+			return (errcode == EAGAIN) || (errcode == EWOULDBLOCK);
+		}
+
+
+		/** Blocks until the file is ready for the given direction, or an error occurs. */
+		void pollFd(fd_t fd, IoDirection direction) {
+			struct pollfd pfd = { fd, short((direction == IoDirection::eIn)? POLLIN : POLLOUT), 0 };
+			while(::poll(&pfd, 1, -1) < 0 && errno == EINTR) { }
+		}
+
+	}
+
+
+	#ifdef POSIXFIO_NOTHROW
+		#define POSIXFIO_THROWERRNO(FD_, DO_) DO_;
+		namespace no_throw {
+	#else
+		#define POSIXFIO_THROWERRNO(FD_, DO_) throw FileError(FD_, errno)
+	#endif
+
+
+	bool AsyncOp::attempt() noexcept {
+		for(;;) {
+			#ifdef POSIXFIO_NOTHROW
+				result_ = perform();
+				if(result_ >= 0) [[likely]] return true;
+				errcode_ = errno;
+			#else
+				try {
+					result_ = perform();
+					if(result_ >= 0) [[likely]] return true;
+					// Some operations (like OutputBuffer::flushSome) report EAGAIN without throwing
+					errcode_ = errno;
+				} catch(FileError& err) {
+					result_ = -1;
+					errcode_ = err.errcode;
+				} catch(...) {
+					result_ = -1;
+					exception_ = std::current_exception();
+					return true;
+				}
+			#endif
+			if(errcode_ != EINTR) return ! isWouldBlock(errcode_);
+		}
+	}
+
+
+	ssize_t AsyncOp::takeResult() {
+		if(exception_) std::rethrow_exception(std::exchange(exception_, nullptr));
+		if(result_ < 0) [[unlikely]] {
+			errno = errcode_;
+			POSIXFIO_THROWERRNO(fd_, (void) 0);
+		}
+		return result_;
+	}
+
+
+
+	EpollReactor::EpollReactor():
+			epoll_(::epoll_create1(EPOLL_CLOEXEC)),
+			wakeup_(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+			pending_(0),
+			stop_(false)
+	{
+		if(! epoll_) POSIXFIO_THROWERRNO(File::NULL_FD, return);
+		if(! wakeup_) POSIXFIO_THROWERRNO(File::NULL_FD, return);
+		struct epoll_event ev = { };
+		ev.events = EPOLLIN;
+		ev.data.fd = wakeup_;
+		if(0 != ::epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_, &ev)) POSIXFIO_THROWERRNO(epoll_, return);
+	}
+
+
+	EpollReactor::~EpollReactor() {
+		assert(pending() == 0);
+	}
+
+
+	bool EpollReactor::arm(fd_t fd, const FdState& state) {
+		struct epoll_event ev = { };
+		ev.events = EPOLLONESHOT;
+		if(state.in)  ev.events |= EPOLLIN;
+		if(state.out) ev.events |= EPOLLOUT;
+		ev.data.fd = fd;
+		// The file may or may not already be in the epoll set, depending on
+		// whether it has been closed (or reused) since the last operation
+		int r = ::epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &ev);
+		if(r != 0 && errno == ENOENT) r = ::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev);
+		return r == 0;
+	}
+
+
+	bool EpollReactor::post(AsyncOp& op) {
+		for(;;) {
+			if(op.attempt()) return false;
+			auto lock = std::unique_lock(mtx_);
+			auto& state = fds_[op.fd()];
+			auto& slot = (op.direction() == IoDirection::eIn)? state.in : state.out;
+			assert(slot == nullptr);
+			slot = &op;
+			if(arm(op.fd(), state)) [[likely]] {
+				pending_.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			// Files that can't be polled can't block either, and `attempt` should be
+			// repeated; any other error is reported by the next attempt
+			slot = nullptr;
+			if(state.in == nullptr && state.out == nullptr) fds_.erase(op.fd());
+		}
+	}
+
+
+	size_t EpollReactor::runOnce(int timeoutMs) {
+		constexpr int maxEvents = 64;
+		struct epoll_event events[maxEvents];
+		int count = ::epoll_wait(epoll_, events, maxEvents, timeoutMs);
+		if(count < 0) {
+			if(errno == EINTR) return 0;
+			POSIXFIO_THROWERRNO(epoll_, return 0);
+		}
+
+		AsyncOp* ready[2 * maxEvents];
+		size_t readyCount = 0;
+		{
+			auto lock = std::unique_lock(mtx_);
+			for(int i = 0; i < count; ++i) {
+				fd_t fd = events[i].data.fd;
+				if(fd == wakeup_) {
+					// The eventfd is level-triggered, and would stay readable forever
+					eventfd_t discarded;
+					(void) ::eventfd_read(wakeup_, &discarded);
+					continue;
+				}
+				auto found = fds_.find(fd);
+				if(found == fds_.end()) continue;
+				auto& state = found->second;
+				auto evs = events[i].events;
+				bool errored = evs & (EPOLLERR | EPOLLHUP);
+				if(state.in && (errored || (evs & EPOLLIN))) {
+					ready[readyCount++] = std::exchange(state.in, nullptr);
+				}
+				if(state.out && (errored || (evs & EPOLLOUT))) {
+					ready[readyCount++] = std::exchange(state.out, nullptr);
+				}
+				if(state.in == nullptr && state.out == nullptr) {
+					fds_.erase(found);
+				} else {
+					arm(fd, state);
+				}
+			}
+		}
+
+		size_t resumed = 0;
+		for(size_t i = 0; i < readyCount; ++i) {
+			pending_.fetch_sub(1, std::memory_order_relaxed);
+			if(! post(*ready[i])) {
+				ready[i]->continuation.resume();
+				++ resumed;
+			}
+		}
+		return resumed;
+	}
+
+
+	void EpollReactor::run() {
+		while(! stop_.load(std::memory_order_acquire)) runOnce();
+	}
+
+
+	void EpollReactor::stop() {
+		std::uint64_t one = 1;
+		stop_.store(true, std::memory_order_release);
+		(void) ::write(wakeup_, &one, sizeof(one));
+	}
+
+
+
+	struct ThreadPoolReactor::Impl {
+		std::mutex mtx;
+		std::condition_variable cond;
+		std::deque<AsyncOp*> queue;
+		std::vector<std::thread> threads;
+		bool stop = false;
+
+		void work() {
+			for(;;) {
+				AsyncOp* op;
+				{
+					auto lock = std::unique_lock(mtx);
+					cond.wait(lock, [&]() { return stop || ! queue.empty(); });
+					if(queue.empty()) return;
+					op = queue.front();
+					queue.pop_front();
+				}
+				while(! op->attempt()) pollFd(op->fd(), op->direction());
+				op->continuation.resume();
+			}
+		}
+	};
+
+
+	ThreadPoolReactor::ThreadPoolReactor(unsigned threadCount):
+			impl_(new Impl)
+	{
+		assert(threadCount > 0);
+		impl_->threads.reserve(threadCount);
+		for(unsigned i = 0; i < threadCount; ++i) {
+			impl_->threads.emplace_back([impl = impl_]() { impl->work(); });
+		}
+	}
+
+
+	ThreadPoolReactor::~ThreadPoolReactor() {
+		{
+			auto lock = std::unique_lock(impl_->mtx);
+			impl_->stop = true;
+		}
+		impl_->cond.notify_all();
+		for(auto& thread : impl_->threads) thread.join();
+		delete impl_;
+	}
+
+
+	bool ThreadPoolReactor::post(AsyncOp& op) {
+		{
+			auto lock = std::unique_lock(impl_->mtx);
+			impl_->queue.push_back(&op);
+		}
+		impl_->cond.notify_one();
+		return true;
+	}
+
+
+
+	DefaultReactor::DefaultReactor(unsigned poolThreadCount):
+			pool_(poolThreadCount)
+	{ }
+
+
+	bool DefaultReactor::post(AsyncOp& op) {
+		struct stat st;
+		if(0 == ::fstat(op.fd(), &st) && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+			return pool_.post(op);
+		}
+		return epoll_.post(op);
+	}
+
+
+
+	AsyncTask<ssize_t> asyncReadAll(Reactor& r, FileView file, void* buf, size_t count) {
+		auto bytes = reinterpret_cast<byte_t*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			ssize_t rd = co_await asyncRead(r, file, bytes + total, count - total);
+			if(rd < 0) [[unlikely]] co_return rd;
+			if(rd == 0) break;
+			total += size_t(rd);
+		}
+		co_return total;
+	}
+
+
+	AsyncTask<ssize_t> asyncWriteAll(Reactor& r, FileView file, const void* buf, size_t count) {
+		auto bytes = reinterpret_cast<const byte_t*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			ssize_t wr = co_await asyncWrite(r, file, bytes + total, count - total);
+			if(wr < 0) [[unlikely]] co_return wr;
+			assert(wr > 0);
+			total += size_t(wr);
+		}
+		co_return total;
+	}
+
+
+	AsyncTask<ssize_t> asyncReadAll(Reactor& r, InputBuffer& in, void* buf, size_t count) {
+		auto bytes = reinterpret_cast<byte_t*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			ssize_t rd = co_await asyncRead(r, in, bytes + total, count - total);
+			if(rd < 0) [[unlikely]] co_return -1;
+			if(rd == 0) break;
+			total += size_t(rd);
+		}
+		co_return total;
+	}
+
+
+	AsyncTask<ssize_t> asyncWriteAll(Reactor& r, OutputBuffer& out, const void* buf, size_t count) {
+		auto bytes = reinterpret_cast<const byte_t*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			ssize_t wr = co_await asyncWrite(r, out, bytes + total, count - total);
+			if(wr < 0) [[unlikely]] co_return -1;
+			if(wr == 0) break;
+			total += size_t(wr);
+		}
+		co_return total;
+	}
+
+
+	AsyncTask<ssize_t> asyncFlush(Reactor& r, OutputBuffer& out) {
+		size_t total = 0;
+		for(;;) {
+			ssize_t wr = co_await IoAwaitable(r, out.file().fd(), IoDirection::eOut, [&out]() { return out.flushSome(); });
+			if(wr < 0) [[unlikely]] co_return -1;
+			if(wr == 0) break;
+			total += size_t(wr);
+		}
+		co_return total;
+	}
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
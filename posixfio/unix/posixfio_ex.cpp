@@ -0,0 +1,131 @@
+#include "../../include/unix/posixfio_ex.hpp"
+
+#include <cerrno>
+#include <cassert>
+#include <utility> // std::move
+#include <new>
+
+#include <unistd.h>
+
+
+
+namespace posixfio::ex {
+
+	#define POSIXFIO_EX_CHECK(R_) { if((R_) < 0) [[unlikely]] return std::unexpected(Errcode(errno)); }
+
+
+	Result<File> File::open(const char* pathname, int flags, mode_t mode) noexcept {
+		fd_t fd = ::open(pathname, flags, mode);
+		POSIXFIO_EX_CHECK(fd)
+		return File(fd);
+	}
+
+
+	Result<File> File::openat(fd_t dirfd, const char* pathname, int flags, mode_t mode) noexcept {
+		fd_t fd = ::openat(dirfd, pathname, flags, mode);
+		POSIXFIO_EX_CHECK(fd)
+		return File(fd);
+	}
+
+
+	File::~File() {
+		if(fd_ >= 0) ::close(fd_);
+	}
+
+
+	File& File::operator=(File&& mv) noexcept {
+		this->~File();
+		return * new (this) File(std::move(mv));
+	}
+
+
+	Result<size_t> File::read(void* buf, size_t count) noexcept {
+		ssize_t rd = ::read(fd_, buf, count);
+		POSIXFIO_EX_CHECK(rd)
+		return size_t(rd);
+	}
+
+
+	Result<size_t> File::write(const void* buf, size_t count) noexcept {
+		ssize_t wr = ::write(fd_, buf, count);
+		POSIXFIO_EX_CHECK(wr)
+		return size_t(wr);
+	}
+
+
+	Result<size_t> File::pread(void* buf, size_t count, off_t offset) noexcept {
+		ssize_t rd = ::pread(fd_, buf, count, offset);
+		POSIXFIO_EX_CHECK(rd)
+		return size_t(rd);
+	}
+
+
+	Result<size_t> File::pwrite(const void* buf, size_t count, off_t offset) noexcept {
+		ssize_t wr = ::pwrite(fd_, buf, count, offset);
+		POSIXFIO_EX_CHECK(wr)
+		return size_t(wr);
+	}
+
+
+	Result<off_t> File::lseek(off_t offset, int whence) noexcept {
+		off_t r = ::lseek(fd_, offset, whence);
+		POSIXFIO_EX_CHECK(r)
+		return r;
+	}
+
+
+	Result<void> File::fsync() noexcept {
+		POSIXFIO_EX_CHECK(::fsync(fd_))
+		return { };
+	}
+
+
+	Result<void> File::fdatasync() noexcept {
+		POSIXFIO_EX_CHECK(::fdatasync(fd_))
+		return { };
+	}
+
+
+	Result<void> File::ftruncate(off_t length) noexcept {
+		POSIXFIO_EX_CHECK(::ftruncate(fd_, length))
+		return { };
+	}
+
+
+	Result<void> File::close() noexcept {
+		if(fd_ < 0) return { };
+		int r = ::close(disown());
+		assert((r == 0) || (r == -1 /* POSIX indicates `-1` specifically */));
+		POSIXFIO_EX_CHECK(r)
+		return { };
+	}
+
+
+	Result<size_t> readAll(fd_t fd, void* buf, size_t count) noexcept {
+		auto bytes = reinterpret_cast<unsigned char*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			ssize_t rd = ::read(fd, bytes + total, count - total);
+			POSIXFIO_EX_CHECK(rd)
+			if(rd == 0) break;
+			total += size_t(rd);
+		}
+		return total;
+	}
+
+
+	Result<size_t> writeAll(fd_t fd, const void* buf, size_t count) noexcept {
+		auto bytes = reinterpret_cast<const unsigned char*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			ssize_t wr = ::write(fd, bytes + total, count - total);
+			POSIXFIO_EX_CHECK(wr)
+			total += size_t(wr);
+		}
+		return total;
+	}
+
+
+	#undef POSIXFIO_EX_CHECK
+
+}
@@ -0,0 +1,261 @@
+#include "../../include/unix/posixfio_log.hpp"
+
+#include <cerrno>
+#include <cassert>
+#include <cstring>
+#include <utility>
+#include <limits>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+
+namespace posixfio {
+
+	#ifdef POSIXFIO_NOTHROW
+		#define POSIXFIO_THROWERRNO(FD_, DO_) DO_;
+		namespace no_throw {
+	#else
+		#define POSIXFIO_THROWERRNO(FD_, DO_) throw FileError(FD_, errno)
+	#endif
+
+
+	namespace _log_impl {
+
+		std::uint32_t checksum(const void* data, std::uint32_t size) {
+			// Multiplicative hash over 64-bit words, seeded with the size so that
+			// records of different sizes (but with the same padded words) differ;
+			// a byte-wise hash would dominate the cost of small records
+			constexpr std::uint64_t prime = 0x9e3779b97f4a7c15;
+			std::uint64_t r = prime ^ size;
+			auto bytes = reinterpret_cast<const unsigned char*>(data);
+			std::uint32_t i = 0;
+			for(; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+				std::uint64_t word;
+				memcpy(&word, bytes + i, sizeof(word));
+				r = (r ^ word) * prime;
+				r ^= r >> 29;
+			}
+			if(i < size) {
+				std::uint64_t word = 0;
+				memcpy(&word, bytes + i, size - i);
+				r = (r ^ word) * prime;
+				r ^= r >> 29;
+			}
+			return std::uint32_t(r ^ (r >> 32));
+		}
+
+	}
+
+
+	namespace {
+
+		using _log_impl::RecordHeader;
+		using _log_impl::alignRecord;
+
+		size_t roundUp(size_t n, size_t unit) {
+			return ((n + unit - 1) / unit) * unit;
+		}
+
+
+		/** Extends the file to `newSize` bytes, preferring to actually allocate the
+		 * blocks so that writes through the mapping can't fail with SIGBUS. */
+		bool extendFile(fd_t fd, off_t oldSize, off_t newSize) {
+			assert(newSize > oldSize);
+			if(0 == ::fallocate(fd, 0, oldSize, newSize - oldSize)) [[likely]] return true;
+			if(errno != EOPNOTSUPP && errno != ENOSYS) POSIXFIO_THROWERRNO(fd, return false);
+			if(0 == ::ftruncate(fd, newSize)) return true;
+			POSIXFIO_THROWERRNO(fd, return false);
+		}
+
+
+		/** Returns the size of the valid records at the beginning of the mapping. */
+		size_t scanRecords(const unsigned char* base, size_t fileSize, size_t* recordCount) {
+			size_t pos = 0;
+			size_t count = 0;
+			while(pos + sizeof(RecordHeader) <= fileSize) {
+				RecordHeader hdr;
+				memcpy(&hdr, base + pos, sizeof(hdr));
+				if(hdr.size == 0) break;
+				size_t next = pos + sizeof(hdr) + alignRecord(hdr.size);
+				if(next > fileSize) break;
+				if(hdr.checksum != _log_impl::checksum(base + pos + sizeof(hdr), hdr.size)) break;
+				pos = next;
+				++ count;
+			}
+			*recordCount = count;
+			return pos;
+		}
+
+	}
+
+
+	MappedAppendLog MappedAppendLog::open(File file, size_t extentSize) {
+		assert(extentSize > 0);
+		MappedAppendLog r;
+		struct stat st;
+		if(0 != ::fstat(file, &st)) [[unlikely]] POSIXFIO_THROWERRNO(file, return r);
+		size_t page = ::sysconf(_SC_PAGESIZE);
+		size_t fileSize = st.st_size;
+		extentSize = roundUp(extentSize, page);
+		size_t mapSize = roundUp(std::max<size_t>(fileSize, 1), extentSize);
+
+		auto map = file.mmap(mapSize, MemProtFlags(PROT_READ | PROT_WRITE), MemMapFlags::eShared, 0);
+		if(! map) [[unlikely]] return r;
+		size_t recordCount;
+		size_t validSize = scanRecords(map.get<const unsigned char>(), fileSize, &recordCount);
+
+		// Whatever follows the last valid record is dropped, and replaced by zeroes
+		if(validSize < fileSize) {
+			if(0 != ::ftruncate(file, validSize)) [[unlikely]] POSIXFIO_THROWERRNO(file, return r);
+			fileSize = validSize;
+		}
+		if(fileSize < mapSize) {
+			if(! extendFile(file, fileSize, mapSize)) [[unlikely]] return r;
+		}
+
+		r.recovery_ = { recordCount, off_t(validSize), off_t(st.st_size) - off_t(validSize) };
+		r.file_ = std::move(file);
+		r.map_ = std::move(map);
+		r.extentSize_ = extentSize;
+		r.end_ = validSize;
+		r.syncedEnd_ = validSize;
+		r.recordCount_ = recordCount;
+		return r;
+	}
+
+
+	MappedAppendLog MappedAppendLog::open(const char* pathname, size_t extentSize) {
+		File file = File::open(pathname, O_RDWR | O_CREAT | O_CLOEXEC);
+		if(! file) [[unlikely]] return MappedAppendLog();
+		return open(std::move(file), extentSize);
+	}
+
+
+	MappedAppendLog::MappedAppendLog() noexcept:
+			file_(),
+			map_(),
+			extentSize_(0),
+			end_(0),
+			syncedEnd_(0),
+			reserved_(0),
+			recordCount_(0),
+			recovery_({ })
+	{ }
+
+
+	MappedAppendLog::MappedAppendLog(MappedAppendLog&& mv) noexcept:
+			#define MV_(MEMBER_) MEMBER_(std::move(mv.MEMBER_))
+			#define CP_(MEMBER_) MEMBER_(mv.MEMBER_)
+				MV_(file_),
+				MV_(map_),
+				CP_(extentSize_),
+				CP_(end_),
+				CP_(syncedEnd_),
+				CP_(reserved_),
+				CP_(recordCount_),
+				CP_(recovery_)
+			#undef MV_
+			#undef CP_
+	{ }
+
+
+	MappedAppendLog::~MappedAppendLog() {
+		if(map_) {
+			#ifdef POSIXFIO_NOTHROW
+				close();
+			#else
+				try { close(); } catch(Errcode&) { }
+			#endif
+		}
+	}
+
+
+	MappedAppendLog& MappedAppendLog::operator=(MappedAppendLog&& mv) noexcept {
+		this->~MappedAppendLog();
+		return * new (this) MappedAppendLog(std::move(mv));
+	}
+
+
+	bool MappedAppendLog::grow(size_t minSize) {
+		size_t newSize = roundUp(minSize, extentSize_);
+		assert(newSize > map_.size());
+		if(! extendFile(file_, map_.size(), newSize)) [[unlikely]] return false;
+		return map_.remap(newSize);
+	}
+
+
+	void* MappedAppendLog::reserve(size_t size) {
+		assert(map_);
+		assert(size > 0);
+		assert(size <= std::numeric_limits<std::uint32_t>::max());
+		// Room for the record, and for the end-of-log header that follows it
+		size_t required = end_ + sizeof(RecordHeader) + alignRecord(size) + sizeof(RecordHeader);
+		if(required > map_.size()) {
+			if(! grow(required)) [[unlikely]] return nullptr;
+		}
+		auto hdr = reinterpret_cast<RecordHeader*>(map_.get<unsigned char>() + end_);
+		hdr->size = 0;
+		reserved_ = size;
+		return hdr + 1;
+	}
+
+
+	void MappedAppendLog::commit(size_t size) {
+		assert(size > 0);
+		assert(size <= reserved_);
+		auto base = map_.get<unsigned char>();
+		auto hdr = reinterpret_cast<RecordHeader*>(base + end_);
+		size_t next = end_ + sizeof(RecordHeader) + alignRecord(size);
+		// The end-of-log header is written first, so that whatever follows the record
+		// (such as the rest of a previous, larger reservation) is never mistaken for
+		// another one; `reserve` made room for it
+		memset(base + next, 0, sizeof(RecordHeader));
+		hdr->checksum = _log_impl::checksum(hdr + 1, size);
+		hdr->size = size;
+		end_ = next;
+		reserved_ = 0;
+		++ recordCount_;
+	}
+
+
+	bool MappedAppendLog::append(const void* buf, size_t size) {
+		void* dst = reserve(size);
+		if(dst == nullptr) [[unlikely]] return false;
+		memcpy(dst, buf, size);
+		commit(size);
+		return true;
+	}
+
+
+	bool MappedAppendLog::sync(LogSyncMode mode) {
+		assert(map_);
+		if(end_ == syncedEnd_) return true;
+		switch(mode) {
+			case LogSyncMode::eRange:
+				if(! map_.msync(syncedEnd_, end_ - syncedEnd_, MemSyncFlags::eSync)) [[unlikely]] return false;
+				break;
+			case LogSyncMode::eFdatasync:
+				if(0 != ::fdatasync(file_)) [[unlikely]] POSIXFIO_THROWERRNO(file_, return false);
+				break;
+		}
+		syncedEnd_ = end_;
+		return true;
+	}
+
+
+	bool MappedAppendLog::close() {
+		assert(map_);
+		if(! map_.munmap()) [[unlikely]] return false;
+		if(0 != ::ftruncate(file_, end_)) [[unlikely]] POSIXFIO_THROWERRNO(file_, return false);
+		return file_.close();
+	}
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
@@ -0,0 +1,614 @@
+#include "../../include/unix/posixfio_mt.hpp"
+
+#include <cerrno>
+#include <cassert>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#include <unistd.h>
+
+
+
+namespace posixfio {
+
+	namespace {
+
+		/** Writes the whole buffer, retrying on `EINTR`;
+		 * returns 0, or the errno value of the failed call. */
+		int writeFully(fd_t fd, const byte_t* buf, size_t count) {
+			while(count > 0) {
+				ssize_t wr = ::write(fd, buf, count);
+				if(wr < 0) [[unlikely]] {
+					if(errno == EINTR) continue;
+					return errno;
+				}
+				assert(wr > 0);
+				buf += wr;
+				count -= size_t(wr);
+			}
+			return 0;
+		}
+
+
+		int syncFile(fd_t fd, GroupSyncMode mode) {
+			int r = (mode == GroupSyncMode::eFsync)? ::fsync(fd) : ::fdatasync(fd);
+			return (r == 0)? 0 : errno;
+		}
+
+	}
+
+
+	#ifdef POSIXFIO_NOTHROW
+		#define POSIXFIO_THROWERRNO(FD_, DO_) DO_;
+		namespace no_throw {
+	#else
+		#define POSIXFIO_THROWERRNO(FD_, DO_) throw FileError(FD_, errno)
+	#endif
+
+
+	GroupCommitWriter::GroupCommitWriter(FileView file, GroupCommitOptions opts):
+			file_(file),
+			opts_(opts),
+			appended_(0),
+			durable_(0),
+			stagedCommits_(0),
+			stats_({ }),
+			errcode_(0),
+			leading_(false)
+	{
+		assert(opts_.maxBytes > 0);
+		staging_.reserve(opts_.maxBytes);
+		flushing_.reserve(opts_.maxBytes);
+	}
+
+
+	GroupCommitWriter::~GroupCommitWriter() {
+		#ifdef POSIXFIO_NOTHROW
+			sync();
+		#else
+			try { sync(); } catch(FileError&) { }
+		#endif
+	}
+
+
+	void GroupCommitWriter::lead(std::unique_lock<std::mutex>& lock) {
+		assert(! leading_);
+		leading_ = true;
+		if(opts_.maxLatency.count() > 0) {
+			batchFull_.wait_until(lock, batchStart_ + opts_.maxLatency, [&]() {
+				return staging_.size() >= opts_.maxBytes; });
+		}
+
+		// Appends go to the other buffer while this batch is written and synced
+		std::swap(staging_, flushing_);
+		Ticket target = appended_;
+		std::uint64_t commits = std::exchange(stagedCommits_, 0);
+		lock.unlock();
+		int err = writeFully(file_, flushing_.data(), flushing_.size());
+		if(err == 0) [[likely]] err = syncFile(file_, opts_.syncMode);
+		lock.lock();
+
+		if(err == 0) [[likely]] {
+			stats_.commits += commits;
+			stats_.bytes += flushing_.size();
+			++ stats_.syncs;
+			durable_ = target;
+		} else {
+			errcode_ = err;
+		}
+		flushing_.clear();
+		leading_ = false;
+		batchDone_.notify_all();
+	}
+
+
+	bool GroupCommitWriter::waitLocked(std::unique_lock<std::mutex>& lock, Ticket ticket) {
+		assert(ticket <= appended_);
+		for(;;) {
+			if(errcode_ != 0) [[unlikely]] {
+				errno = errcode_;
+				POSIXFIO_THROWERRNO(file_, return false);
+			}
+			if(durable_ >= ticket) return true;
+			if(leading_) batchDone_.wait(lock);
+			else lead(lock);
+		}
+	}
+
+
+	GroupCommitWriter::Ticket GroupCommitWriter::append(const void* buf, size_t count) {
+		auto lock = std::unique_lock(mtx_);
+		// A single append larger than `maxBytes` is only staged on its own
+		while((! staging_.empty()) && staging_.size() + count > opts_.maxBytes && errcode_ == 0) {
+			if(leading_) batchDone_.wait(lock);
+			else lead(lock);
+		}
+		if(staging_.empty()) batchStart_ = std::chrono::steady_clock::now();
+		auto bytes = reinterpret_cast<const byte_t*>(buf);
+		staging_.insert(staging_.end(), bytes, bytes + count);
+		appended_ += count;
+		++ stagedCommits_;
+		if(staging_.size() >= opts_.maxBytes) batchFull_.notify_one();
+		return appended_;
+	}
+
+
+	bool GroupCommitWriter::wait(Ticket ticket) {
+		auto lock = std::unique_lock(mtx_);
+		return waitLocked(lock, ticket);
+	}
+
+
+	bool GroupCommitWriter::sync() {
+		auto lock = std::unique_lock(mtx_);
+		return waitLocked(lock, appended_);
+	}
+
+
+	GroupCommitStats GroupCommitWriter::stats() const {
+		auto lock = std::unique_lock(mtx_);
+		return stats_;
+	}
+
+
+
+	ConcurrentOutputBuffer::ConcurrentOutputBuffer(FileView file, size_t segmentSize, size_t segmentCount):
+			file_(file),
+			segmentSize_(segmentSize),
+			segmentCount_(segmentCount),
+			ring_(new byte_t[segmentSize * segmentCount]),
+			committed_(new std::atomic_size_t[segmentCount]),
+			tail_(0),
+			flushed_(0),
+			drained_(0),
+			wake_(0),
+			flushWaiters_(0),
+			errcode_(0),
+			stop_(false)
+	{
+		assert(segmentSize > 0);
+		assert(segmentCount > 1);
+		for(size_t i = 0; i < segmentCount; ++i) committed_[i].store(0, std::memory_order_relaxed);
+		flusher_ = std::thread([this]() { runFlusher(); });
+	}
+
+
+	ConcurrentOutputBuffer::~ConcurrentOutputBuffer() {
+		stop_.store(true, std::memory_order_release);
+		notifyFlusher();
+		flusher_.join();
+		delete[] committed_;
+		delete[] ring_;
+	}
+
+
+	void ConcurrentOutputBuffer::notifyFlusher() {
+		wake_.fetch_add(1, std::memory_order_release);
+		wake_.notify_one();
+	}
+
+
+	void ConcurrentOutputBuffer::waitFlushed(std::uint64_t position) {
+		constexpr unsigned spinCount = 64;
+		unsigned spins = 0;
+		for(;;) {
+			auto drained = drained_.load(std::memory_order_acquire);
+			if(flushed_.load(std::memory_order_acquire) >= position) [[likely]] return;
+			if(spins < spinCount) {
+				++ spins;
+				std::this_thread::yield();
+			} else {
+				drained_.wait(drained, std::memory_order_acquire);
+			}
+		}
+	}
+
+
+	void ConcurrentOutputBuffer::drain() {
+		// Only the flusher thread changes `flushed_`
+		std::uint64_t begin = flushed_.load(std::memory_order_relaxed);
+		std::uint64_t end = begin;
+		while(end - begin < capacity()) {
+			std::uint64_t segStart = end - (end % segmentSize_);
+			std::uint64_t segEnd = segStart + segmentSize_;
+			// Loading `committed_` before `tail_` guarantees that, if they match,
+			// every byte reserved in the segment until now has been committed
+			size_t committed = committed_[(segStart / segmentSize_) % segmentCount_].load(std::memory_order_acquire);
+			std::uint64_t limit = std::min(segEnd, tail_.load(std::memory_order_acquire));
+			if(limit <= end || committed != limit - segStart) break;
+			end = limit;
+			if(limit < segEnd) break;
+		}
+		if(end == begin) return;
+
+		// The range wraps around the ring at most once
+		size_t ringBegin = begin % capacity();
+		size_t firstLen = std::min<size_t>(end - begin, capacity() - ringBegin);
+		IoVecList<2> iov;
+		iov.add(ring_ + ringBegin, firstLen);
+		if(firstLen < end - begin) iov.add(ring_, (end - begin) - firstLen);
+		if(errcode_.load(std::memory_order_relaxed) == 0) {
+			#ifdef POSIXFIO_NOTHROW
+				if(writeAllV(file_, iov) < 0) [[unlikely]] errcode_.store(errno, std::memory_order_relaxed);
+			#else
+				try { writeAllV(file_, iov); }
+				catch(FileError& err) { errcode_.store(err.errcode, std::memory_order_relaxed); }
+			#endif
+		}
+
+		// Segments that have been written entirely can be reused
+		for(std::uint64_t seg = begin / segmentSize_; (seg + 1) * segmentSize_ <= end; ++ seg) {
+			committed_[seg % segmentCount_].store(0, std::memory_order_relaxed);
+		}
+		flushed_.store(end, std::memory_order_release);
+		drained_.fetch_add(1, std::memory_order_release);
+		drained_.notify_all();
+	}
+
+
+	void ConcurrentOutputBuffer::runFlusher() {
+		for(;;) {
+			auto wake = wake_.load(std::memory_order_acquire);
+			// Pairs with the fence in `write`: either the producer sees a pending
+			// `flush` and wakes the flusher, or `drain` sees what it committed
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			bool stop = stop_.load(std::memory_order_acquire);
+			drain();
+			if(stop) return;
+			wake_.wait(wake, std::memory_order_acquire);
+		}
+	}
+
+
+	bool ConcurrentOutputBuffer::checkError() {
+		int err = errcode_.load(std::memory_order_relaxed);
+		if(err == 0) [[likely]] return true;
+		errno = err;
+		POSIXFIO_THROWERRNO(file_, return false);
+	}
+
+
+	ssize_t ConcurrentOutputBuffer::write(const void* buf, size_t count) {
+		if(! checkError()) [[unlikely]] return -1;
+		auto bytes = reinterpret_cast<const byte_t*>(buf);
+		size_t total = 0;
+		while(total < count) {
+			// A chunk must not span every segment, or it would wait for its own first segment to be flushed
+			size_t chunk = std::min(count - total, capacity() - segmentSize_);
+			std::uint64_t pos = tail_.fetch_add(chunk, std::memory_order_relaxed);
+
+			// The segments of the previous lap must have been written entirely
+			std::uint64_t lastSeg = (pos + chunk - 1) / segmentSize_;
+			if(lastSeg + 1 > segmentCount_) waitFlushed((lastSeg + 1 - segmentCount_) * segmentSize_);
+
+			bool notify = false;
+			std::uint64_t cursor = pos;
+			while(cursor < pos + chunk) {
+				std::uint64_t seg = cursor / segmentSize_;
+				size_t segOffset = cursor % segmentSize_;
+				size_t len = std::min<size_t>(segmentSize_ - segOffset, (pos + chunk) - cursor);
+				auto slot = seg % segmentCount_;
+				memcpy(ring_ + (slot * segmentSize_) + segOffset, bytes + total + (cursor - pos), len);
+				if(committed_[slot].fetch_add(len, std::memory_order_release) + len == segmentSize_) notify = true;
+				cursor += len;
+			}
+			// A pending `flush` may be waiting for a partial segment
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(notify || flushWaiters_.load(std::memory_order_relaxed) > 0) notifyFlusher();
+			total += chunk;
+		}
+		return total;
+	}
+
+
+	bool ConcurrentOutputBuffer::flush() {
+		std::uint64_t target = tail_.load(std::memory_order_acquire);
+		flushWaiters_.fetch_add(1, std::memory_order_seq_cst);
+		notifyFlusher();
+		waitFlushed(target);
+		flushWaiters_.fetch_sub(1, std::memory_order_relaxed);
+		return checkError();
+	}
+
+
+
+	AsyncOutputBuffer::AsyncOutputBuffer(FileView file, size_t capacity, size_t bufferCount, BackpressurePolicy policy):
+			file_(file),
+			capacity_(capacity),
+			policy_(policy),
+			current_(nullptr),
+			currentSize_(0),
+			dropped_(0),
+			written_(0),
+			errcode_(0),
+			stop_(false)
+	{
+		assert(capacity > 0);
+		assert(bufferCount > 1);
+		buffers_.reserve(bufferCount);
+		for(size_t i = 0; i < bufferCount; ++i) buffers_.push_back(new byte_t[capacity]);
+		current_ = buffers_.front();
+		free_.assign(buffers_.begin() + 1, buffers_.end());
+		writer_ = std::thread([this]() { runWriter(); });
+	}
+
+
+	AsyncOutputBuffer::~AsyncOutputBuffer() {
+		{
+			auto lock = std::unique_lock(mtx_);
+			if(currentSize_ > 0) queue_.push_back(Job { current_, currentSize_, std::nullopt });
+			stop_ = true;
+		}
+		queueCond_.notify_one();
+		writer_.join();
+		for(auto buffer : buffers_) delete[] buffer;
+	}
+
+
+	void AsyncOutputBuffer::runWriter() {
+		auto lock = std::unique_lock(mtx_);
+		for(;;) {
+			queueCond_.wait(lock, [&]() { return stop_ || ! queue_.empty(); });
+			if(queue_.empty()) return;
+			Job job = std::move(queue_.front());
+			queue_.pop_front();
+
+			if(job.buffer != nullptr) {
+				// After an error, buffers are only recycled
+				if(errcode_ == 0) [[likely]] {
+					lock.unlock();
+					int err = writeFully(file_, job.buffer, job.size);
+					lock.lock();
+					if(err == 0) [[likely]] written_ += job.size;
+					else errcode_ = err;
+				}
+				free_.push_back(job.buffer);
+				freeCond_.notify_one();
+			}
+
+			if(job.done) {
+				if(errcode_ == 0) [[likely]] {
+					job.done->set_value(written_);
+				} else {
+					#ifdef POSIXFIO_NOTHROW
+						job.done->set_value(-1);
+					#else
+						job.done->set_exception(std::make_exception_ptr(FileError(file_, errcode_)));
+					#endif
+				}
+			}
+		}
+	}
+
+
+	void AsyncOutputBuffer::handOff(std::unique_lock<std::mutex>& lock, std::optional<std::promise<ssize_t>> done) {
+		queue_.push_back(Job { current_, currentSize_, std::move(done) });
+		queueCond_.notify_one();
+		currentSize_ = 0;
+		if(free_.empty()) {
+			if(policy_ == BackpressurePolicy::eGrow) {
+				buffers_.push_back(new byte_t[capacity_]);
+				current_ = buffers_.back();
+				return;
+			}
+			freeCond_.wait(lock, [&]() { return ! free_.empty(); });
+		}
+		current_ = free_.back();
+		free_.pop_back();
+	}
+
+
+	bool AsyncOutputBuffer::checkError(std::unique_lock<std::mutex>&) {
+		if(errcode_ == 0) [[likely]] return true;
+		errno = errcode_;
+		POSIXFIO_THROWERRNO(file_, return false);
+	}
+
+
+	ssize_t AsyncOutputBuffer::write(const void* buf, size_t count) {
+		auto bytes = reinterpret_cast<const byte_t*>(buf);
+		size_t room = capacity_ - currentSize_;
+		if(count < room) [[likely]] {
+			memcpy(current_ + currentSize_, bytes, count);
+			currentSize_ += count;
+			return count;
+		}
+
+		auto lock = std::unique_lock(mtx_);
+		if(! checkError(lock)) [[unlikely]] return -1;
+		// The last buffer to be filled must be handed off, which requires one more
+		if(policy_ == BackpressurePolicy::eDrop && count >= room + (free_.size() * capacity_)) {
+			dropped_ += count;
+			return 0;
+		}
+		size_t total = 0;
+		while(total < count) {
+			size_t n = std::min(count - total, capacity_ - currentSize_);
+			memcpy(current_ + currentSize_, bytes + total, n);
+			currentSize_ += n;
+			total += n;
+			if(currentSize_ == capacity_) handOff(lock);
+		}
+		return total;
+	}
+
+
+	std::future<ssize_t> AsyncOutputBuffer::flush() {
+		std::promise<ssize_t> done;
+		auto r = done.get_future();
+		auto lock = std::unique_lock(mtx_);
+		if(currentSize_ > 0) {
+			handOff(lock, std::move(done));
+		} else {
+			queue_.push_back(Job { nullptr, 0, std::move(done) });
+			queueCond_.notify_one();
+		}
+		return r;
+	}
+
+
+
+	PrefetchInputBuffer::PrefetchInputBuffer(FileView file, size_t capacity, size_t depth):
+			file_(file),
+			capacity_(capacity),
+			pending_({ nullptr, 0, 0 }),
+			buffer_(nullptr),
+			begin_(0),
+			end_(0),
+			errcode_(0),
+			eof_(false),
+			stop_(false)
+	{
+		assert(capacity > 0);
+		assert(depth > 0);
+		// One more buffer than `depth`, which is owned by the consumer
+		buffers_.reserve(depth + 1);
+		for(size_t i = 0; i < depth + 1; ++i) buffers_.push_back(new byte_t[capacity]);
+		buffer_ = buffers_.front();
+		free_.assign(buffers_.begin() + 1, buffers_.end());
+		reader_ = std::thread([this]() { runReader(); });
+	}
+
+
+	PrefetchInputBuffer::~PrefetchInputBuffer() {
+		{
+			auto lock = std::unique_lock(mtx_);
+			stop_ = true;
+		}
+		freeCond_.notify_one();
+		reader_.join();
+		for(auto buffer : buffers_) delete[] buffer;
+	}
+
+
+	void PrefetchInputBuffer::runReader() {
+		auto lock = std::unique_lock(mtx_);
+		for(;;) {
+			freeCond_.wait(lock, [&]() { return stop_ || ! free_.empty(); });
+			if(stop_) return;
+			byte_t* buffer = free_.back();
+			free_.pop_back();
+
+			lock.unlock();
+			ssize_t rd;
+			do { rd = ::read(file_, buffer, capacity_); } while(rd < 0 && errno == EINTR);
+			int err = errno;
+			lock.lock();
+
+			if(rd > 0) [[likely]] {
+				ready_.push_back(Block { buffer, 0, size_t(rd) });
+				readyCond_.notify_one();
+			} else {
+				// EOF and errors end the prefetching
+				free_.push_back(buffer);
+				if(rd == 0) eof_ = true;
+				else errcode_ = err;
+				readyCond_.notify_one();
+				return;
+			}
+		}
+	}
+
+
+	ssize_t PrefetchInputBuffer::nextBlock(Block* dst) {
+		if(pending_.data != nullptr) {
+			*dst = std::exchange(pending_, Block { nullptr, 0, 0 });
+			return dst->end - dst->begin;
+		}
+		auto lock = std::unique_lock(mtx_);
+		readyCond_.wait(lock, [&]() { return eof_ || (errcode_ != 0) || ! ready_.empty(); });
+		if(ready_.empty()) {
+			if(errcode_ == 0) return 0;
+			errno = errcode_;
+			POSIXFIO_THROWERRNO(file_, return -1);
+		}
+		*dst = ready_.front();
+		ready_.pop_front();
+		return dst->end - dst->begin;
+	}
+
+
+	ssize_t PrefetchInputBuffer::read(void* buf, size_t count) {
+		if(begin_ == end_) {
+			ssize_t fl = fill();
+			if(fl <= 0) [[unlikely]] return fl;
+		}
+		size_t n = std::min(count, end_ - begin_);
+		memcpy(buf, buffer_ + begin_, n);
+		begin_ += n;
+		return n;
+	}
+
+
+	ssize_t PrefetchInputBuffer::readLeast(void* buf, size_t least, size_t count) {
+		ssize_t total = 0;
+		while(size_t(total) < least) {
+			auto rd = read(reinterpret_cast<byte_t*>(buf) + total, ssize_t(count) - total);
+			if(rd == 0) [[unlikely]] return total;
+			if(rd < 0) [[unlikely]] return -1;
+			total += rd;
+		}
+		return total;
+	}
+
+
+	ssize_t PrefetchInputBuffer::readAll(void* buf, size_t count) {
+		return readLeast(buf, count, count);
+	}
+
+
+	ssize_t PrefetchInputBuffer::fill() {
+		if(end_ - begin_ >= capacity_) return 0;
+		Block next;
+		ssize_t avail = nextBlock(&next);
+		if(avail <= 0) return avail;
+
+		byte_t* released;
+		if(begin_ == end_) {
+			// Swap the consumed buffer with the next one, without copying
+			released = std::exchange(buffer_, next.data);
+			begin_ = next.begin;
+			end_ = next.end;
+		} else {
+			// Top up the unread bytes, and keep the rest of the next block for later
+			memmove(buffer_, buffer_ + begin_, end_ - begin_);
+			end_ -= begin_;
+			begin_ = 0;
+			avail = std::min<size_t>(avail, capacity_ - end_);
+			memcpy(buffer_ + end_, next.data + next.begin, avail);
+			end_ += avail;
+			next.begin += avail;
+			if(next.begin < next.end) {
+				pending_ = next;
+				return avail;
+			}
+			released = next.data;
+		}
+		{
+			auto lock = std::unique_lock(mtx_);
+			free_.push_back(released);
+		}
+		freeCond_.notify_one();
+		return avail;
+	}
+
+
+	ssize_t PrefetchInputBuffer::fwd() {
+		if(begin_ + 1 >= end_) {
+			// Drop the current byte (if any) before filling, or it would be served twice
+			begin_ = end_;
+			ssize_t fl = fill();
+			if(fl <= 0)  return fl;
+		} else {
+			++ begin_;
+		}
+		return 1;
+	}
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
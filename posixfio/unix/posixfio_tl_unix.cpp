@@ -0,0 +1,1287 @@
+#include "../../include/unix/posixfio_tl.hpp"
+
+#include <cerrno>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <bit>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <poll.h>
+
+
+
+// Linux-specific counterparts of the utilities in "posixfio_tl.cpp".
+
+
+
+namespace posixfio {
+
+	#ifdef POSIXFIO_NOTHROW
+		#define POSIXFIO_THROWERRNO(FD_, DO_) DO_;
+	#else
+		#define POSIXFIO_THROWERRNO(FD_, DO_) throw FileError(FD_, errno)
+	#endif
+
+
+	namespace {
+
+		size_t alignDown(size_t n, size_t alignment) {
+			return (n / alignment) * alignment;
+		}
+
+
+		byte_t* allocAligned(size_t size, size_t alignment) {
+			return reinterpret_cast<byte_t*>(::operator new[](size, std::align_val_t(alignment)));
+		}
+
+
+		void freeAligned(byte_t* ptr, size_t alignment) {
+			::operator delete[](ptr, std::align_val_t(alignment));
+		}
+
+
+		struct AlignedDeleter {
+			size_t alignment;
+			void operator()(byte_t* ptr) const { freeAligned(ptr, alignment); }
+		};
+
+
+		/** Returns the alignment of direct transfers, which also serves as the
+		 * alignment of the buffer itself; returns 0 if an error occurs. */
+		size_t directAlignment(FileView file) {
+			auto align = file.directIoAlignment();
+			return std::max(align.memory, align.offset);
+		}
+
+
+		/** Maps a new memfd of `capacity` bytes twice, back-to-back;
+		 * the memfd itself is closed, since the mappings keep it alive. */
+		MemMapping mapRing(size_t capacity) {
+			constexpr auto prot = MemProtFlags(PROT_READ | PROT_WRITE);
+			File memfd = File::memfdCreate("posixfio-ring");
+			if(! memfd) [[unlikely]] return MemMapping();
+			if(0 != ::ftruncate(memfd, capacity)) [[unlikely]] POSIXFIO_THROWERRNO(memfd, return MemMapping());
+			// Mapping the whole range reserves it; the second half, past the
+			// end of the file, is then replaced by the second view of the file
+			auto ring = memfd.mmap(nullptr, 2 * capacity, prot, MemMapFlags::eShared, 0);
+			if(! ring) [[unlikely]] return ring;
+			auto mirror = memfd.mmap(ring.get<byte_t>() + capacity, capacity, prot, MemMapFlags(MAP_SHARED | MAP_FIXED), 0);
+			if(! mirror) [[unlikely]] return MemMapping();
+			mirror.disown();
+			return ring;
+		}
+
+
+		bool isAppendOnly(fd_t fd) {
+			int flags = ::fcntl(fd, F_GETFL);
+			return (flags >= 0) && (flags & O_APPEND);
+		}
+
+
+		/** Whether an error from `copy_file_range`, `sendfile` or `splice` means
+		 * that the kernel can't perform the operation on the given files, rather
+		 * than an I/O error; `EBADF` is also reported for `O_APPEND` destinations,
+		 * which the buffered fallback can write to. */
+		bool isTransferRefused(int errcode, FileView dst) {
+			switch(errcode) {
+				case EINVAL:
+				case EXDEV:
+				case ENOSYS:
+				case EOPNOTSUPP:
+					return true;
+				case EBADF:
+					return isAppendOnly(dst);
+				default:
+					return false;
+			}
+		}
+
+
+		/** Guesses which file made a single in-kernel copy from `src` to `dst` fail. */
+		fd_t blameKernelCopy(FileView src, FileView dst, int errcode) {
+			switch(errcode) {
+				case ENOSPC:
+				case EDQUOT:
+				case EFBIG:
+				case EPIPE:
+					return dst;
+				case EBADF: {
+					int flags = ::fcntl(dst, F_GETFL);
+					bool dstWritable = (flags >= 0) && ((flags & O_ACCMODE) != O_RDONLY);
+					return dstWritable? fd_t(src) : fd_t(dst);
+				}
+				default:
+					return src;
+			}
+		}
+
+
+		bool isFifo(fd_t fd) {
+			struct stat st;
+			return (0 == ::fstat(fd, &st)) && S_ISFIFO(st.st_mode);
+		}
+
+
+		/** The `errno` of a failed transfer engine, and the file that caused it. */
+		struct EngineError {
+			int errcode;  // 0 if the engine succeeded
+			fd_t fd;
+		};
+
+		constexpr EngineError engineOk = { 0, File::NULL_FD };
+
+
+		// Every transfer engine below moves data until `*moved` reaches `count` or
+		// EOF is reached, returning `engineOk`; otherwise, it returns the `errno`
+		// of the failed call, along with the file that caused it.
+
+
+		EngineError transferCopyFileRange(FileView src, FileView dst, size_t count, size_t chunk, size_t* moved) {
+			bool first = true;
+			while(*moved < count) {
+				ssize_t n = ::copy_file_range(src, nullptr, dst, nullptr, std::min(chunk, count - *moved), 0);
+				if(n < 0) return { errno, blameKernelCopy(src, dst, errno) };
+				if(n == 0) {
+					// Pseudo-files (like the ones in /proc) may report a size of 0,
+					// and the next strategy can tell the difference
+					return first? EngineError { EINVAL, src } : engineOk;
+				}
+				*moved += size_t(n);
+				first = false;
+			}
+			return engineOk;
+		}
+
+
+		EngineError transferSendfile(FileView src, FileView dst, size_t count, size_t chunk, size_t* moved) {
+			while(*moved < count) {
+				ssize_t n = ::sendfile(dst, src, nullptr, std::min(chunk, count - *moved));
+				if(n < 0) return { errno, blameKernelCopy(src, dst, errno) };
+				if(n == 0) return engineOk;
+				*moved += size_t(n);
+			}
+			return engineOk;
+		}
+
+
+		EngineError transferSplice(FileView src, FileView dst, size_t count, size_t chunk, size_t* moved) {
+			constexpr unsigned flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+			if(isFifo(src) || isFifo(dst)) {
+				while(*moved < count) {
+					ssize_t n = ::splice(src, nullptr, dst, nullptr, std::min(chunk, count - *moved), flags);
+					if(n < 0) return { errno, blameKernelCopy(src, dst, errno) };
+					if(n == 0) return engineOk;
+					*moved += size_t(n);
+				}
+				return engineOk;
+			}
+
+			// Neither file is a pipe, one is needed to stand between them
+			fd_t pipeFds[2];
+			if(0 != ::pipe2(pipeFds, O_CLOEXEC)) return { errno, src };
+			Pipe pipe;
+			pipe.rd = pipeFds[0];
+			pipe.wr = pipeFds[1];
+			(void) ::fcntl(pipe.wr, F_SETPIPE_SZ, int(std::min<size_t>(chunk, INT_MAX))); // Fewer, larger splices; best effort
+			while(*moved < count) {
+				ssize_t inPipe = ::splice(src, nullptr, pipe.wr, nullptr, std::min(chunk, count - *moved), flags);
+				if(inPipe < 0) return { errno, src };
+				if(inPipe == 0) return engineOk;
+				while(inPipe > 0) {
+					ssize_t n = ::splice(pipe.rd, nullptr, dst, nullptr, inPipe, flags);
+					if(n < 0) {
+						// The data in the pipe has already been consumed from `src`,
+						// and must reach `dst` before falling back
+						int errcode = errno;
+						if(! isTransferRefused(errcode, dst)) return { errcode, dst };
+						auto buf = std::make_unique<byte_t[]>(inPipe);
+						ssize_t rd = readAll(pipe.rd, buf.get(), inPipe);
+						if(rd < 0) [[unlikely]] return { errno, src };
+						ssize_t wr = writeAll(dst, buf.get(), rd);
+						if(wr < 0) [[unlikely]] return { errno, dst };
+						*moved += size_t(wr);
+						return { errcode, dst };
+					}
+					*moved += size_t(n);
+					inPipe -= n;
+				}
+			}
+			return engineOk;
+		}
+
+
+		EngineError transferBuffered(FileView src, FileView dst, size_t count, size_t chunk, size_t* moved) {
+			chunk = std::min(chunk, count - *moved);
+			auto buf = std::make_unique<byte_t[]>(chunk);
+			while(*moved < count) {
+				ssize_t rd = src.read(buf.get(), std::min(chunk, count - *moved));
+				if(rd < 0) [[unlikely]] return { errno, src };
+				if(rd == 0) return engineOk;
+				ssize_t wr = writeAll(dst, buf.get(), rd);
+				if(wr < 0) [[unlikely]] return { errno, dst };
+				*moved += size_t(wr);
+			}
+			return engineOk;
+		}
+
+	}
+
+
+	ssize_t readAllV(FileView file, const struct iovec* iov, int iovcnt) {
+		#define BYTES_(PTR_) reinterpret_cast<byte_t*>(PTR_)
+		size_t total = 0;
+		int i = 0;
+		while(i < iovcnt) {
+			if(iov[i].iov_len == 0) { ++ i;  continue; } // An empty first buffer would be mistaken for EOF
+			ssize_t rd = file.readv(iov + i, std::min(iovcnt - i, IOV_MAX));
+			#ifdef POSIXFIO_NOTHROW
+				if(rd < 0) return rd;
+			#else
+				assert(rd >= 0);
+			#endif
+			if(rd == 0) break;
+			total += size_t(rd);
+			size_t partial = size_t(rd);
+			while(i < iovcnt && partial >= iov[i].iov_len) {
+				partial -= iov[i].iov_len;
+				++ i;
+			}
+			if(partial > 0) {
+				// The read stopped in the middle of a buffer, which is completed on its own
+				assert(i < iovcnt);
+				size_t remaining = iov[i].iov_len - partial;
+				rd = readAll(file, BYTES_(iov[i].iov_base) + partial, remaining);
+				if(rd < 0) [[unlikely]] return rd;
+				total += size_t(rd);
+				if(size_t(rd) < remaining) break;
+				++ i;
+			}
+		}
+		return total;
+		#undef BYTES_
+	}
+
+
+	ssize_t writeAllV(FileView file, const struct iovec* iov, int iovcnt) {
+		#define CBYTES_(PTR_) reinterpret_cast<const byte_t*>(PTR_)
+		size_t total = 0;
+		int i = 0;
+		while(i < iovcnt) {
+			if(iov[i].iov_len == 0) { ++ i;  continue; }
+			ssize_t wr = file.writev(iov + i, std::min(iovcnt - i, IOV_MAX));
+			#ifdef POSIXFIO_NOTHROW
+				assert(wr != 0);
+				if(wr < 0) [[unlikely]] return wr;
+			#else
+				assert(wr > 0);
+			#endif
+			total += size_t(wr);
+			size_t partial = size_t(wr);
+			while(i < iovcnt && partial >= iov[i].iov_len) {
+				partial -= iov[i].iov_len;
+				++ i;
+			}
+			if(partial > 0) {
+				// The write stopped in the middle of a buffer, which is completed on its own
+				assert(i < iovcnt);
+				size_t remaining = iov[i].iov_len - partial;
+				wr = writeAll(file, CBYTES_(iov[i].iov_base) + partial, remaining);
+				if(wr < 0) [[unlikely]] return wr;
+				total += size_t(wr);
+				++ i;
+			}
+		}
+		return total;
+		#undef CBYTES_
+	}
+
+
+	ssize_t preadAll(FileView file, void* buf, size_t count, off_t offset) {
+		#define BYTES_(PTR_) reinterpret_cast<byte_t*>(PTR_)
+		const auto initCount = count;
+		ssize_t rd = 1 /* Must be != 0 */;
+		while(count > 0 && rd > 0) {
+			rd = file.pread(buf, count, offset);
+			#ifdef POSIXFIO_NOTHROW
+				if(rd < 0) return rd;
+			#else
+				assert(rd >= 0);
+			#endif
+			assert(count >= size_t(rd));
+			buf = BYTES_(buf) + rd;
+			count -= size_t(rd);
+			offset += rd;
+		}
+		return initCount - count;
+		#undef BYTES_
+	}
+
+
+	ssize_t pwriteAll(FileView file, const void* buf, size_t count, off_t offset) {
+		#define CBYTES_(PTR_) reinterpret_cast<const byte_t*>(PTR_)
+		const auto initCount = count;
+		while(count > 0) {
+			ssize_t wr = file.pwrite(buf, count, offset);
+			#ifdef POSIXFIO_NOTHROW
+				assert(wr != 0);
+				if(wr < 0) [[unlikely]] return wr;
+			#else
+				assert(wr > 0);
+			#endif
+			assert(count >= size_t(wr));
+			buf = CBYTES_(buf) + wr;
+			count -= size_t(wr);
+			offset += wr;
+		}
+		assert(count == 0);
+		return initCount;
+		#undef CBYTES_
+	}
+
+
+
+	namespace {
+
+		/** Returns the `poll` timeout that expires at the deadline, or -1 if there is none. */
+		int pollTimeout(std::chrono::steady_clock::time_point deadline) {
+			using namespace std::chrono;
+			if(deadline == steady_clock::time_point::max()) return -1;
+			auto remaining = ceil<milliseconds>(deadline - steady_clock::now()).count();
+			return int(std::clamp<decltype(remaining)>(remaining, 0, INT_MAX));
+		}
+
+
+		/** Repeats `op(offset, count)`, which follows `read` or `write` semantics
+		 * without throwing, until at least `least` bytes are transferred or
+		 * the policy stops the transfer. */
+		template<typename Op>
+		IoResult ioLoop(FileView file, short pollEvents, size_t least, size_t count, const IoPolicy& policy, Op&& op) {
+			assert(least <= count);
+			IoResult r = { 0, IoStatus::eComplete, 0 };
+			bool hasDeadline = policy.deadline != std::chrono::steady_clock::time_point::max();
+			while(r.count < least) {
+				if(hasDeadline && std::chrono::steady_clock::now() >= policy.deadline) [[unlikely]] {
+					r.status = IoStatus::eTimeout;
+					r.errcode = ETIMEDOUT;
+					break;
+				}
+				ssize_t xfer = op(r.count, count - r.count);
+				if(xfer > 0) [[likely]] {
+					r.count += size_t(xfer);
+					continue;
+				}
+				if(xfer == 0) {
+					r.status = IoStatus::eEof;
+					break;
+				}
+				int err = errno;
+				if(err == EAGAIN || err == EWOULDBLOCK) {
+					if(! policy.waitReady) {
+						r.status = IoStatus::eWouldBlock;
+						r.errcode = err;
+						break;
+					}
+					struct pollfd pfd = { file, pollEvents, 0 };
+					int ready = ::poll(&pfd, 1, pollTimeout(policy.deadline));
+					if(ready >= 0) continue;  // On timeout, the deadline is checked at the top of the loop
+					err = errno;
+				}
+				if(err == EINTR) {
+					if(policy.retryInterrupted) continue;
+					r.status = IoStatus::eInterrupted;
+				} else {
+					r.status = IoStatus::eError;
+				}
+				r.errcode = err;
+				break;
+			}
+			return r;
+		}
+
+	}
+
+
+	IoResult readAll(FileView file, void* buf, size_t count, const IoPolicy& policy) {
+		return readLeast(file, buf, count, count, policy);
+	}
+
+
+	IoResult readLeast(FileView file, void* buf, size_t least, size_t count, const IoPolicy& policy) {
+		auto bytes = reinterpret_cast<byte_t*>(buf);
+		return ioLoop(file, POLLIN, least, count, policy, [&](size_t offset, size_t n) {
+			return ::read(file, bytes + offset, n);
+		});
+	}
+
+
+	IoResult writeAll(FileView file, const void* buf, size_t count, const IoPolicy& policy) {
+		return writeLeast(file, buf, count, count, policy);
+	}
+
+
+	IoResult writeLeast(FileView file, const void* buf, size_t least, size_t count, const IoPolicy& policy) {
+		auto bytes = reinterpret_cast<const byte_t*>(buf);
+		return ioLoop(file, POLLOUT, least, count, policy, [&](size_t offset, size_t n) {
+			return ::write(file, bytes + offset, n);
+		});
+	}
+
+
+
+	TransferResult transfer(FileView src, FileView dst, size_t count, TransferHints hints) {
+		using Engine = EngineError (*)(FileView, FileView, size_t, size_t, size_t*);
+		struct Candidate {
+			TransferStrategy strategy;
+			bool allowed;
+			Engine engine;
+		};
+		const Candidate candidates[] = {
+			{ TransferStrategy::eCopyFileRange, hints.allowCopyFileRange, transferCopyFileRange },
+			{ TransferStrategy::eSendfile,      hints.allowSendfile,      transferSendfile },
+			{ TransferStrategy::eSplice,        hints.allowSplice,        transferSplice },
+			{ TransferStrategy::eBuffered,      true,                     transferBuffered } };
+		assert(hints.chunkSize > 0);
+
+		TransferResult r = { 0, TransferStrategy::eNone };
+		size_t moved = 0;
+		if(count == 0) return r;
+		for(auto& candidate : candidates) {
+			if(! candidate.allowed) continue;
+			size_t prevMoved = moved;
+			auto err = candidate.engine(src, dst, count, hints.chunkSize, &moved);
+			if(moved > prevMoved) r.strategy = candidate.strategy;
+			if(err.errcode == 0) {
+				r.count = moved;
+				return r;
+			}
+			if((candidate.strategy == TransferStrategy::eBuffered) || ! isTransferRefused(err.errcode, dst)) {
+				#ifdef POSIXFIO_NOTHROW
+					errno = err.errcode;
+					r.count = -1;
+					return r;
+				#else
+					throw FileError(err.fd, err.errcode);
+				#endif
+			}
+		}
+		assert(false && "the buffered strategy is always allowed");
+		return r;
+	}
+
+
+
+	MappedInputBuffer::MappedInputBuffer() noexcept:
+			file_(),
+			windowOffset_(0),
+			begin_(0),
+			end_(0),
+			released_(0),
+			windowSize_(0)
+	{ }
+
+
+	MappedInputBuffer::MappedInputBuffer(FileView file, size_t windowSize):
+			MappedInputBuffer()
+	{
+		assert(windowSize > 0);
+		off_t offset = file.lseek(0, SEEK_CUR);
+		if(offset < 0) [[unlikely]] return;
+		size_t page = ::sysconf(_SC_PAGESIZE);
+		file_ = file;
+		windowOffset_ = offset;
+		windowSize_ = ((windowSize + page - 1) / page) * page;
+	}
+
+
+	void MappedInputBuffer::releaseConsumed() {
+		// Consumed pages are dropped from the process in steps of a quarter window,
+		// so that large windows don't keep the whole file resident
+		size_t page = ::sysconf(_SC_PAGESIZE);
+		size_t consumed = (begin_ / page) * page;
+		if(consumed - released_ >= std::max(windowSize_ / 4, page)) {
+			(void) ::madvise(window_.get<byte_t>() + released_, consumed - released_, MADV_DONTNEED);
+			released_ = consumed;
+		}
+	}
+
+
+	ssize_t MappedInputBuffer::fill() {
+		struct stat st;
+		if(0 != ::fstat(file_, &st)) [[unlikely]] {
+			POSIXFIO_THROWERRNO(file_, return -1);
+		}
+		size_t page = ::sysconf(_SC_PAGESIZE);
+		off_t fileSize = st.st_size;
+		off_t cursor = tell();
+		off_t prevWindowEnd = windowOffset_ + off_t(end_);
+		off_t newOffset = (cursor / page) * page;
+		off_t newWindowEnd = std::min<off_t>(fileSize, newOffset + windowSize_);
+		if(newWindowEnd <= prevWindowEnd) return 0;
+
+		if(! window_ || newOffset != windowOffset_) {
+			auto mapping = file_.mmap(windowSize_, MemProtFlags::eRead, MemMapFlags::eShared, newOffset);
+			if(! mapping) [[unlikely]] return -1;
+			(void) ::madvise(mapping.get(), windowSize_, MADV_SEQUENTIAL);
+			window_ = std::move(mapping);
+			windowOffset_ = newOffset;
+			begin_ = cursor - newOffset;
+			released_ = 0;
+		}
+		end_ = newWindowEnd - windowOffset_;
+		return newWindowEnd - prevWindowEnd;
+	}
+
+
+	ssize_t MappedInputBuffer::read(void* buf, size_t count) {
+		if(begin_ >= end_) {
+			ssize_t fl = fill();
+			if(fl <= 0) return fl;
+		}
+		size_t n = std::min(count, end_ - begin_);
+		memcpy(buf, window_.get<byte_t>() + begin_, n);
+		begin_ += n;
+		releaseConsumed();
+		return n;
+	}
+
+
+	ssize_t MappedInputBuffer::readLeast(void* buf, size_t least, size_t count) {
+		ssize_t total = 0;
+		while(size_t(total) < least) {
+			auto rd = read(reinterpret_cast<byte_t*>(buf) + total, ssize_t(count) - total);
+			if(rd == 0) [[unlikely]] return total;
+			if(rd < 0) [[unlikely]] return -1;
+			total += rd;
+		}
+		return total;
+	}
+
+
+	ssize_t MappedInputBuffer::readAll(void* buf, size_t count) {
+		return readLeast(buf, count, count);
+	}
+
+
+	ssize_t MappedInputBuffer::fwd() {
+		if(begin_ + 1 >= end_) {
+			begin_ = end_;
+			ssize_t fl = fill();
+			if(fl <= 0)  return fl;
+			releaseConsumed();
+		} else {
+			++ begin_;
+		}
+		return 1;
+	}
+
+
+
+	DirectInputBuffer::DirectInputBuffer() noexcept:
+			file_(),
+			bufferOffset_(0),
+			begin_(0),
+			end_(0),
+			capacity_(0),
+			alignment_(0),
+			buffer_(nullptr)
+	{ }
+
+
+	DirectInputBuffer::DirectInputBuffer(DirectInputBuffer&& mv) noexcept:
+			#define MV_(MEMBER_) MEMBER_(std::move(mv.MEMBER_))
+			#define CP_(MEMBER_) MEMBER_(mv.MEMBER_)
+				MV_(file_),
+				CP_(bufferOffset_),
+				CP_(begin_),
+				CP_(end_),
+				CP_(capacity_),
+				CP_(alignment_),
+				CP_(buffer_)
+			#undef MV_
+			#undef CP_
+	{
+		mv.buffer_ = nullptr;
+	}
+
+
+	DirectInputBuffer::DirectInputBuffer(FileView file, size_t capacity):
+			DirectInputBuffer()
+	{
+		assert(capacity > 0);
+		size_t alignment = directAlignment(file);
+		if(alignment == 0) [[unlikely]] return;
+		off_t offset = file.lseek(0, SEEK_CUR);
+		if(offset < 0) [[unlikely]] return;
+		file_ = file;
+		alignment_ = alignment;
+		capacity_ = alignDown(capacity + alignment_ - 1, alignment_);
+		bufferOffset_ = alignDown(offset, alignment_);
+		// The bytes before the initial offset are read, but never exposed
+		begin_ = offset - bufferOffset_;
+		end_ = begin_;
+		buffer_ = allocAligned(capacity_, alignment_);
+	}
+
+
+	DirectInputBuffer::~DirectInputBuffer() {
+		if(buffer_ != nullptr) freeAligned(buffer_, alignment_);
+	}
+
+
+	DirectInputBuffer& DirectInputBuffer::operator=(DirectInputBuffer&& mv) noexcept {
+		this->~DirectInputBuffer();
+		return * new (this) DirectInputBuffer(std::move(mv));
+	}
+
+
+	ssize_t DirectInputBuffer::fill() {
+		// Consumed blocks are dropped, the partially consumed one is moved to the beginning
+		size_t consumed = alignDown(begin_, alignment_);
+		if(consumed > 0) {
+			memmove(buffer_, buffer_ + consumed, end_ - consumed);
+			bufferOffset_ += consumed;
+			begin_ -= consumed;
+			end_ -= consumed;
+		}
+		// A partial block at the end (the tail of the file, at the time it was read) is read again
+		size_t readFrom = alignDown(end_, alignment_);
+		if(readFrom >= capacity_) return 0;
+		ssize_t rd = file_.pread(buffer_ + readFrom, capacity_ - readFrom, bufferOffset_ + off_t(readFrom));
+		if(rd < 0) [[unlikely]] return rd;
+		size_t newEnd = readFrom + size_t(rd);
+		if(newEnd <= end_) return 0;
+		ssize_t r = newEnd - end_;
+		end_ = newEnd;
+		return r;
+	}
+
+
+	ssize_t DirectInputBuffer::read(void* buf, size_t count) {
+		if(begin_ >= end_) {
+			ssize_t fl = fill();
+			if(fl <= 0) return fl;
+		}
+		size_t n = std::min(count, end_ - begin_);
+		memcpy(buf, buffer_ + begin_, n);
+		begin_ += n;
+		return n;
+	}
+
+
+	ssize_t DirectInputBuffer::readLeast(void* buf, size_t least, size_t count) {
+		ssize_t total = 0;
+		while(size_t(total) < least) {
+			auto rd = read(reinterpret_cast<byte_t*>(buf) + total, ssize_t(count) - total);
+			if(rd == 0) [[unlikely]] return total;
+			if(rd < 0) [[unlikely]] return -1;
+			total += rd;
+		}
+		return total;
+	}
+
+
+	ssize_t DirectInputBuffer::readAll(void* buf, size_t count) {
+		return readLeast(buf, count, count);
+	}
+
+
+	ssize_t DirectInputBuffer::fwd() {
+		if(begin_ + 1 >= end_) {
+			begin_ = end_;
+			ssize_t fl = fill();
+			if(fl <= 0)  return fl;
+		} else {
+			++ begin_;
+		}
+		return 1;
+	}
+
+
+
+	DirectOutputBuffer::DirectOutputBuffer() noexcept:
+			file_(),
+			bufferOffset_(0),
+			end_(0),
+			capacity_(0),
+			alignment_(0),
+			buffer_(nullptr)
+	{ }
+
+
+	DirectOutputBuffer::DirectOutputBuffer(DirectOutputBuffer&& mv) noexcept:
+			#define MV_(MEMBER_) MEMBER_(std::move(mv.MEMBER_))
+			#define CP_(MEMBER_) MEMBER_(mv.MEMBER_)
+				MV_(file_),
+				CP_(bufferOffset_),
+				CP_(end_),
+				CP_(capacity_),
+				CP_(alignment_),
+				CP_(buffer_)
+			#undef MV_
+			#undef CP_
+	{
+		mv.buffer_ = nullptr;
+	}
+
+
+	DirectOutputBuffer::DirectOutputBuffer(FileView file, size_t capacity):
+			DirectOutputBuffer()
+	{
+		assert(capacity > 0);
+		size_t alignment = directAlignment(file);
+		if(alignment == 0) [[unlikely]] return;
+		off_t offset = file.lseek(0, SEEK_CUR);
+		if(offset < 0) [[unlikely]] return;
+		off_t bufferOffset = alignDown(offset, alignment);
+		size_t end = offset - bufferOffset;
+		size_t bufCapacity = alignDown(capacity + alignment - 1, alignment);
+		auto buffer = std::unique_ptr<byte_t, AlignedDeleter>(allocAligned(bufCapacity + alignment, alignment), { alignment });
+		if(end > 0) {
+			// The first block is partially rewritten, so the data before the offset must be preserved
+			ssize_t rd = file.pread(buffer.get(), alignment, bufferOffset);
+			if(rd < 0) [[unlikely]] return;
+			if(size_t(rd) < end) memset(buffer.get() + rd, 0, end - rd);
+		}
+		file_ = file;
+		bufferOffset_ = bufferOffset;
+		end_ = end;
+		capacity_ = bufCapacity;
+		alignment_ = alignment;
+		buffer_ = buffer.release();
+	}
+
+
+	DirectOutputBuffer::~DirectOutputBuffer() {
+		if(buffer_ != nullptr) {
+			#ifdef POSIXFIO_NOTHROW
+				flush();
+			#else
+				try { flush(); } catch(Errcode&) { }
+			#endif
+			freeAligned(buffer_, alignment_);
+		}
+	}
+
+
+	DirectOutputBuffer& DirectOutputBuffer::operator=(DirectOutputBuffer&& mv) noexcept {
+		this->~DirectOutputBuffer();
+		return * new (this) DirectOutputBuffer(std::move(mv));
+	}
+
+
+	bool DirectOutputBuffer::flushBlocks() {
+		size_t blocks = alignDown(end_, alignment_);
+		if(blocks == 0) return true;
+		if(0 > pwriteAll(file_, buffer_, blocks, bufferOffset_)) [[unlikely]] return false;
+		memmove(buffer_, buffer_ + blocks, end_ - blocks);
+		bufferOffset_ += blocks;
+		end_ -= blocks;
+		return true;
+	}
+
+
+	ssize_t DirectOutputBuffer::write(const void* buf, size_t count) {
+		if(end_ >= capacity_) {
+			if(! flushBlocks()) [[unlikely]] return -1;
+		}
+		size_t n = std::min(count, capacity_ - end_);
+		memcpy(buffer_ + end_, buf, n);
+		end_ += n;
+		return n;
+	}
+
+
+	ssize_t DirectOutputBuffer::writeAll(const void* buf, size_t count) {
+		size_t total = 0;
+		while(total < count) {
+			auto wr = write(reinterpret_cast<const byte_t*>(buf) + total, count - total);
+			if(wr < 0) [[unlikely]] return -1;
+			total += wr;
+		}
+		return total;
+	}
+
+
+	bool DirectOutputBuffer::flush() {
+		if(! flushBlocks()) [[unlikely]] return false;
+		if(end_ == 0) return true;
+		struct stat st;
+		if(0 != ::fstat(file_, &st)) [[unlikely]] POSIXFIO_THROWERRNO(file_, return false);
+		off_t tailEnd = tell();
+		size_t padFrom = end_;
+		if(st.st_size > tailEnd) {
+			// The file has data after the tail, which must be written back as it is
+			byte_t* scratch = buffer_ + capacity_;
+			ssize_t rd = file_.pread(scratch, alignment_, bufferOffset_);
+			if(rd < 0) [[unlikely]] return false;
+			if(size_t(rd) > end_) {
+				memcpy(buffer_ + end_, scratch + end_, rd - end_);
+				padFrom = rd;
+			}
+		}
+		memset(buffer_ + padFrom, 0, alignment_ - padFrom);
+		if(0 > pwriteAll(file_, buffer_, alignment_, bufferOffset_)) [[unlikely]] return false;
+		off_t blockEnd = bufferOffset_ + off_t(alignment_);
+		if(st.st_size < blockEnd) {
+			// Remove the padding
+			if(0 != ::ftruncate(file_, std::max<off_t>(st.st_size, tailEnd))) [[unlikely]] POSIXFIO_THROWERRNO(file_, return false);
+		}
+		return true;
+	}
+
+
+
+	RingInputBuffer::RingInputBuffer() noexcept:
+			file_(),
+			ring_(),
+			begin_(0),
+			end_(0),
+			capacity_(0)
+	{ }
+
+
+	RingInputBuffer::RingInputBuffer(FileView file, size_t capacity):
+			file_(file),
+			begin_(0),
+			end_(0)
+	{
+		assert(capacity > 0);
+		size_t page = ::sysconf(_SC_PAGESIZE);
+		capacity_ = alignDown(capacity + page - 1, page);
+		ring_ = mapRing(capacity_);
+	}
+
+
+	ssize_t RingInputBuffer::fill() {
+		size_t free = capacity_ - size();
+		if(free == 0) return 0;
+		ssize_t rd = _buffer_op_impl::readReady(file_, ring_.get<byte_t>() + end_, free);
+		if(rd > 0) [[likely]] end_ += rd;
+		return rd;
+	}
+
+
+	ssize_t RingInputBuffer::read(void* buf, size_t count) {
+		if(begin_ >= end_) {
+			// Reads that would fill the whole buffer skip it
+			if(count >= capacity_) return file_.read(buf, count);
+			ssize_t fl = fill();
+			if(fl <= 0) return fl;
+		}
+		size_t n = std::min(count, size());
+		memcpy(buf, data(), n);
+		consume(n);
+		return n;
+	}
+
+
+	ssize_t RingInputBuffer::readLeast(void* buf, size_t least, size_t count) {
+		ssize_t total = 0;
+		while(size_t(total) < least) {
+			auto rd = read(reinterpret_cast<byte_t*>(buf) + total, ssize_t(count) - total);
+			if(rd == 0) [[unlikely]] return total;
+			if(rd < 0) [[unlikely]] return -1;
+			total += rd;
+		}
+		return total;
+	}
+
+
+	ssize_t RingInputBuffer::readAll(void* buf, size_t count) {
+		return readLeast(buf, count, count);
+	}
+
+
+	ssize_t RingInputBuffer::fwd() {
+		if(begin_ + 1 >= end_) {
+			consume(size());
+			ssize_t fl = fill();
+			if(fl <= 0)  return fl;
+		} else {
+			consume(1);
+		}
+		return 1;
+	}
+
+
+	ssize_t RingInputBuffer::peek(size_t n) {
+		assert(n <= capacity_);
+		while(size() < n) {
+			ssize_t rd = fill();
+			if(rd < 0) [[unlikely]] return -1;
+			if(rd == 0) break;
+		}
+		return size();
+	}
+
+
+
+	RingOutputBuffer::RingOutputBuffer() noexcept:
+			file_(),
+			ring_(),
+			begin_(0),
+			end_(0),
+			capacity_(0)
+	{ }
+
+
+	RingOutputBuffer::RingOutputBuffer(RingOutputBuffer&& mv) noexcept:
+			#define MV_(MEMBER_) MEMBER_(std::move(mv.MEMBER_))
+			#define CP_(MEMBER_) MEMBER_(mv.MEMBER_)
+				MV_(file_),
+				MV_(ring_),
+				CP_(begin_),
+				CP_(end_),
+				CP_(capacity_)
+			#undef MV_
+			#undef CP_
+	{ }
+
+
+	RingOutputBuffer::RingOutputBuffer(FileView file, size_t capacity):
+			file_(file),
+			begin_(0),
+			end_(0)
+	{
+		assert(capacity > 0);
+		size_t page = ::sysconf(_SC_PAGESIZE);
+		capacity_ = alignDown(capacity + page - 1, page);
+		ring_ = mapRing(capacity_);
+	}
+
+
+	RingOutputBuffer::~RingOutputBuffer() {
+		if(ring_) {
+			#ifdef POSIXFIO_NOTHROW
+				flush();
+			#else
+				try { flush(); } catch(Errcode&) { }
+			#endif
+		}
+	}
+
+
+	RingOutputBuffer& RingOutputBuffer::operator=(RingOutputBuffer&& mv) noexcept {
+		this->~RingOutputBuffer();
+		return * new (this) RingOutputBuffer(std::move(mv));
+	}
+
+
+	void RingOutputBuffer::advance(size_t n) {
+		begin_ += n;
+		if(begin_ >= capacity_) { begin_ -= capacity_;  end_ -= capacity_; }
+	}
+
+
+	ssize_t RingOutputBuffer::flushSome() {
+		if(size() == 0) return 0;
+		ssize_t wr = _buffer_op_impl::writeReady(file_, ring_.get<byte_t>() + begin_, size());
+		if(wr > 0) [[likely]] advance(wr);
+		return wr;
+	}
+
+
+	bool RingOutputBuffer::flush() {
+		while(size() > 0) {
+			if(0 > flushSome()) [[unlikely]] return false;
+		}
+		begin_ = 0;
+		end_ = 0;
+		return true;
+	}
+
+
+	ssize_t RingOutputBuffer::write(const void* buf, size_t count) {
+		if(size() >= capacity_) {
+			ssize_t wr = flushSome();
+			if(wr <= 0) [[unlikely]] return wr;
+		}
+		if(size() == 0 && count >= capacity_) {
+			// Writes that would fill the whole buffer skip it
+			return file_.write(buf, count);
+		}
+		size_t n = std::min(count, capacity_ - size());
+		memcpy(ring_.get<byte_t>() + end_, buf, n);
+		end_ += n;
+		return n;
+	}
+
+
+	ssize_t RingOutputBuffer::writeAll(const void* buf, size_t count) {
+		size_t total = 0;
+		while(total < count) {
+			auto wr = write(reinterpret_cast<const byte_t*>(buf) + total, count - total);
+			if(wr < 0) [[unlikely]] return -1;
+			total += wr;
+		}
+		return total;
+	}
+
+
+	std::span<byte_t> RingOutputBuffer::reserve(size_t n) {
+		if(n > capacity_) [[unlikely]] return { };
+		while(capacity_ - size() < n) {
+			ssize_t wr = flushSome();
+			if(wr < 0) [[unlikely]] return { };
+		}
+		return { ring_.get<byte_t>() + end_, capacity_ - size() };
+	}
+
+
+
+	namespace _buffer_pool_impl {
+
+		constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+
+		struct PoolState {
+			BufferPoolOptions opts;
+			std::pmr::memory_resource* upstream;
+			size_t pageSize;
+			unsigned minShift;
+			unsigned classCount;
+			std::mutex mtx;
+			std::vector<std::vector<void*>> shared;
+			std::atomic_size_t blockCount;
+			std::atomic_bool alive;
+			std::atomic_bool noHugetlb;
+
+			PoolState(BufferPoolOptions opts, std::pmr::memory_resource* upstream):
+					opts(opts),
+					upstream(upstream),
+					pageSize(::sysconf(_SC_PAGESIZE)),
+					blockCount(0),
+					alive(true),
+					noHugetlb(false)
+			{
+				this->opts.minBlockSize = std::bit_ceil(std::max(opts.minBlockSize, alignof(std::max_align_t)));
+				this->opts.maxBlockSize = std::bit_ceil(std::max(opts.maxBlockSize, this->opts.minBlockSize));
+				minShift = std::countr_zero(this->opts.minBlockSize);
+				classCount = std::countr_zero(this->opts.maxBlockSize) - minShift + 1;
+				shared.resize(classCount);
+			}
+
+			~PoolState() {
+				for(unsigned cls = 0; cls < classCount; ++ cls) {
+					for(void* block : shared[cls]) freeBlock(block, cls);
+				}
+			}
+
+			size_t blockSize(unsigned cls) const { return size_t(1) << (minShift + cls); }
+			size_t blockAlignment(unsigned cls) const { return std::min(blockSize(cls), pageSize); }
+			bool isMapped(unsigned cls) const { return opts.hugePages && blockSize(cls) >= hugePageSize; }
+
+			/** Returns `classCount` for requests that bypass the pool. */
+			unsigned classOf(size_t bytes, size_t alignment) const {
+				if(bytes > opts.maxBlockSize) [[unlikely]] return classCount;
+				unsigned cls = std::countr_zero(std::bit_ceil(std::max(bytes, opts.minBlockSize))) - minShift;
+				if(alignment > blockAlignment(cls)) [[unlikely]] return classCount;
+				return cls;
+			}
+
+			void* mapBlock(size_t size) {
+				if(! noHugetlb.load(std::memory_order_relaxed)) {
+					void* r = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+					if(r != MAP_FAILED) return r;
+					noHugetlb.store(true, std::memory_order_relaxed);
+				}
+				// Transparent huge pages need the block to be aligned to a huge page,
+				// so an extra one is mapped and the misaligned ends are unmapped
+				auto base = reinterpret_cast<byte_t*>(::mmap(nullptr, size + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+				if(base == MAP_FAILED) [[unlikely]] throw std::bad_alloc();
+				size_t head = (hugePageSize - (reinterpret_cast<uintptr_t>(base) % hugePageSize)) % hugePageSize;
+				if(head > 0) ::munmap(base, head);
+				if(head < hugePageSize) ::munmap(base + head + size, hugePageSize - head);
+				(void) ::madvise(base + head, size, MADV_HUGEPAGE);
+				return base + head;
+			}
+
+			void* allocBlock(unsigned cls) {
+				void* r = isMapped(cls)?
+					mapBlock(blockSize(cls)) :
+					upstream->allocate(blockSize(cls), blockAlignment(cls));
+				blockCount.fetch_add(1, std::memory_order_relaxed);
+				return r;
+			}
+
+			void freeBlock(void* block, unsigned cls) {
+				if(isMapped(cls)) ::munmap(block, blockSize(cls));
+				else upstream->deallocate(block, blockSize(cls), blockAlignment(cls));
+				blockCount.fetch_sub(1, std::memory_order_relaxed);
+			}
+		};
+
+	}
+
+
+	namespace {
+
+		using _buffer_pool_impl::PoolState;
+
+
+		/** The free lists of a thread for a single pool, which keep the pool's
+		 * state alive until the thread exits or notices that the pool is gone. */
+		struct ThreadCache {
+			std::shared_ptr<PoolState> pool;
+			std::vector<std::vector<void*>> lists;
+
+			ThreadCache(std::shared_ptr<PoolState> pool):
+					pool(std::move(pool)),
+					lists(this->pool->classCount)
+			{
+				for(auto& list : lists) list.reserve(this->pool->opts.threadCacheSize);
+			}
+
+			~ThreadCache() {
+				auto lock = std::unique_lock(pool->mtx);
+				for(unsigned cls = 0; cls < pool->classCount; ++ cls) {
+					pool->shared[cls].insert(pool->shared[cls].end(), lists[cls].begin(), lists[cls].end());
+				}
+			}
+		};
+
+
+		thread_local std::vector<std::unique_ptr<ThreadCache>> threadCaches;
+
+
+		ThreadCache& threadCache(const std::shared_ptr<PoolState>& pool) {
+			auto& caches = threadCaches;
+			size_t i = 0;
+			while(i < caches.size()) {
+				if(caches[i]->pool == pool) [[likely]] return *caches[i];
+				if(! caches[i]->pool->alive.load(std::memory_order_relaxed)) {
+					caches[i] = std::move(caches.back());
+					caches.pop_back();
+				} else {
+					++ i;
+				}
+			}
+			return *caches.emplace_back(std::make_unique<ThreadCache>(pool));
+		}
+
+
+		void dropThreadCache(const std::shared_ptr<PoolState>& pool) {
+			auto& caches = threadCaches;
+			for(auto& cache : caches) {
+				if(cache->pool == pool) {
+					cache = std::move(caches.back());
+					caches.pop_back();
+					return;
+				}
+			}
+		}
+
+	}
+
+
+	BufferPool::BufferPool(BufferPoolOptions opts, std::pmr::memory_resource* upstream):
+			state_(std::make_shared<PoolState>(opts, upstream))
+	{ }
+
+
+	BufferPool::~BufferPool() {
+		state_->alive.store(false, std::memory_order_relaxed);
+		trim();
+	}
+
+
+	void* BufferPool::do_allocate(size_t bytes, size_t alignment) {
+		unsigned cls = state_->classOf(bytes, alignment);
+		if(cls >= state_->classCount) [[unlikely]] return state_->upstream->allocate(bytes, alignment);
+		auto& list = threadCache(state_).lists[cls];
+		if(list.empty()) {
+			// Take up to half a thread cache from the shared blocks
+			auto lock = std::unique_lock(state_->mtx);
+			auto& shared = state_->shared[cls];
+			size_t n = std::min(shared.size(), std::max<size_t>(state_->opts.threadCacheSize / 2, 1));
+			if(n == 0) {
+				lock.unlock();
+				return state_->allocBlock(cls);
+			}
+			list.insert(list.end(), shared.end() - n, shared.end());
+			shared.resize(shared.size() - n);
+		}
+		void* r = list.back();
+		list.pop_back();
+		return r;
+	}
+
+
+	void BufferPool::do_deallocate(void* p, size_t bytes, size_t alignment) {
+		unsigned cls = state_->classOf(bytes, alignment);
+		if(cls >= state_->classCount) [[unlikely]] return state_->upstream->deallocate(p, bytes, alignment);
+		auto& list = threadCache(state_).lists[cls];
+		if(list.size() >= state_->opts.threadCacheSize) [[unlikely]] {
+			// Keep half of the cache, so that alternating allocations and
+			// deallocations don't lock every time
+			size_t keep = state_->opts.threadCacheSize / 2;
+			auto lock = std::unique_lock(state_->mtx);
+			auto& shared = state_->shared[cls];
+			shared.insert(shared.end(), list.begin() + keep, list.end());
+			shared.push_back(p);
+			list.resize(keep);
+			return;
+		}
+		list.push_back(p);
+	}
+
+
+	bool BufferPool::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+		return this == &other;
+	}
+
+
+	void BufferPool::trim() {
+		dropThreadCache(state_);
+		auto lock = std::unique_lock(state_->mtx);
+		for(unsigned cls = 0; cls < state_->classCount; ++ cls) {
+			for(void* block : state_->shared[cls]) state_->freeBlock(block, cls);
+			state_->shared[cls].clear();
+		}
+	}
+
+
+	size_t BufferPool::blockCount() const {
+		return state_->blockCount.load(std::memory_order_relaxed);
+	}
+
+
+
+	ssize_t OutputBuffer::flush(const void* buf, size_t count) {
+		assert(end_ >= begin_);
+		auto bytes = reinterpret_cast<const byte_t*>(buf);
+		size_t written = 0;  // Bytes of `buf` that have been written
+		// `begin_` follows every write, so that the bytes of the window
+		// that haven't been written stay buffered if an error occurs
+		while(end_ > begin_) {
+			struct iovec iov[2] = {
+				{ buffer_ + begin_, end_ - begin_ },
+				{ const_cast<byte_t*>(bytes), count } };
+			ssize_t wr = file_.writev(iov, 2);
+			if(wr < 0) [[unlikely]] return wr;
+			if(hints_.pattern == AccessPattern::eOnce) [[unlikely]] _buffer_op_impl::hintTransferred(file_, &hints_, wr, true);
+			size_t fromWindow = std::min(size_t(wr), end_ - begin_);
+			begin_ += fromWindow;
+			written = size_t(wr) - fromWindow;
+		}
+		begin_ = 0;
+		end_ = 0;
+		if(written < count) {
+			ssize_t wr = posixfio::writeAll(file_, bytes + written, count - written);
+			if(wr < 0) [[unlikely]] return wr;
+			if(hints_.pattern == AccessPattern::eOnce) [[unlikely]] _buffer_op_impl::hintTransferred(file_, &hints_, wr, true);
+		}
+		return count;
+	}
+
+}
@@ -0,0 +1,278 @@
+#include "../../include/unix/posixfio_uring.hpp"
+
+#include <cerrno>
+#include <cassert>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+
+
+namespace posixfio {
+
+	namespace {
+
+		// `read`/`write` never transfer more than this many bytes at once on Linux,
+		// and io_uring only has 32 bits for the length anyway
+		constexpr size_t maxRwCount = 0x7ffff000;
+
+
+		int sysIoUringSetup(unsigned entries, io_uring_params* params) {
+			return int(::syscall(__NR_io_uring_setup, entries, params));
+		}
+
+		int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+			return int(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+		}
+
+		int sysIoUringRegister(int fd, unsigned opcode, const void* arg, unsigned nrArgs) {
+			return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+		}
+
+
+		template<typename T>
+		T* ringPtr(MemMapping& map, unsigned offset) {
+			return reinterpret_cast<T*>(map.get<unsigned char>() + offset);
+		}
+
+	}
+
+
+	#ifdef POSIXFIO_NOTHROW
+		#define POSIXFIO_THROWERRNO(FD_, DO_) DO_;
+		namespace no_throw {
+	#else
+		#define POSIXFIO_THROWERRNO(FD_, DO_) throw FileError(FD_, errno)
+	#endif
+
+
+	Ring Ring::create(unsigned entries, unsigned flags) {
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		params.flags = flags;
+		Ring r;
+		r.fd_ = File(sysIoUringSetup(entries, &params));
+		if(! r.fd_) POSIXFIO_THROWERRNO(File::NULL_FD, return Ring());
+
+		constexpr auto prot = MemProtFlags(int(MemProtFlags::eRead) | int(MemProtFlags::eWrite));
+		constexpr auto mapFlags = MemMapFlags(int(MemMapFlags::eShared) | MAP_POPULATE);
+		size_t sqRingSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+		size_t cqRingSize = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+		bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if(singleMmap) sqRingSize = std::max(sqRingSize, cqRingSize);
+
+		r.sqRingMap_ = r.fd_.mmap(sqRingSize, prot, mapFlags, IORING_OFF_SQ_RING);
+		if(! r.sqRingMap_) [[unlikely]] return Ring();
+		if(! singleMmap) {
+			r.cqRingMap_ = r.fd_.mmap(cqRingSize, prot, mapFlags, IORING_OFF_CQ_RING);
+			if(! r.cqRingMap_) [[unlikely]] return Ring();
+		}
+		r.sqesMap_ = r.fd_.mmap(params.sq_entries * sizeof(io_uring_sqe), prot, mapFlags, IORING_OFF_SQES);
+		if(! r.sqesMap_) [[unlikely]] return Ring();
+
+		auto& sqMap = r.sqRingMap_;
+		auto& cqMap = singleMmap? r.sqRingMap_ : r.cqRingMap_;
+		r.sqHead_     = ringPtr<unsigned>(sqMap, params.sq_off.head);
+		r.sqTail_     = ringPtr<unsigned>(sqMap, params.sq_off.tail);
+		r.sqArray_    = ringPtr<unsigned>(sqMap, params.sq_off.array);
+		r.sqMask_     = *ringPtr<unsigned>(sqMap, params.sq_off.ring_mask);
+		r.sqEntries_  = *ringPtr<unsigned>(sqMap, params.sq_off.ring_entries);
+		r.sqes_       = r.sqesMap_.get<io_uring_sqe>();
+		r.cqHead_     = ringPtr<unsigned>(cqMap, params.cq_off.head);
+		r.cqTail_     = ringPtr<unsigned>(cqMap, params.cq_off.tail);
+		r.cqes_       = ringPtr<io_uring_cqe>(cqMap, params.cq_off.cqes);
+		r.cqMask_     = *ringPtr<unsigned>(cqMap, params.cq_off.ring_mask);
+		r.sqLocalTail_ = *r.sqTail_;
+		r.sqSubmitted_ = r.sqLocalTail_;
+		return r;
+	}
+
+
+	Ring::Ring() noexcept:
+			sqHead_(nullptr),
+			sqTail_(nullptr),
+			sqArray_(nullptr),
+			sqes_(nullptr),
+			cqHead_(nullptr),
+			cqTail_(nullptr),
+			cqes_(nullptr),
+			sqMask_(0),
+			sqEntries_(0),
+			cqMask_(0),
+			sqLocalTail_(0),
+			sqSubmitted_(0)
+	{ }
+
+
+	unsigned Ring::sqSpace() const {
+		assert(fd_);
+		unsigned head = std::atomic_ref<unsigned>(*sqHead_).load(std::memory_order_acquire);
+		return sqEntries_ - (sqLocalTail_ - head);
+	}
+
+
+	io_uring_sqe* Ring::nextSqe() {
+		if(sqSpace() == 0) [[unlikely]] return nullptr;
+		unsigned index = sqLocalTail_ & sqMask_;
+		io_uring_sqe* sqe = sqes_ + index;
+		memset(sqe, 0, sizeof(*sqe));
+		sqArray_[index] = index;
+		++ sqLocalTail_;
+		return sqe;
+	}
+
+
+	int Ring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+		int r;
+		do {
+			r = sysIoUringEnter(fd_, toSubmit, minComplete, flags);
+		} while(r < 0 && errno == EINTR);
+		return r;
+	}
+
+
+	#define PREP_RW_(OPCODE_, FILE_, BUF_, COUNT_, OFFSET_, USER_DATA_) \
+		io_uring_sqe* sqe = nextSqe(); \
+		if(sqe == nullptr) [[unlikely]] return false; \
+		sqe->opcode = OPCODE_; \
+		sqe->fd = (FILE_).fd_; \
+		if((FILE_).registered_) sqe->flags |= IOSQE_FIXED_FILE; \
+		sqe->addr = reinterpret_cast<std::uint64_t>(BUF_); \
+		sqe->len = std::uint32_t(std::min(COUNT_, maxRwCount)); \
+		sqe->off = std::uint64_t(OFFSET_); \
+		sqe->user_data = USER_DATA_;
+
+	bool Ring::prepRead(RingFile file, void* buf, size_t count, off_t offset, std::uint64_t userData) {
+		PREP_RW_(IORING_OP_READ, file, buf, count, offset, userData)
+		return true;
+	}
+
+	bool Ring::prepWrite(RingFile file, const void* buf, size_t count, off_t offset, std::uint64_t userData) {
+		PREP_RW_(IORING_OP_WRITE, file, buf, count, offset, userData)
+		return true;
+	}
+
+	bool Ring::prepReadFixed(RingFile file, void* buf, size_t count, off_t offset, unsigned bufIndex, std::uint64_t userData) {
+		PREP_RW_(IORING_OP_READ_FIXED, file, buf, count, offset, userData)
+		sqe->buf_index = bufIndex;
+		return true;
+	}
+
+	bool Ring::prepWriteFixed(RingFile file, const void* buf, size_t count, off_t offset, unsigned bufIndex, std::uint64_t userData) {
+		PREP_RW_(IORING_OP_WRITE_FIXED, file, buf, count, offset, userData)
+		sqe->buf_index = bufIndex;
+		return true;
+	}
+
+	#undef PREP_RW_
+
+
+	bool Ring::prepFsync(RingFile file, RingFsyncFlags flags, std::uint64_t userData) {
+		io_uring_sqe* sqe = nextSqe();
+		if(sqe == nullptr) [[unlikely]] return false;
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = file.fd_;
+		if(file.registered_) sqe->flags |= IOSQE_FIXED_FILE;
+		sqe->fsync_flags = unsigned(flags);
+		sqe->user_data = userData;
+		return true;
+	}
+
+
+	bool Ring::prepOpenat(fd_t dirfd, const char* pathname, int flags, posixfio::mode_t mode, std::uint64_t userData) {
+		io_uring_sqe* sqe = nextSqe();
+		if(sqe == nullptr) [[unlikely]] return false;
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = dirfd;
+		sqe->addr = reinterpret_cast<std::uint64_t>(pathname);
+		sqe->len = mode;
+		sqe->open_flags = std::uint32_t(flags);
+		sqe->user_data = userData;
+		return true;
+	}
+
+
+	bool Ring::prepClose(fd_t fd, std::uint64_t userData) {
+		io_uring_sqe* sqe = nextSqe();
+		if(sqe == nullptr) [[unlikely]] return false;
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = fd;
+		sqe->user_data = userData;
+		return true;
+	}
+
+
+	posixfio::ssize_t Ring::submit(unsigned waitNr) {
+		assert(fd_);
+		unsigned toSubmit = sqLocalTail_ - sqSubmitted_;
+		std::atomic_ref<unsigned>(*sqTail_).store(sqLocalTail_, std::memory_order_release);
+		if(toSubmit == 0 && waitNr == 0) return 0;
+		int r = enter(toSubmit, waitNr, (waitNr > 0)? IORING_ENTER_GETEVENTS : 0);
+		if(r < 0) [[unlikely]] POSIXFIO_THROWERRNO(fd_, return r);
+		sqSubmitted_ += unsigned(r);
+		return r;
+	}
+
+
+	unsigned Ring::peekCompletions(RingCompletion* dst, unsigned maxNr) {
+		assert(fd_);
+		unsigned head = *cqHead_;
+		unsigned tail = std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+		unsigned count = std::min(tail - head, maxNr);
+		for(unsigned i = 0; i < count; ++i) {
+			const io_uring_cqe& cqe = cqes_[(head + i) & cqMask_];
+			dst[i] = { cqe.user_data, cqe.res, cqe.flags };
+		}
+		std::atomic_ref<unsigned>(*cqHead_).store(head + count, std::memory_order_release);
+		return count;
+	}
+
+
+	posixfio::ssize_t Ring::waitCompletions(RingCompletion* dst, unsigned maxNr, unsigned minNr) {
+		assert(minNr <= maxNr);
+		unsigned count = peekCompletions(dst, maxNr);
+		while(count < minNr) {
+			int r = enter(0, minNr - count, IORING_ENTER_GETEVENTS);
+			if(r < 0) [[unlikely]] POSIXFIO_THROWERRNO(fd_, return r);
+			count += peekCompletions(dst + count, maxNr - count);
+		}
+		return count;
+	}
+
+
+	bool Ring::registerBuffers(const struct iovec* buffers, unsigned count) {
+		int r = sysIoUringRegister(fd_, IORING_REGISTER_BUFFERS, buffers, count);
+		if(r < 0) POSIXFIO_THROWERRNO(fd_, return false);
+		return true;
+	}
+
+
+	bool Ring::unregisterBuffers() {
+		int r = sysIoUringRegister(fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+		if(r < 0) POSIXFIO_THROWERRNO(fd_, return false);
+		return true;
+	}
+
+
+	bool Ring::registerFiles(const fd_t* fds, unsigned count) {
+		int r = sysIoUringRegister(fd_, IORING_REGISTER_FILES, fds, count);
+		if(r < 0) POSIXFIO_THROWERRNO(fd_, return false);
+		return true;
+	}
+
+
+	bool Ring::unregisterFiles() {
+		int r = sysIoUringRegister(fd_, IORING_UNREGISTER_FILES, nullptr, 0);
+		if(r < 0) POSIXFIO_THROWERRNO(fd_, return false);
+		return true;
+	}
+
+
+	#ifdef POSIXFIO_NOTHROW
+		}
+	#endif
+
+}
@@ -0,0 +1,232 @@
+#include "test_tools.hpp"
+
+#include "../include/unix/posixfio_async.hpp"
+
+#include <iostream>
+#include <string>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cassert>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	constexpr auto eFailure = utest::ResultType::eFailure;
+	constexpr auto eSuccess = utest::ResultType::eSuccess;
+
+	const std::string tmpFile = "tmpfile";
+
+	// Larger than the default pipe capacity, so that both ends have to wait
+	constexpr size_t payloadSize = 256 * 1024;
+
+	std::string ioPayload;
+
+
+	std::string mkPayload() {
+		static size_t state = 7;
+		std::string r;  r.reserve(payloadSize);
+		auto rng = std::minstd_rand(state = (payloadSize ^ state));
+		for(size_t i=0; i < payloadSize; ++i) {
+			r.push_back(char(rng()));
+		}
+		return r;
+	}
+
+
+	Pipe mkNonblockingPipe() {
+		Pipe r = Pipe::create();
+		::fcntl(r.rd, F_SETFL, ::fcntl(r.rd, F_GETFL) | O_NONBLOCK);
+		::fcntl(r.wr, F_SETFL, ::fcntl(r.wr, F_GETFL) | O_NONBLOCK);
+		return r;
+	}
+
+
+	bool checkPayload(std::ostream& out, ssize_t count, const std::string& got) {
+		if(count != ssize_t(ioPayload.size())) {
+			out << "Transferred " << count << '/' << ioPayload.size() << " bytes" << std::endl;
+			return false;
+		}
+		if(got != ioPayload) {
+			out << "Received data != IO payload" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+
+	AsyncTask<ssize_t> writeBuffered(Reactor& r, FileView file, size_t capacity = 1000) {
+		OutputBuffer out = OutputBuffer(file, capacity);
+		size_t cursor = 0;
+		size_t chunk = 1;
+		while(cursor < ioPayload.size()) {
+			size_t n = std::min(chunk, ioPayload.size() - cursor);
+			ssize_t wr = co_await asyncWriteAll(r, out, ioPayload.data() + cursor, n);
+			if(wr != ssize_t(n)) co_return -1;
+			cursor += n;
+			chunk = (chunk * 7) % 3001;
+		}
+		if(0 > co_await asyncFlush(r, out)) co_return -1;
+		co_return cursor;
+	}
+
+
+	AsyncTask<ssize_t> readBuffered(Reactor& r, FileView file, std::string& dst) {
+		InputBuffer in = InputBuffer(file, 1500);
+		size_t cursor = 0;
+		size_t chunk = 3;
+		while(cursor < dst.size()) {
+			size_t n = std::min(chunk, dst.size() - cursor);
+			ssize_t rd = co_await asyncReadAll(r, in, dst.data() + cursor, n);
+			if(rd != ssize_t(n)) co_return -1;
+			cursor += n;
+			chunk = (chunk * 5) % 2999;
+		}
+		co_return cursor;
+	}
+
+
+	utest::ResultType epoll_pipe(std::ostream& out) {
+		try {
+			EpollReactor reactor;
+			Pipe pipe = mkNonblockingPipe();
+			std::string buf;  buf.resize(ioPayload.size());
+			auto writer = asyncWriteAll(reactor, pipe.wr, ioPayload.data(), ioPayload.size());
+			writer.start();
+			auto rd = runUntilDone(reactor, asyncReadAll(reactor, pipe.rd, buf.data(), buf.size()));
+			while(! writer.done()) reactor.runOnce();
+			if(writer.result() != ssize_t(ioPayload.size())) {
+				out << "Writer returned " << writer.result() << std::endl;
+				return eFailure;
+			}
+			if(! checkPayload(out, rd, buf)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	/** With `pipeCapacity > 0`, the pipe is shrunk to fit less than the
+	 * output buffer, so that flushing it has to wait for the reader. */
+	template<size_t pipeCapacity, size_t bufferCapacity>
+	utest::ResultType epoll_pipe_buffered(std::ostream& out) {
+		try {
+			EpollReactor reactor;
+			Pipe pipe = mkNonblockingPipe();
+			if constexpr(pipeCapacity > 0) pipe.setCapacity(pipeCapacity);
+			std::string buf;  buf.resize(ioPayload.size());
+			auto writer = writeBuffered(reactor, pipe.wr, bufferCapacity);
+			writer.start();
+			auto rd = runUntilDone(reactor, readBuffered(reactor, pipe.rd, buf));
+			while(! writer.done()) reactor.runOnce();
+			if(writer.result() != ssize_t(ioPayload.size())) {
+				out << "Writer returned " << writer.result() << std::endl;
+				return eFailure;
+			}
+			if(! checkPayload(out, rd, buf)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType thread_pool_file(std::ostream& out) {
+		try {
+			ThreadPoolReactor reactor = ThreadPoolReactor(2);
+			std::string buf;  buf.resize(ioPayload.size());
+			{
+				File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+				auto wr = syncWait(writeBuffered(reactor, f));
+				if(wr != ssize_t(ioPayload.size())) {
+					out << "Wrote " << wr << '/' << ioPayload.size() << " bytes" << std::endl;
+					return eFailure;
+				}
+			}
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto rd = syncWait(asyncReadAll(reactor, f, buf.data(), buf.size()));
+			if(! checkPayload(out, rd, buf)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType default_reactor(std::ostream& out) {
+		try {
+			DefaultReactor reactor = DefaultReactor(2);
+			std::thread epollThread = std::thread([&]() { reactor.epoll().run(); });
+			Pipe pipe = mkNonblockingPipe();
+			std::string buf;  buf.resize(ioPayload.size());
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto writer = asyncWriteAll(reactor, pipe.wr, ioPayload.data(), ioPayload.size());
+			auto reader = readBuffered(reactor, pipe.rd, buf);
+			std::thread writerThread = std::thread([&]() { syncWait(std::move(writer)); });
+			auto rd = syncWait(std::move(reader));
+			writerThread.join();
+			std::string fileBuf;  fileBuf.resize(ioPayload.size());
+			auto fileRd = syncWait(asyncReadAll(reactor, f, fileBuf.data(), fileBuf.size()));
+			reactor.epoll().stop();
+			epollThread.join();
+			if(! checkPayload(out, rd, buf)) return eFailure;
+			if(! checkPayload(out, fileRd, fileBuf)) return eFailure;
+
+			// The stop request must have been consumed, or `runOnce` would never block again
+			reactor.epoll().runOnce(0);
+			auto start = std::chrono::steady_clock::now();
+			reactor.epoll().runOnce(20);
+			if(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {
+				out << "runOnce returned early after stop" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType fileerror_ebadf(std::ostream& out) {
+		int got = 0;
+		try {
+			ThreadPoolReactor reactor = ThreadPoolReactor(1);
+			File f = File::open(tmpFile.c_str(), O_WRONLY);
+			char c;
+			auto rd = syncWait(asyncReadAll(reactor, f, &c, 1));
+			if(rd < 0) got = errno;
+		} catch(FileError& err) {
+			got = err.errcode;
+		}
+		if(got != EBADF) {
+			out << "Expected errno EBADF, got " << got << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+}
+
+
+
+int main(int, char**) {
+	auto batch = utest::TestBatch(std::cout);
+	ioPayload = mkPayload();
+	batch
+		.run("Epoll reactor, pipe", epoll_pipe)
+		.run("Epoll reactor, buffered pipe", epoll_pipe_buffered<0, 1000>)
+		.run("Epoll reactor, buffered pipe (4 KiB pipe)", epoll_pipe_buffered<4096, 60000>)
+		.run("Thread pool reactor, buffered file", thread_pool_file)
+		.run("Default reactor, pipe and file", default_reactor)
+		.run("Read write-only file (EBADF)", fileerror_ebadf);
+	return batch.failures() == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}
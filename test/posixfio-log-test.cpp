@@ -0,0 +1,212 @@
+#include "test_tools.hpp"
+
+#include "../include/unix/posixfio_log.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <cassert>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	constexpr auto eFailure = utest::ResultType::eFailure;
+	constexpr auto eSuccess = utest::ResultType::eSuccess;
+
+	const std::string tmpFile = "tmpfile";
+
+	// Small enough for the log to be grown and remapped many times
+	constexpr size_t extentSize = 64 * 1024;
+	constexpr size_t recordCount = 5000;
+
+	std::vector<std::string> records;
+
+
+	std::vector<std::string> mkRecords() {
+		std::vector<std::string> r;  r.reserve(recordCount);
+		auto rng = std::minstd_rand(recordCount);
+		for(size_t i = 0; i < recordCount; ++i) {
+			std::string rec;
+			size_t size = 1 + (rng() % 300);
+			rec.reserve(size);
+			for(size_t j = 0; j < size; ++j) rec.push_back(char(rng()));
+			r.push_back(std::move(rec));
+		}
+		return r;
+	}
+
+
+	/** Appends every record, alternating between `append` and
+	 * oversized reservations, syncing every few records. */
+	bool appendRecords(MappedAppendLog& log, LogSyncMode syncMode) {
+		for(size_t i = 0; i < records.size(); ++i) {
+			auto& rec = records[i];
+			if(i % 2 == 0) {
+				if(! log.append(rec.data(), rec.size())) return false;
+			} else {
+				void* dst = log.reserve(rec.size() + 100);
+				if(dst == nullptr) return false;
+				memcpy(dst, rec.data(), rec.size());
+				log.commit(rec.size());
+			}
+			if(i % 100 == 99 && ! log.sync(syncMode)) return false;
+		}
+		return log.sync(syncMode);
+	}
+
+
+	bool checkRecords(std::ostream& out, const MappedAppendLog& log, size_t expectedCount) {
+		if(log.recordCount() != expectedCount) {
+			out << "Expected " << expectedCount << " records, found " << log.recordCount() << std::endl;
+			return false;
+		}
+		size_t i = 0;
+		bool match = true;
+		log.forEach([&](const void* data, size_t size) {
+			match = match && (i < records.size()) && (std::string_view(reinterpret_cast<const char*>(data), size) == records[i]);
+			++ i;
+		});
+		if(i != expectedCount || ! match) {
+			out << "Record content mismatch" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+
+	template<LogSyncMode syncMode>
+	utest::ResultType append_reopen(std::ostream& out) {
+		try {
+			::unlink(tmpFile.c_str());
+			{
+				auto log = MappedAppendLog::open(tmpFile.c_str(), extentSize);
+				if(! appendRecords(log, syncMode)) {
+					out << "Failed to append records" << std::endl;
+					return eFailure;
+				}
+				if(! checkRecords(out, log, recordCount)) return eFailure;
+			}
+			auto log = MappedAppendLog::open(tmpFile.c_str(), extentSize);
+			if(log.recovery().truncatedSize != 0) {
+				out << "Cleanly closed log was truncated by " << log.recovery().truncatedSize << " bytes" << std::endl;
+				return eFailure;
+			}
+			if(! checkRecords(out, log, recordCount)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		} catch(Errcode& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType torn_tail(std::ostream& out) {
+		try {
+			::unlink(tmpFile.c_str());
+			// The child process "crashes" while the last record is being
+			// overwritten, without closing (nor truncating) the log
+			pid_t child = ::fork();
+			if(child == 0) {
+				auto log = MappedAppendLog::open(tmpFile.c_str(), extentSize);
+				if(! appendRecords(log, LogSyncMode::eRange)) ::_exit(EXIT_FAILURE);
+				auto torn = reinterpret_cast<char*>(log.reserve(100));
+				memset(torn, 'x', 100);
+				log.commit();
+				torn[50] = 'y';
+				::_exit(EXIT_SUCCESS);
+			}
+			int status;
+			::waitpid(child, &status, 0);
+			if(! WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+				out << "Child process failed" << std::endl;
+				return eFailure;
+			}
+			auto log = MappedAppendLog::open(tmpFile.c_str(), extentSize);
+			if(log.recovery().records != recordCount || log.recovery().truncatedSize <= 0) {
+				out << "Recovered " << log.recovery().records << " records, truncated " << log.recovery().truncatedSize << " bytes" << std::endl;
+				return eFailure;
+			}
+			if(! checkRecords(out, log, recordCount)) return eFailure;
+			// The log must remain usable after a recovery
+			if(! log.append("tail", 4)) return eFailure;
+			if(log.recordCount() != recordCount + 1) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		} catch(Errcode& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	/** A shrunk reservation leaves stale data behind the committed record, which
+	 * is overwritten by the next one; the stale data contains a valid record,
+	 * right where the end-of-log header of the next record goes. */
+	utest::ResultType stale_reservation(std::ostream& out) {
+		using _log_impl::RecordHeader;
+		try {
+			::unlink(tmpFile.c_str());
+			pid_t child = ::fork();
+			if(child == 0) {
+				auto log = MappedAppendLog::open(tmpFile.c_str(), extentSize);
+				auto stale = reinterpret_cast<char*>(log.reserve(200));
+				memset(stale, 'x', 200);
+				// First record: header + 56 bytes, second record: header + 56 bytes
+				size_t ghostOffset = 2 * (sizeof(RecordHeader) + _log_impl::alignRecord(50)) - sizeof(RecordHeader);
+				RecordHeader ghost = { 5, _log_impl::checksum("ghost", 5) };
+				memcpy(stale + ghostOffset, &ghost, sizeof(ghost));
+				memcpy(stale + ghostOffset + sizeof(ghost), "ghost", 5);
+				log.commit(50);
+				if(! log.append(stale, 50)) ::_exit(EXIT_FAILURE);
+				if(! log.sync()) ::_exit(EXIT_FAILURE);
+				::_exit(EXIT_SUCCESS);
+			}
+			int status;
+			::waitpid(child, &status, 0);
+			if(! WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+				out << "Child process failed" << std::endl;
+				return eFailure;
+			}
+			auto log = MappedAppendLog::open(tmpFile.c_str(), extentSize);
+			if(log.recordCount() != 2) {
+				out << "Recovered " << log.recordCount() << " records instead of 2" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		} catch(Errcode& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+}
+
+
+
+int main(int, char**) {
+	auto batch = utest::TestBatch(std::cout);
+	records = mkRecords();
+	batch
+		.run("Append and reopen (msync)", append_reopen<LogSyncMode::eRange>)
+		.run("Append and reopen (fdatasync)", append_reopen<LogSyncMode::eFdatasync>)
+		.run("Recover torn tail", torn_tail)
+		.run("Stale reservation after a shorter commit", stale_reservation);
+	::unlink(tmpFile.c_str());
+	return batch.failures() == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -138,6 +138,80 @@ namespace {
 		return eSuccess;
 	};
 
+
+	#ifdef POSIXFIO_UNIX
+		utest::ResultType advise_file(std::ostream& out) {
+			try {
+				File f = File::open(tmpFile.c_str(), O_RDONLY);
+				auto flags = MemMapFlags(int(MemMapFlags::eShared) | int(MemMapFlags::ePopulate));
+				MemMapping map = f.mmap(ioPayload.size(), MemProtFlags::eRead, flags, 0);
+				map.madvise(MemAdvice::eWillNeed);
+				map.madvise(100, ioPayload.size() - 200, MemAdvice::eSequential); // Not page-aligned
+				map.madvise(MemAdvice::eCold);
+				if(0 != memcmp(map.get(), ioPayload.data(), ioPayload.size())) {
+					out << "File != IO payload\n";
+					return eFailure;
+				}
+				try {
+					map.madvise(MemAdvice::ePopulateRead);
+				} catch(Errcode& err) {
+					// Linux < 5.14
+					if(err.errcode != EINVAL) throw;
+					out << "MADV_POPULATE_READ is not supported\n";
+					return eNeutral;
+				}
+			} catch(Errcode& err) {
+				out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+				return eFailure;
+			}
+			return eSuccess;
+		}
+
+
+		utest::ResultType remap_file(std::ostream& out) {
+			try {
+				size_t half = ioPayload.size() / 2;
+				File f = File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+				f.ftruncate(half);
+				MemMapping map = f.mmap(half, MemProtFlags(PROT_READ | PROT_WRITE), MemMapFlags::eShared, 0);
+				memcpy(map.get(), ioPayload.data(), half);
+				f.ftruncate(ioPayload.size());
+				map.remap(ioPayload.size());
+				if(map.size() != ioPayload.size()) {
+					out << "Mapping size mismatch after `remap`\n";
+					return eFailure;
+				}
+				memcpy(map.get<char>() + half, ioPayload.data() + half, ioPayload.size() - half);
+				map.msync(half, ioPayload.size() - half); // Not page-aligned, unless `half` is
+				IO_PAYLOAD_BUFFER_(buf)
+				if(ssize_t(buf.size()) != f.pread(buf.data(), buf.size(), 0) || buf != ioPayload) {
+					out << "File != IO payload\n";
+					return eFailure;
+				}
+			} catch(Errcode& err) {
+				out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+				return eFailure;
+			}
+			return eSuccess;
+		}
+
+
+		utest::ResultType lock_range(std::ostream& out) {
+			try {
+				File f = File::open(tmpFile.c_str(), O_RDONLY);
+				MemMapping map = f.mmap(ioPayload.size(), MemProtFlags::eRead, MemMapFlags::eShared, 0);
+				map.mlock(100, 3000);
+				map.munlock(100, 3000);
+			} catch(Errcode& err) {
+				out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+				// RLIMIT_MEMLOCK may be too low
+				if(err.errcode == EPERM || err.errcode == ENOMEM || err.errcode == EAGAIN) return eNeutral;
+				return eFailure;
+			}
+			return eSuccess;
+		}
+	#endif
+
 }
 
 
@@ -148,6 +222,12 @@ int main(int, char**) {
 	batch
 		.run("Write mapped file", write_file)
 		.run("Read mapped file", read_file);
+	#ifdef POSIXFIO_UNIX
+		batch
+			.run("Advise mapped file", advise_file)
+			.run("Lock mapped range", lock_range)
+			.run("Remap file", remap_file);
+	#endif
 	ioPayload = mkPayload();
 	return batch.failures() == 0? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,483 @@
+#include "test_tools.hpp"
+
+#include "../include/unix/posixfio_mt.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+#include <unistd.h>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	constexpr auto eFailure = utest::ResultType::eFailure;
+	constexpr auto eSuccess = utest::ResultType::eSuccess;
+
+	const std::string tmpFile = "tmpfile";
+
+	constexpr unsigned threadCount = 4;
+	constexpr std::uint32_t recordsPerThread = 500;
+
+
+	struct Record {
+		std::uint32_t thread;
+		std::uint32_t seq;
+		char padding[8];
+	};
+
+
+	std::string readFile(const char* pathname) {
+		std::string r;
+		File f = File::open(pathname, O_RDONLY);
+		char buf[4096];
+		ssize_t rd;
+		while((rd = f.read(buf, sizeof(buf))) > 0) r.append(buf, rd);
+		return r;
+	}
+
+
+	/** Checks that every thread's records are all present, and in order. */
+	bool checkRecords(std::ostream& out, const std::string& data, unsigned threads, std::uint32_t perThread) {
+		if(data.size() != threads * perThread * sizeof(Record)) {
+			out << "File size is " << data.size() << ", expected " << (threads * perThread * sizeof(Record)) << std::endl;
+			return false;
+		}
+		std::vector<std::uint32_t> next(threads, 0);
+		for(size_t i = 0; i < data.size(); i += sizeof(Record)) {
+			Record rec;
+			memcpy(&rec, data.data() + i, sizeof(rec));
+			if(rec.thread >= threads || rec.seq != next[rec.thread]) {
+				out << "Unexpected record " << rec.thread << ':' << rec.seq << " at offset " << i << std::endl;
+				return false;
+			}
+			++ next[rec.thread];
+		}
+		return true;
+	}
+
+
+	template<unsigned latencyUs>
+	utest::ResultType group_commit_threads(std::ostream& out) {
+		try {
+			File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			GroupCommitStats stats;
+			std::vector<unsigned> failures(threadCount, 0);
+			{
+				GroupCommitOptions opts;
+				opts.maxLatency = std::chrono::microseconds(latencyUs);
+				auto writer = GroupCommitWriter(f, opts);
+				std::vector<std::thread> threads;
+				for(unsigned t = 0; t < threadCount; ++t) {
+					threads.emplace_back([&, t]() {
+						for(std::uint32_t i = 0; i < recordsPerThread; ++i) {
+							Record rec = { t, i, "record" };
+							if(! writer.commit(&rec, sizeof(rec))) ++ failures[t];
+						}
+					});
+				}
+				for(auto& thread : threads) thread.join();
+				stats = writer.stats();
+			}
+			for(unsigned t = 0; t < threadCount; ++t) {
+				if(failures[t] != 0) {
+					out << "Thread " << t << " failed " << failures[t] << " commits" << std::endl;
+					return eFailure;
+				}
+			}
+			if(stats.commits != threadCount * recordsPerThread || stats.bytes != stats.commits * sizeof(Record)) {
+				out << "Stats report " << stats.commits << " commits, " << stats.bytes << " bytes" << std::endl;
+				return eFailure;
+			}
+			if(stats.syncs == 0 || stats.syncs > stats.commits) {
+				out << "Stats report " << stats.syncs << " syncs" << std::endl;
+				return eFailure;
+			}
+			if(! checkRecords(out, readFile(tmpFile.c_str()), threadCount, recordsPerThread)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType group_commit_backpressure(std::ostream& out) {
+		constexpr std::uint32_t count = 5000;
+		try {
+			File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			GroupCommitOptions opts;
+			opts.maxBytes = 4096;
+			auto writer = GroupCommitWriter(f, opts);
+			GroupCommitWriter::Ticket ticket = 0;
+			for(std::uint32_t i = 0; i < count; ++i) {
+				Record rec = { 0, i, "record" };
+				ticket = writer.append(&rec, sizeof(rec));
+			}
+			// Appending more than `maxBytes` without waiting must have synced some batches already
+			auto stats = writer.stats();
+			if(stats.syncs < (count * sizeof(Record)) / opts.maxBytes - 1) {
+				out << "Only " << stats.syncs << " batches were synced while appending" << std::endl;
+				return eFailure;
+			}
+			if(! writer.wait(ticket)) return eFailure;
+			if(! checkRecords(out, readFile(tmpFile.c_str()), 1, count)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	template<size_t segmentSize>
+	utest::ResultType concurrent_buffer_threads(std::ostream& out) {
+		constexpr std::uint32_t perThread = 20000;
+		try {
+			File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			{
+				// A small ring, so that producers have to wait for the flusher
+				auto buf = ConcurrentOutputBuffer(f, segmentSize, 4);
+				std::vector<std::thread> threads;
+				for(unsigned t = 0; t < threadCount; ++t) {
+					threads.emplace_back([&, t]() {
+						for(std::uint32_t i = 0; i < perThread; ++i) {
+							Record rec = { t, i, "record" };
+							buf.write(&rec, sizeof(rec));
+						}
+					});
+				}
+				for(auto& thread : threads) thread.join();
+			}
+			if(! checkRecords(out, readFile(tmpFile.c_str()), threadCount, perThread)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType concurrent_buffer_flush(std::ostream& out) {
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			auto buf = ConcurrentOutputBuffer(f, 4096, 4);
+			std::string expect;
+			for(std::uint32_t i = 0; i < 100; ++i) {
+				Record rec = { 0, i, "record" };
+				buf.write(&rec, sizeof(rec));
+				expect.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+				// Every few records, the partially filled segment must be written
+				if(i % 10 == 9) {
+					if(! buf.flush()) return eFailure;
+					auto got = readFile(tmpFile.c_str());
+					if(got != expect) {
+						out << "Flushed " << got.size() << '/' << expect.size() << " bytes" << std::endl;
+						return eFailure;
+					}
+				}
+			}
+			// Larger than the whole ring
+			std::string big(buf.capacity() * 3 + 123, 'x');
+			if(buf.write(big.data(), big.size()) != ssize_t(big.size())) return eFailure;
+			if(! buf.flush()) return eFailure;
+			if(readFile(tmpFile.c_str()) != expect + big) {
+				out << "Large write mismatch" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType async_buffer_file(std::ostream& out) {
+		constexpr std::uint32_t count = 50000;
+		try {
+			File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			auto buf = AsyncOutputBuffer(f, 1000, 3);
+			for(std::uint32_t i = 0; i < count; ++i) {
+				Record rec = { 0, i, "record" };
+				if(buf.write(&rec, sizeof(rec)) != sizeof(rec)) return eFailure;
+			}
+			auto flushed = buf.flush().get();
+			if(flushed != ssize_t(count * sizeof(Record))) {
+				out << "Flushed " << flushed << '/' << (count * sizeof(Record)) << " bytes" << std::endl;
+				return eFailure;
+			}
+			if(! checkRecords(out, readFile(tmpFile.c_str()), 1, count)) return eFailure;
+			// Nothing left to write
+			if(buf.flush().get() != flushed) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	/** Writes to a pipe that nobody reads from, until the writer thread
+	 * is stuck, so that the backpressure policy kicks in; then reads
+	 * the pipe, and checks that the accepted records are intact. */
+	template<BackpressurePolicy policy>
+	utest::ResultType async_buffer_backpressure(std::ostream& out) {
+		constexpr std::uint32_t count = 20000;
+		constexpr size_t capacity = 4096;
+		try {
+			Pipe pipe = Pipe::create();
+			std::string received;
+			std::thread reader;
+			std::vector<std::uint32_t> accepted;
+			size_t dropped, bufferCount;
+			bool unexpectedResult = false;
+			{
+				auto buf = AsyncOutputBuffer(pipe.wr, capacity, 2, policy);
+				auto startReader = [&]() {
+					reader = std::thread([&]() {
+						char rdBuf[4096];
+						ssize_t rd;
+						while((rd = pipe.rd.read(rdBuf, sizeof(rdBuf))) > 0) received.append(rdBuf, rd);
+					});
+				};
+				if constexpr(policy == BackpressurePolicy::eBlock) startReader();
+				for(std::uint32_t i = 0; i < count; ++i) {
+					Record rec = { 0, i, "record" };
+					ssize_t wr = buf.write(&rec, sizeof(rec));
+					if(wr == sizeof(rec)) accepted.push_back(i);
+					else if(wr != 0 || policy != BackpressurePolicy::eDrop) unexpectedResult = true;
+				}
+				if constexpr(policy != BackpressurePolicy::eBlock) startReader();
+				buf.flush().get();
+				dropped = buf.dropped();
+				bufferCount = buf.bufferCount();
+			}
+			pipe.wr.close();
+			reader.join();
+
+			if(unexpectedResult) {
+				out << "Unexpected write result" << std::endl;
+				return eFailure;
+			}
+			if(policy == BackpressurePolicy::eDrop && (dropped == 0 || dropped != (count - accepted.size()) * sizeof(Record))) {
+				out << "Dropped " << dropped << " bytes, " << (count - accepted.size()) << " records" << std::endl;
+				return eFailure;
+			}
+			if(policy == BackpressurePolicy::eGrow && bufferCount <= 2) {
+				out << "The buffer did not grow" << std::endl;
+				return eFailure;
+			}
+			if(policy != BackpressurePolicy::eDrop && accepted.size() != count) return eFailure;
+			if(received.size() != accepted.size() * sizeof(Record)) {
+				out << "Received " << received.size() << " bytes, expected " << (accepted.size() * sizeof(Record)) << std::endl;
+				return eFailure;
+			}
+			for(size_t i = 0; i < accepted.size(); ++i) {
+				Record rec;
+				memcpy(&rec, received.data() + (i * sizeof(Record)), sizeof(rec));
+				if(rec.seq != accepted[i]) {
+					out << "Record #" << i << " is " << rec.seq << ", expected " << accepted[i] << std::endl;
+					return eFailure;
+				}
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType async_buffer_ebadf(std::ostream& out) {
+		File f = File::open(tmpFile.c_str(), O_RDONLY | O_CREAT, 0600);
+		auto buf = AsyncOutputBuffer(f, 64);
+		buf.write("xxxx", 4);
+		try {
+			buf.flush().get();
+			out << "Flush did not fail" << std::endl;
+			return eFailure;
+		} catch(FileError& err) {
+			if(err.errcode != EBADF) {
+				out << "Expected errno " << EBADF << " (EBADF), got " << err.errcode << std::endl;
+				return eFailure;
+			}
+		}
+		try {
+			std::string big(256, 'x');
+			buf.write(big.data(), big.size());
+			out << "Write after failure did not fail" << std::endl;
+			return eFailure;
+		} catch(FileError& err) {
+			if(err.errcode != EBADF) return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	std::string mkPayload(size_t size) {
+		std::string r;  r.reserve(size);
+		auto rng = std::minstd_rand(size);
+		for(size_t i = 0; i < size; ++i) r.push_back(char(rng()));
+		return r;
+	}
+
+
+	/** Reads the whole file with a mix of `readAll` and `fill` calls. */
+	ssize_t readPrefetched(PrefetchInputBuffer& in, std::string& dst) {
+		size_t chunk = 1;
+		for(;;) {
+			switch(chunk % 2) {
+				case 0: {
+					std::string buf(chunk, '\0');
+					ssize_t rd = in.readAll(buf.data(), chunk);
+					if(rd < 0) return rd;
+					dst.append(buf.data(), rd);
+					if(size_t(rd) < chunk) return dst.size();
+				} break;
+				case 1: {
+					ssize_t fl = in.fill();
+					if(fl < 0) return fl;
+					if(in.size() == 0) return dst.size();
+					size_t n = std::min(chunk, in.size());
+					dst.append(reinterpret_cast<const char*>(in.data()), n);
+					// Consume exactly `n` bytes, so that the next fill has to top the buffer up
+					std::string discard(n, '\0');
+					in.read(discard.data(), n);
+				} break;
+			}
+			chunk = (chunk * 7) % 3001;
+		}
+	}
+
+
+	utest::ResultType prefetch_file(std::ostream& out) {
+		auto payload = mkPayload(1024 * 1024 + 17);
+		try {
+			{
+				File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+				writeAll(f, payload.data(), payload.size());
+			}
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			auto in = PrefetchInputBuffer(f, 1000, 3);
+			std::string got;
+			ssize_t rd = readPrefetched(in, got);
+			if(rd != ssize_t(payload.size()) || got != payload) {
+				out << "Read " << rd << '/' << payload.size() << " bytes" << (got == payload? "" : ", with mismatching data") << std::endl;
+				return eFailure;
+			}
+
+			// Read it again, one byte at a time
+			f.lseek(0, SEEK_SET);
+			auto in2 = PrefetchInputBuffer(f, 1000, 3);
+			got.clear();
+			while(1 == in2.fwd()) got.push_back(char(*in2.data()));
+			if(got != payload) {
+				out << "Forwarded " << got.size() << '/' << payload.size() << " bytes" << (got == payload? "" : ", with mismatching data") << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType prefetch_pipe(std::ostream& out) {
+		auto payload = mkPayload(256 * 1024);
+		try {
+			Pipe pipe = Pipe::create();
+			std::thread writer([&]() {
+				for(size_t i = 0; i < payload.size(); i += 777) {
+					writeAll(pipe.wr, payload.data() + i, std::min<size_t>(777, payload.size() - i));
+				}
+				pipe.wr.close();
+			});
+			std::string got;
+			ssize_t rd;
+			{
+				auto in = PrefetchInputBuffer(pipe.rd, 4096);
+				rd = readPrefetched(in, got);
+			}
+			writer.join();
+			if(rd != ssize_t(payload.size()) || got != payload) {
+				out << "Read " << rd << '/' << payload.size() << " bytes" << (got == payload? "" : ", with mismatching data") << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType prefetch_ebadf(std::ostream& out) {
+		File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT, 0600);
+		auto in = PrefetchInputBuffer(f, 64);
+		try {
+			in.fill();
+			out << "Fill did not fail" << std::endl;
+			return eFailure;
+		} catch(FileError& err) {
+			if(err.errcode != EBADF) {
+				out << "Expected errno " << EBADF << " (EBADF), got " << err.errcode << std::endl;
+				return eFailure;
+			}
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType group_commit_ebadf(std::ostream& out) {
+		File f = File::open(tmpFile.c_str(), O_RDONLY | O_CREAT, 0600);
+		auto writer = GroupCommitWriter(f);
+		for(unsigned i = 0; i < 2; ++i) {
+			try {
+				writer.commit("x", 1);
+				out << "Commit #" << i << " did not fail" << std::endl;
+				return eFailure;
+			} catch(FileError& err) {
+				if(err.errcode != EBADF) {
+					out << "Expected errno " << EBADF << " (EBADF), got " << err.errcode << std::endl;
+					return eFailure;
+				}
+			}
+		}
+		return eSuccess;
+	}
+
+}
+
+
+
+int main(int, char**) {
+	auto batch = utest::TestBatch(std::cout);
+	batch
+		.run("Group commit, concurrent threads", group_commit_threads<0>)
+		.run("Group commit, concurrent threads with latency", group_commit_threads<2000>)
+		.run("Group commit, staging area backpressure", group_commit_backpressure)
+		.run("Group commit to read-only file (EBADF)", group_commit_ebadf)
+		.run("Concurrent buffer, aligned segments", concurrent_buffer_threads<256>)
+		.run("Concurrent buffer, records across segments", concurrent_buffer_threads<200>)
+		.run("Concurrent buffer, flush partial segments", concurrent_buffer_flush)
+		.run("Async buffer, file", async_buffer_file)
+		.run("Async buffer, blocking backpressure", async_buffer_backpressure<BackpressurePolicy::eBlock>)
+		.run("Async buffer, dropping backpressure", async_buffer_backpressure<BackpressurePolicy::eDrop>)
+		.run("Async buffer, growing backpressure", async_buffer_backpressure<BackpressurePolicy::eGrow>)
+		.run("Async buffer to read-only file (EBADF)", async_buffer_ebadf)
+		.run("Prefetch buffer, file", prefetch_file)
+		.run("Prefetch buffer, pipe", prefetch_pipe)
+		.run("Prefetch buffer from write-only file (EBADF)", prefetch_ebadf);
+	::unlink(tmpFile.c_str());
+	return batch.failures() == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -2,6 +2,7 @@
 
 #if defined POSIXFIO_UNIX
 	#include "../include/unix/posixfio.hpp"
+	#include "../include/unix/posixfio_ex.hpp"
 #elif defined POSIXFIO_WIN32
 	#include "../include/win32/posixfio.hpp"
 #endif
@@ -327,6 +328,349 @@ namespace {
 	}
 
 
+	utest::ResultType pread_pwrite_file(std::ostream& out) {
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			IO_PAYLOAD_BUFFER_(buf)
+			ssize_t half = ioPayload.size() / 2;
+			ssize_t rest = ioPayload.size() - half;
+			// Write the second half first, to make sure that the file offset is ignored
+			if(rest != f.pwrite(ioPayload.data() + half, rest, half)) throw 0;
+			if(half != f.pwrite(ioPayload.data(), half, 0)) throw 0;
+			if(0 != f.lseek(0, SEEK_CUR)) {
+				out << "The file offset has been changed by pwrite" << std::endl;
+				return eFailure;
+			}
+			if(rest != f.pread(buf.data() + half, rest, half)) throw 0;
+			if(half != f.pread(buf.data(), half, 0)) throw 0;
+			if(buf != ioPayload) {
+				out << "Payload mismatch" << std::endl;
+				return eFailure;
+			}
+		} catch(...) {
+			out << "ERRNO " << errno << ' ' << errno_str(errno) << '\n';
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType preadv2_pwritev2_file(std::ostream& out) {
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			IO_PAYLOAD_BUFFER_(buf)
+			size_t third = ioPayload.size() / 3;
+			struct iovec wrIov[2] = {
+				{ ioPayload.data(), third },
+				{ ioPayload.data() + third, ioPayload.size() - third } };
+			struct iovec rdIov[2] = {
+				{ buf.data(), ioPayload.size() - third },
+				{ buf.data() + (ioPayload.size() - third), third } };
+			ssize_t wr = f.pwritev2(wrIov, 2, 0, RwFlags::eDsync);
+			if(wr != ssize_t(ioPayload.size())) {
+				out << "Incomplete write: " << wr << " of " << ioPayload.size() << " bytes" << std::endl;
+				return eFailure;
+			}
+			// The file has just been written, so its pages should be cached and RWF_NOWAIT should succeed
+			ssize_t rd = f.preadv2(rdIov, 2, 0, RwFlags::eNoWait);
+			if(rd != ssize_t(ioPayload.size())) {
+				out << "Incomplete read: " << rd << " of " << ioPayload.size() << " bytes" << std::endl;
+				return eFailure;
+			}
+			if(buf != ioPayload) {
+				out << "Payload mismatch" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+			if(err.errcode == EOPNOTSUPP || err.errcode == EAGAIN) return eNeutral;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType pipe_capacity(std::ostream& out) {
+		try {
+			Pipe pipe = Pipe::create2(O_NONBLOCK | O_CLOEXEC);
+			if(! (::fcntl(pipe.rd, F_GETFL) & O_NONBLOCK) || ! (::fcntl(pipe.wr, F_GETFD) & FD_CLOEXEC)) {
+				out << "Pipe flags were not applied" << std::endl;
+				return eFailure;
+			}
+			ssize_t cap = pipe.capacity();
+			// The kernel rounds capacities up to a power of two number of pages
+			ssize_t newCap = pipe.setCapacity((cap * 2) + 1);
+			if(newCap <= cap * 2 || newCap != pipe.capacity()) {
+				out << "Capacity " << cap << " -> " << newCap << " (reported " << pipe.capacity() << ')' << std::endl;
+				return eFailure;
+			}
+			char c;
+			try {
+				pipe.read(&c, 1);
+				out << "Empty non-blocking pipe did not fail with EAGAIN" << std::endl;
+				return eFailure;
+			} catch(FileError& err) {
+				if(err.errcode != EAGAIN) throw;
+			}
+			try {
+				// Truncated to an `int`, this would be a valid capacity of one page
+				pipe.setCapacity((size_t(1) << 32) + 4096);
+				out << "Capacity " << pipe.capacity() << " was set from an out of range value" << std::endl;
+				return eFailure;
+			} catch(FileError& err) {
+				if(err.errcode != EINVAL) throw;
+			}
+			if(pipe.capacity() != newCap) {
+				out << "Capacity changed to " << pipe.capacity() << " after a failed resize" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType pipe_tee_splice(std::ostream& out) {
+		// One producer, duplicated to two pipes with `tee` and spliced to a file
+		try {
+			Pipe src = Pipe::create();
+			Pipe dst[2] = { Pipe::create(), Pipe::create() };
+			File f = File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			ssize_t moved = 0;
+			while(moved < ssize_t(ioPayload.size())) {
+				struct iovec iov = { ioPayload.data() + moved, ioPayload.size() - moved };
+				moved += src.vmsplice(&iov, 1);
+			}
+			for(auto& pipe : dst) {
+				// `tee` never consumes data, so a partial copy could not be resumed
+				moved = src.tee(pipe, ioPayload.size());
+				if(moved != ssize_t(ioPayload.size())) {
+					out << "Duplicated " << moved << " of " << ioPayload.size() << " bytes" << std::endl;
+					return eFailure;
+				}
+			}
+			for(moved = 0; moved < ssize_t(ioPayload.size()); ) {
+				moved += src.spliceTo(f, nullptr, ioPayload.size() - moved);
+			}
+			for(auto& pipe : dst) {
+				IO_PAYLOAD_BUFFER_(buf)
+				for(moved = 0; moved < ssize_t(buf.size()); ) {
+					moved += pipe.read(buf.data() + moved, buf.size() - moved);
+				}
+				if(buf != ioPayload) {
+					out << "Payload mismatch in a duplicated pipe" << std::endl;
+					return eFailure;
+				}
+			}
+			IO_PAYLOAD_BUFFER_(buf)
+			if(ssize_t(buf.size()) != f.pread(buf.data(), buf.size(), 0) || buf != ioPayload) {
+				out << "Payload mismatch in the spliced file" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType readv_writev_file(std::ostream& out) {
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			IO_PAYLOAD_BUFFER_(buf)
+			size_t sz = ioPayload.size();
+			IoVecList<3> wrIov;
+			wrIov
+				.add(ioPayload.data(), 10)
+				.add(ioPayload.data() + 10, 0)
+				.add(ioPayload.data() + 10, sz - 10);
+			IoVecList<2> rdIov;
+			rdIov
+				.add(buf.data(), sz / 2)
+				.add(buf.data() + (sz / 2), sz - (sz / 2));
+			if(wrIov.bytes() != sz || ! wrIov.full()) {
+				out << "Unexpected IoVecList state" << std::endl;
+				return eFailure;
+			}
+			if(ssize_t(sz) != f.writev(wrIov.data(), wrIov.size())) throw 0;
+			if(0 != f.lseek(0, SEEK_SET)) throw 0;
+			if(ssize_t(sz) != f.readv(rdIov.data(), rdIov.size())) throw 0;
+			if(buf != ioPayload) {
+				out << "Payload mismatch" << std::endl;
+				return eFailure;
+			}
+		} catch(...) {
+			out << "ERRNO " << errno << ' ' << errno_str(errno) << '\n';
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType fallocate_fadvise(std::ostream& out) {
+		constexpr off_t blockSize = 64 * 1024;
+		constexpr off_t fileSize = 4 * blockSize;
+		auto isZero = [](const std::string& s) { return s.find_first_not_of('\0') == std::string::npos; };
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			std::string block;  block.assign(blockSize, 'x');
+			if(! f.fallocate(FallocateMode::eDefault, 0, fileSize)) throw 0;
+			if(f.lseek(0, SEEK_END) != fileSize) {
+				out << "fallocate did not extend the file" << std::endl;
+				return eFailure;
+			}
+			f.lseek(0, SEEK_SET);
+			for(off_t i = 0; i < fileSize; i += blockSize) if(blockSize != f.write(block.data(), blockSize)) throw 0;
+			if(! f.syncFileRange(0, 0, SyncRangeFlags::eWriteAndWait)) throw 0;
+			if(! f.fadvise(0, 0, FileAdvice::eSequential)) throw 0;
+			if(! f.readahead(0, fileSize)) throw 0;
+
+			// Punch the second block, zero the third one, preallocate past the end
+			bool punched = f.fallocate(FallocateMode::ePunchHole, blockSize, blockSize);
+			if(! punched && errno != EOPNOTSUPP) throw 0;
+			bool zeroed = f.fallocate(FallocateMode::eZeroRange, 2 * blockSize, blockSize);
+			if(! zeroed && errno != EOPNOTSUPP) throw 0;
+			if(! f.fallocate(FallocateMode::eKeepSize, fileSize, fileSize)) throw 0;
+			if(f.lseek(0, SEEK_END) != fileSize) {
+				out << "FallocateMode::eKeepSize changed the file size" << std::endl;
+				return eFailure;
+			}
+
+			std::string rd;  rd.resize(blockSize);
+			if(blockSize != f.pread(rd.data(), blockSize, 0) || rd != block) {
+				out << "Data outside of the affected ranges was changed" << std::endl;
+				return eFailure;
+			}
+			if(punched && (blockSize != f.pread(rd.data(), blockSize, blockSize) || ! isZero(rd))) {
+				out << "The punched hole does not read as zeroes" << std::endl;
+				return eFailure;
+			}
+			if(zeroed && (blockSize != f.pread(rd.data(), blockSize, 2 * blockSize) || ! isZero(rd))) {
+				out << "The zeroed range does not read as zeroes" << std::endl;
+				return eFailure;
+			}
+			if(! (punched && zeroed)) return eNeutral;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+			if(err.errcode == EOPNOTSUPP) return eNeutral;
+			return eFailure;
+		} catch(...) {
+			out << "ERRNO " << errno << ' ' << errno_str(errno) << '\n';
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType special_files(std::ostream& out) {
+		try {
+			// memfd: writes fail once the file is sealed
+			File mem = File::memfdCreate("posixfio-test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+			if(4 != mem.write("abcd", 4)) throw 0;
+			if(! mem.addSeals(FileSeals(F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW))) throw 0;
+			if(! (mem.getSeals() & F_SEAL_WRITE)) {
+				out << "F_SEAL_WRITE was not applied" << std::endl;
+				return eFailure;
+			}
+			bool sealed = false;
+			try { mem.pwrite("x", 1, 0); } catch(FileError& err) { sealed = (err.errcode == EPERM); }
+			if(! sealed) {
+				out << "A sealed memfd could be written" << std::endl;
+				return eFailure;
+			}
+			char rd[4];
+			if(4 != mem.pread(rd, 4, 0) || 0 != memcmp(rd, "abcd", 4)) {
+				out << "Sealed memfd data mismatch" << std::endl;
+				return eFailure;
+			}
+
+			// eventfd: writes are added to the counter, reads reset it
+			File ev = File::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			std::uint64_t count;
+			if(! (ev.eventfdWrite(3) && ev.eventfdWrite(4) && ev.eventfdRead(&count))) throw 0;
+			bool empty = false;
+			try { ev.eventfdRead(&count); } catch(FileError& err) { empty = (err.errcode == EAGAIN); }
+			if(count != 7 || ! empty) {
+				out << "Unexpected eventfd counter" << std::endl;
+				return eFailure;
+			}
+
+			// timerfd: a one-shot timer expires once
+			File tm = File::timerfd();
+			struct itimerspec its = { };
+			its.it_value.tv_nsec = 1000000;
+			if(! tm.timerfdSettime(its)) throw 0;
+			std::uint64_t expirations;
+			if(sizeof(expirations) != tm.read(&expirations, sizeof(expirations)) || expirations != 1) {
+				out << "Unexpected timerfd expiration count" << std::endl;
+				return eFailure;
+			}
+
+			// signalfd: a blocked signal is delivered as a record
+			sigset_t mask, oldMask;
+			sigemptyset(&mask);
+			sigaddset(&mask, SIGUSR1);
+			if(0 != ::pthread_sigmask(SIG_BLOCK, &mask, &oldMask)) throw 0;
+			File sig = File::signalfd(mask);
+			::raise(SIGUSR1);
+			struct signalfd_siginfo info;
+			ssize_t rdSize = sig.read(&info, sizeof(info));
+			::pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+			if(rdSize != sizeof(info) || info.ssi_signo != SIGUSR1) {
+				out << "signalfd did not receive SIGUSR1" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << ' ' << errno_str(err.errcode) << '\n';
+			return eFailure;
+		} catch(...) {
+			out << "ERRNO " << errno << ' ' << errno_str(errno) << '\n';
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType expected_api(std::ostream& out) {
+		auto missing = ex::File::open("/No file named like this should ever exist in a filesystem's root dir", O_RDONLY);
+		if(missing || missing.error() != ENOENT) {
+			out << "Expected ENOENT" << std::endl;
+			return eFailure;
+		}
+		auto f = ex::File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if(! f) {
+			out << "ERRNO " << f.error() << ' ' << errno_str(f.error()) << '\n';
+			return eFailure;
+		}
+		std::string rd;  rd.resize(ioPayload.size() + 1);
+		auto wr = ex::writeAll(*f, ioPayload.data(), ioPayload.size());
+		auto seek = f->lseek(0, SEEK_SET);
+		auto rdAll = ex::readAll(*f, rd.data(), rd.size());  // Stops at EOF
+		if(wr != ioPayload.size() || seek != 0 || rdAll != ioPayload.size() || 0 != rd.compare(0, ioPayload.size(), ioPayload)) {
+			out << "Payload mismatch" << std::endl;
+			return eFailure;
+		}
+		auto shortRd = f->pread(rd.data(), 4, 2);
+		if(shortRd != 4 || 0 != memcmp(rd.data(), ioPayload.data() + 2, 4)) {
+			out << "Positional read mismatch" << std::endl;
+			return eFailure;
+		}
+		if(! f->ftruncate(0) || f->lseek(0, SEEK_END) != 0 || ! f->close() || *f) {
+			out << "Unexpected ftruncate / close result" << std::endl;
+			return eFailure;
+		}
+		auto badRd = ex::File(f->fd()).read(rd.data(), 1);
+		if(badRd || badRd.error() != EBADF) {
+			out << "Expected EBADF from a closed file" << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
 	utest::ResultType fileerror_enoent(std::ostream& out) {
 		return requireFileError(out, ENOENT, [](std::ostream&) {
 			auto f = File::open(
@@ -381,5 +725,17 @@ int main(int, char**) {
 		#endif
 		.run("Copy-construct file", copy_file)
 		.run("Copy-construct file view", copy_fileview);
+	#ifdef POSIXFIO_UNIX
+		ioPayload = mkPayload();
+		batch
+			.run("Vectored read / write", readv_writev_file)
+			.run("Positional read / write", pread_pwrite_file)
+			.run("Vectored positional read / write (RWF_*)", preadv2_pwritev2_file)
+			.run("Pipe flags and capacity", pipe_capacity)
+			.run("Pipe tee, splice and vmsplice", pipe_tee_splice)
+			.run("File preallocation and cache advice", fallocate_fadvise)
+			.run("memfd, eventfd, timerfd and signalfd", special_files)
+			.run("std::expected API", expected_api);
+	#endif
 	return batch.failures() == 0? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -1,14 +1,24 @@
 #include <test_tools.hpp>
 
-#include "../include/win32/posixfio_tl.hpp"
+#if defined POSIXFIO_UNIX
+	#include "../include/unix/posixfio_tl.hpp"
+#elif defined POSIXFIO_WIN32
+	#include "../include/win32/posixfio_tl.hpp"
+#endif
 
 #include <array>
+#include <thread>
+#include <atomic>
+#include <vector>
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <charconv>
 #include <random>
 #include <cstring>
 #include <cassert>
 #include <memory>
+#include <chrono>
 
 
 
@@ -336,6 +346,135 @@ namespace {
 	}
 
 
+	/** Decodes length-prefixed records in place, with `peek` and `consume`. */
+	template<size_t inputBufferStaticCapacity>
+	utest::ResultType peek_consume(std::ostream& out) {
+		constexpr size_t recordCount = 20000;
+		constexpr size_t maxRecordSize = 61;
+		auto recordSize = [](size_t i) { return (i * 7) % (maxRecordSize + 1); };
+		try {
+			{
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+				auto buf = posixfio::OutputBuffer(f, 4096);
+				for(size_t i = 0; i < recordCount; ++i) {
+					byte_t record[2 + maxRecordSize];
+					record[0] = recordSize(i);
+					record[1] = byte_t(i);
+					memset(record + 2, int(i % 251), recordSize(i));
+					if(ssize_t(2 + recordSize(i)) != buf.writeAll(record, 2 + recordSize(i))) throw 0;
+				}
+			}
+			File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+			auto buf = InputBuffer<inputBufferStaticCapacity>::ctor(f, 64);
+			for(size_t i = 0; i < recordCount; ++i) {
+				if(buf.peek(2) < 2) {
+					out << "Unexpected EOF before record " << i << std::endl;
+					return eFailure;
+				}
+				size_t size = buf.data()[0];
+				if(size != recordSize(i) || buf.data()[1] != byte_t(i)) {
+					out << "Bad header for record " << i << std::endl;
+					return eFailure;
+				}
+				if(buf.peek(2 + size) < ssize_t(2 + size)) {
+					out << "Unexpected EOF in record " << i << std::endl;
+					return eFailure;
+				}
+				for(size_t j = 0; j < size; ++j) if(buf.data()[2 + j] != byte_t(i % 251)) {
+					out << "Bad payload for record " << i << std::endl;
+					return eFailure;
+				}
+				buf.consume(2 + size);
+			}
+			if(0 != buf.peek(1)) {
+				out << "Expected EOF" << std::endl;
+				return eFailure;
+			}
+			if(buf.reserveContiguous(65)) {
+				out << "Reserved more than the capacity" << std::endl;
+				return eFailure;
+			}
+			return eSuccess;
+		} CATCH_ERRNO_(out)
+		return eFailure;
+	}
+
+
+	/** Formats numbers directly into the buffer, with `reserve` and `commit`. */
+	template<size_t outputBufferStaticCapacity>
+	utest::ResultType reserve_commit(std::ostream& out) {
+		constexpr size_t numberCount = 20000;
+		constexpr size_t maxNumberSize = 21;
+		try {
+			std::string expect;
+			{
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+				auto buf = OutputBuffer<outputBufferStaticCapacity>::ctor(f, 64);
+				for(size_t i = 0; i < numberCount; ++i) {
+					expect.append(std::to_string(i * i) + ' ');
+					auto span = buf.reserve(maxNumberSize);
+					if(span.size() < maxNumberSize) throw 0;
+					auto chars = reinterpret_cast<char*>(span.data());
+					auto end = std::to_chars(chars, chars + span.size(), i * i).ptr;
+					*(end++) = ' ';
+					buf.commit(end - chars);
+				}
+				if(! buf.reserve(65).empty()) {
+					out << "Reserved more than the capacity" << std::endl;
+					return eFailure;
+				}
+			}
+			File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+			std::string cmpString;  cmpString.resize(expect.size() + 1);
+			if(ssize_t(expect.size()) != readAll(f, cmpString.data(), cmpString.size())) {
+				out << "File size mismatch" << std::endl;
+				return eFailure;
+			}
+			cmpString.pop_back();
+			auto diffPt = diff(expect, cmpString);
+			if(0 <= diffPt) {
+				out << "File content does not match at char " << diffPt << std::endl;
+				return eFailure;
+			}
+			return eSuccess;
+		} CATCH_ERRNO_(out)
+		return eFailure;
+	}
+
+
+	/** Compares every delimiter scanning kernel that the CPU supports with `memchr`;
+	 * a delimiter right past the end catches kernels that overrun the range. */
+	utest::ResultType find_byte_kernels(std::ostream& out) {
+		constexpr size_t maxLength = 130;
+		constexpr byte_t delim = '\n';
+		std::array<byte_t, maxLength + 1> bytes;
+		auto kernels = _buffer_op_impl::findByteKernels();
+		if(kernels.empty()) {
+			out << "No kernel is available" << std::endl;
+			return eFailure;
+		}
+		for(const auto& kernel : kernels) {
+			for(size_t length = 0; length <= maxLength; ++length) {
+				for(size_t pos = 0; pos <= length; ++pos) {
+					// `pos == length` leaves the delimiter out of the range
+					memset(bytes.data(), 'x', bytes.size());
+					bytes[length] = delim;
+					bytes[pos] = delim;
+					auto expect = reinterpret_cast<const byte_t*>(memchr(bytes.data(), delim, length));
+					auto found = kernel.fn(bytes.data(), length, delim);
+					if(found != expect) {
+						out << kernel.name << ": length " << length << ", delimiter at " << pos << ", found at ";
+						if(found == nullptr) out << "nullptr"; else out << (found - bytes.data());
+						out << std::endl;
+						return eFailure;
+					}
+				}
+			}
+		}
+		return eSuccess;
+	}
+
+
 	utest::ResultType fileerror_file_ebadf(std::ostream& out) {
 		int r = requireFileError(out, EBADF, [](std::ostream& out) {
 			auto f = File::open(tmpFile.c_str(), O_RDONLY | O_CREAT);
@@ -411,6 +550,865 @@ namespace {
 	}
 
 
+	#ifdef POSIXFIO_UNIX
+		utest::ResultType positional_threads(std::ostream& out) {
+			constexpr size_t threadCount = 8;
+			try {
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600));
+				size_t sliceSize = ioPayload.size() / threadCount;
+				std::string cmpString;  cmpString.resize(sliceSize * threadCount);
+				std::vector<ssize_t> results(2 * threadCount);
+				auto runThreads = [&](auto fn) {
+					std::vector<std::thread> threads;
+					for(size_t i = 0; i < threadCount; ++i) threads.emplace_back(fn, i);
+					for(auto& thread : threads) thread.join();
+				};
+				// All threads share the same file descriptor, each one working on its own slice
+				runThreads([&](size_t i) {
+					results[i] = pwriteAll(f, ioPayload.data() + (i * sliceSize), sliceSize, i * sliceSize); });
+				runThreads([&](size_t i) {
+					results[threadCount + i] = preadAll(f, cmpString.data() + (i * sliceSize), sliceSize, i * sliceSize); });
+				for(auto result : results) {
+					if(result != ssize_t(sliceSize)) {
+						out << "Partial transfer of " << result << '/' << sliceSize << " bytes" << std::endl;
+						return eFailure;
+					}
+				}
+				auto diffPt = diff(ioPayload, cmpString);
+				if(0 <= diffPt) {
+					out << "File content does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				char c;
+				if(0 != preadAll(f, &c, 1, cmpString.size() + 1)) {
+					out << "Read past EOF" << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		utest::ResultType vectored_pipe(std::ostream& out) {
+			// More buffers than IOV_MAX, of varying sizes (including 0)
+			constexpr size_t iovCount = 2500;
+			try {
+				Pipe pipe = Pipe::create();
+				std::string cmpString;  cmpString.resize(ioPayload.size());
+				std::vector<struct iovec> wrIov;
+				std::vector<struct iovec> rdIov;
+				size_t cursor = 0;
+				for(size_t i = 0; i < iovCount && cursor < ioPayload.size(); ++i) {
+					size_t n = std::min((i * 37) % 1001, ioPayload.size() - cursor);
+					if(i + 1 == iovCount) n = ioPayload.size() - cursor;
+					wrIov.push_back({ ioPayload.data() + cursor, n });
+					cursor += n;
+				}
+				for(cursor = 0; cursor < cmpString.size(); ) {
+					size_t n = std::min<size_t>(1777, cmpString.size() - cursor);
+					rdIov.push_back({ cmpString.data() + cursor, n });
+					cursor += n;
+				}
+				// Reads from a pipe are limited by its capacity, so they stop in the middle of buffers
+				ssize_t wr = -1;
+				std::thread writer = std::thread([&]() {
+					wr = writeAllV(pipe.wr, wrIov.data(), wrIov.size());
+					pipe.wr.close();
+				});
+				ssize_t rd = readAllV(pipe.rd, rdIov.data(), rdIov.size());
+				writer.join();
+				if(wr != ssize_t(ioPayload.size()) || rd != ssize_t(ioPayload.size())) {
+					out << "Transferred " << wr << " / " << rd << " of " << ioPayload.size() << " bytes" << std::endl;
+					return eFailure;
+				}
+				auto diffPt = diff(ioPayload, cmpString);
+				if(0 <= diffPt) {
+					out << "Data does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		utest::ResultType flush_span(std::ostream& out) {
+			try {
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					auto buf = posixfio::OutputBuffer(f, 4096);
+					size_t cursor = 0;
+					while(cursor < ioPayload.size()) {
+						size_t n = std::min<size_t>(100 + (cursor % 20000), ioPayload.size() - cursor);
+						if(n > 4096) {
+							if(ssize_t(n) != buf.flush(ioPayload.data() + cursor, n)) throw 0;
+						} else {
+							if(ssize_t(n) != buf.writeAll(ioPayload.data() + cursor, n)) throw 0;
+						}
+						cursor += n;
+					}
+				}
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				std::string cmpString;  cmpString.resize(ioPayload.size());
+				if(ssize_t(cmpString.size()) != readAll(f, cmpString.data(), cmpString.size())) throw 0;
+				auto diffPt = diff(ioPayload, cmpString);
+				if(0 <= diffPt) {
+					out << "File content does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Flushes a span after more buffered bytes than a non-blocking pipe can hold:
+		 * the bytes that weren't written must stay buffered, without being repeated. */
+		utest::ResultType flush_span_nonblocking(std::ostream& out) {
+			constexpr size_t pipeCapacity = 4096;
+			constexpr size_t buffered = 6000;
+			try {
+				Pipe pipe = Pipe::create2(O_NONBLOCK | O_CLOEXEC);
+				if(ssize_t(pipeCapacity) != pipe.setCapacity(pipeCapacity)) {
+					out << "Pipe capacity is " << pipe.capacity() << std::endl;
+					return eNeutral;
+				}
+				auto buf = posixfio::OutputBuffer(pipe.wr, 2 * buffered);
+				auto result = [&]() {
+					try {
+						auto span = buf.reserve(buffered);
+						memcpy(span.data(), ioPayload.data(), buffered);
+						buf.commit(buffered);
+						ssize_t wr;
+						#ifdef POSIXFIO_NOTHROW
+							wr = buf.flush(ioPayload.data() + buffered, 100);
+						#else
+							try {
+								wr = buf.flush(ioPayload.data() + buffered, 100);
+							} catch(FileError& err) {
+								if(err.errcode != EAGAIN) throw;
+								wr = -1;
+								errno = EAGAIN;
+							}
+						#endif
+						if(wr >= 0 || errno != EAGAIN) {
+							out << "Flushing into a full pipe returned " << wr << std::endl;
+							return eFailure;
+						}
+						std::string cmpString;  cmpString.resize(buffered + 1);
+						ssize_t rd = pipe.rd.read(cmpString.data(), cmpString.size());
+						if(! buf.flush()) {
+							out << "The second flush failed with " << buf.size() << " bytes left" << std::endl;
+							return eFailure;
+						}
+						ssize_t rd2 = pipe.rd.read(cmpString.data() + rd, cmpString.size() - rd);
+						if(rd + rd2 != ssize_t(buffered)) {
+							out << "Read " << (rd + rd2) << " bytes, expected " << buffered << std::endl;
+							return eFailure;
+						}
+						cmpString.resize(buffered);
+						auto diffPt = diff(ioPayload.substr(0, buffered), cmpString);
+						if(0 <= diffPt) {
+							out << "Pipe content does not match at char " << diffPt << std::endl;
+							return eFailure;
+						}
+						return eSuccess;
+					} CATCH_ERRNO_(out)
+					return eFailure;
+				}();
+				// Make room for whatever the destructor of `buf` has left to write
+				pipe.setCapacity(16 * pipeCapacity);
+				return result;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Writes the IO payload several times through an OutputBuffer, then reads
+		 * it back through an InputBuffer, both using the same access pattern. */
+		template<AccessPattern pattern>
+		utest::ResultType access_pattern(std::ostream& out) {
+			constexpr size_t repeat = 4;
+			try {
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					auto buf = posixfio::OutputBuffer(f, 4096, pattern);
+					for(size_t i = 0; i < repeat; ++i) {
+						size_t cursor = 0;
+						while(cursor < ioPayload.size()) {
+							size_t n = std::min<size_t>(100 + (cursor % 20000), ioPayload.size() - cursor);
+							if(ssize_t(n) != buf.writeAll(ioPayload.data() + cursor, n)) throw 0;
+							cursor += n;
+						}
+					}
+				}
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				auto buf = posixfio::InputBuffer(f, 4096, pattern);
+				std::string cmpString;  cmpString.resize(ioPayload.size());
+				for(size_t i = 0; i < repeat; ++i) {
+					if(ssize_t(cmpString.size()) != buf.readAll(cmpString.data(), cmpString.size())) throw 0;
+					auto diffPt = diff(ioPayload, cmpString);
+					if(0 <= diffPt) {
+						out << "File content does not match at char " << diffPt << " of repetition " << i << std::endl;
+						return eFailure;
+					}
+				}
+				char c;
+				if(0 != buf.read(&c, 1)) {
+					out << "Expected EOF" << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Writes the IO payload through a DirectOutputBuffer, starting at an
+		 * unaligned offset and flushing unaligned tails, then reads it back
+		 * through a DirectInputBuffer. */
+		utest::ResultType direct_io(std::ostream& out) {
+			constexpr size_t skip = 1000;
+			constexpr size_t overwrite = 5000; // Rewrites the middle of the file, with data after the tail
+			try {
+				std::string prefix;  prefix.assign(skip, '#');
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					alwaysThrowErr(writeAll(f, prefix.data(), skip));
+				}
+				File f;
+				try { f = File::open(tmpFile.c_str(), O_RDWR | O_DIRECT); } catch(Errno&) { }
+				if(! f) {
+					out << "O_DIRECT is not supported" << std::endl;
+					return eNeutral;
+				}
+				f.lseek(skip, SEEK_SET);
+				{
+					auto buf = posixfio::DirectOutputBuffer(f, 20000);
+					size_t cursor = 0;
+					while(cursor < ioPayload.size()) {
+						size_t n = std::min<size_t>(100 + (cursor % 30000), ioPayload.size() - cursor);
+						if(ssize_t(n) != buf.writeAll(ioPayload.data() + cursor, n)) throw 0;
+						cursor += n;
+						if(cursor % 7 == 0 && ! buf.flush()) throw 0;
+					}
+				}
+				{
+					f.lseek(skip + overwrite, SEEK_SET);
+					auto buf = posixfio::DirectOutputBuffer(f, 4096);
+					if(ssize_t(overwrite) != buf.writeAll(ioPayload.data() + overwrite, overwrite)) throw 0;
+				}
+
+				File rf = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				if(rf.lseek(0, SEEK_END) != off_t(skip + ioPayload.size())) {
+					out << "File size mismatch" << std::endl;
+					return eFailure;
+				}
+				std::string cmpString;  cmpString.resize(skip + ioPayload.size());
+				if(ssize_t(cmpString.size()) != preadAll(rf, cmpString.data(), cmpString.size(), 0)) throw 0;
+				if(std::string_view(cmpString).substr(0, skip) != prefix) {
+					out << "The data before the initial offset was changed" << std::endl;
+					return eFailure;
+				}
+				auto diffPt = diff(ioPayload, std::string_view(cmpString).substr(skip));
+				if(0 <= diffPt) {
+					out << "File content does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+
+				f.lseek(skip, SEEK_SET);
+				auto buf = posixfio::DirectInputBuffer(f, 20000);
+				cmpString.resize(ioPayload.size());
+				size_t cursor = 0;
+				while(cursor < ioPayload.size()) {
+					size_t n = std::min<size_t>(100 + (cursor % 30000), ioPayload.size() - cursor);
+					if(ssize_t(n) != buf.readAll(cmpString.data() + cursor, n)) throw 0;
+					cursor += n;
+				}
+				char c;
+				if(0 != buf.read(&c, 1)) {
+					out << "Expected EOF" << std::endl;
+					return eFailure;
+				}
+				diffPt = diff(ioPayload, cmpString);
+				if(0 <= diffPt) {
+					out << "Buffered content does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Splits the IO payload into lines with `readLine`, `forEachLine` or
+		 * `readUntil`, and compares them with the ones read by `std::getline`;
+		 * small buffers exercise lines that are longer than the buffer. */
+		template<char mode, size_t capacity>
+		utest::ResultType read_lines(std::ostream& out) {
+			try {
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					if(ssize_t(ioPayload.size()) != writeAll(f, ioPayload.data(), ioPayload.size())) throw 0;
+				}
+				std::vector<std::string> expect;
+				{
+					auto is = std::istringstream(ioPayload);
+					std::string line;
+					while(std::getline(is, line)) expect.push_back(line);
+				}
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				auto buf = posixfio::InputBuffer(f, capacity);
+				std::vector<std::string> got;
+				size_t consumed = 0;
+				if constexpr(mode == 'l') {
+					std::string_view line;
+					ssize_t rd;
+					while(0 < (rd = buf.readLine(&line))) {
+						got.emplace_back(line);
+						consumed += rd;
+					}
+					if(rd < 0) throw 0;
+				} else if constexpr(mode == 'e') {
+					ssize_t rd = buf.forEachLine([&](std::string_view line) { got.emplace_back(line); });
+					if(rd < 0) throw 0;
+					consumed = rd;
+				} else {
+					std::string line;  line.resize(1024);
+					ssize_t rd;
+					while(0 < (rd = buf.readUntil(line.data(), line.size(), '\n'))) {
+						consumed += rd;
+						if(line[rd - 1] == '\n') -- rd;
+						got.emplace_back(line.data(), rd);
+					}
+					if(rd < 0) throw 0;
+				}
+				if(consumed != ioPayload.size()) {
+					out << "Consumed " << consumed << " bytes out of " << ioPayload.size() << std::endl;
+					return eFailure;
+				}
+				if(got.size() != expect.size()) {
+					out << "Read " << got.size() << " lines, expected " << expect.size() << std::endl;
+					return eFailure;
+				}
+				for(size_t i = 0; i < got.size(); ++i) {
+					if(got[i] != expect[i]) {
+						out << "Line " << i << " does not match" << std::endl;
+						return eFailure;
+					}
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Reads a line that is longer than the buffer from a non-blocking pipe,
+		 * which runs dry halfway through: the line must be resumed, not truncated. */
+		utest::ResultType read_lines_nonblocking(std::ostream& out) {
+			constexpr size_t capacity = 64;
+			try {
+				Pipe pipe = Pipe::create2(O_NONBLOCK | O_CLOEXEC);
+				auto buf = posixfio::InputBuffer(pipe.rd, capacity);
+				std::string head = std::string(capacity, 'a');
+				if(ssize_t(head.size()) != writeAll(pipe.wr, head.data(), head.size())) throw 0;
+				std::string_view line;
+				ssize_t rd = buf.readLine(&line);
+				if(rd >= 0 || errno != EAGAIN) {
+					out << "Reading from an empty pipe returned " << rd << std::endl;
+					return eFailure;
+				}
+				if(4 != writeAll(pipe.wr, "bbb\n", 4)) throw 0;
+				rd = buf.readLine(&line);
+				if(rd != ssize_t(capacity + 4) || line != head + "bbb") {
+					out << "Resumed line has " << line.size() << " bytes, consumed " << rd << std::endl;
+					return eFailure;
+				}
+				if(4 != writeAll(pipe.wr, "ccc\n", 4)) throw 0;
+				rd = buf.readLine(&line);
+				if(rd != 4 || line != "ccc") {
+					out << "Line after the resumed one is \"" << line << '"' << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Writes the IO payload through a RingOutputBuffer, alternating `writeAll`
+		 * and `reserve`, then reads it back through a RingInputBuffer, alternating
+		 * `read` and `peek`, with sizes that make the window wrap around. */
+		utest::ResultType ring_buffers(std::ostream& out) {
+			try {
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					auto buf = posixfio::RingOutputBuffer(f, 4096);
+					size_t cursor = 0;
+					for(size_t i = 0; cursor < ioPayload.size(); ++i) {
+						size_t n = std::min<size_t>(1 + ((i * 997) % 4096), ioPayload.size() - cursor);
+						if(i % 2 == 0) {
+							if(ssize_t(n) != buf.writeAll(ioPayload.data() + cursor, n)) throw 0;
+						} else {
+							auto span = buf.reserve(n);
+							if(span.size() < n) throw 0;
+							memcpy(span.data(), ioPayload.data() + cursor, n);
+							buf.commit(n);
+						}
+						cursor += n;
+					}
+				}
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				auto buf = posixfio::RingInputBuffer(f, 4096);
+				std::string cmpString;  cmpString.resize(ioPayload.size());
+				size_t cursor = 0;
+				for(size_t i = 0; cursor < ioPayload.size(); ++i) {
+					size_t n = std::min<size_t>(1 + ((i * 997) % 4096), ioPayload.size() - cursor);
+					if(i % 2 == 0) {
+						if(ssize_t(n) != buf.readAll(cmpString.data() + cursor, n)) throw 0;
+					} else {
+						if(buf.peek(n) < ssize_t(n)) throw 0;
+						memcpy(cmpString.data() + cursor, buf.data(), n);
+						buf.consume(n);
+					}
+					cursor += n;
+				}
+				if(0 != buf.peek(1)) {
+					out << "Expected EOF" << std::endl;
+					return eFailure;
+				}
+				auto diffPt = diff(ioPayload, cmpString);
+				if(0 <= diffPt) {
+					out << "File content does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Transfers through pipes that aren't ready, or are interrupted by signals,
+		 * following different IO policies. */
+		utest::ResultType io_policy(std::ostream& out) {
+			using namespace std::chrono_literals;
+			try {
+				std::string cmpString;  cmpString.resize(ioPayload.size());
+
+				// Non-blocking: both ends stop when the pipe is full, or empty
+				{
+					Pipe pipe = Pipe::create2(O_NONBLOCK | O_CLOEXEC);
+					auto wr = writeAll(pipe.wr, ioPayload.data(), ioPayload.size(), IoPolicy { });
+					auto rd = readAll(pipe.rd, cmpString.data(), cmpString.size(), IoPolicy { });
+					if(wr.status != IoStatus::eWouldBlock || rd.status != IoStatus::eWouldBlock || rd.errcode != EAGAIN) {
+						out << "Expected EAGAIN from both ends of a non-blocking pipe" << std::endl;
+						return eFailure;
+					}
+					if(wr.count == 0 || rd.count != wr.count || 0 != memcmp(ioPayload.data(), cmpString.data(), rd.count)) {
+						out << "Partial transfer mismatch: " << wr.count << " written, " << rd.count << " read" << std::endl;
+						return eFailure;
+					}
+				}
+
+				// Non-blocking with waits: the deadline expires on an idle pipe
+				{
+					Pipe pipe = Pipe::create2(O_NONBLOCK | O_CLOEXEC);
+					auto start = std::chrono::steady_clock::now();
+					auto rd = readAll(pipe.rd, cmpString.data(), 1, IoPolicy { .waitReady = true, .deadline = start + 20ms });
+					if(rd.status != IoStatus::eTimeout || rd.count != 0 || std::chrono::steady_clock::now() < start + 20ms) {
+						out << "Expected a timeout after 20ms" << std::endl;
+						return eFailure;
+					}
+				}
+
+				// Non-blocking with waits: the whole payload goes through the pipe
+				{
+					Pipe pipe = Pipe::create2(O_NONBLOCK | O_CLOEXEC);
+					IoResult wr;
+					std::thread writer = std::thread([&]() {
+						wr = writeAll(pipe.wr, ioPayload.data(), ioPayload.size(), IoPolicy { .waitReady = true });
+						pipe.wr.close();
+					});
+					auto rd = readAll(pipe.rd, cmpString.data(), cmpString.size() + 1, IoPolicy { .waitReady = true });
+					writer.join();
+					if(! wr.complete() || rd.status != IoStatus::eEof || rd.count != ioPayload.size()) {
+						out << "Waiting transfer stopped after " << wr.count << " / " << rd.count << " bytes" << std::endl;
+						return eFailure;
+					}
+					auto diffPt = diff(ioPayload, cmpString);
+					if(0 <= diffPt) {
+						out << "Data does not match at char " << diffPt << std::endl;
+						return eFailure;
+					}
+				}
+
+				// Blocking, interrupted by a signal halfway through
+				struct sigaction sa = { }, oldSa;
+				sa.sa_handler = [](int) { };
+				sigemptyset(&sa.sa_mask);
+				if(0 != ::sigaction(SIGUSR1, &sa, &oldSa)) throw 0;
+				for(bool retry : { true, false }) {
+					Pipe pipe = Pipe::create();
+					pthread_t reader = ::pthread_self();
+					std::thread writer = std::thread([&]() {
+						posixfio::writeAll(pipe.wr, ioPayload.data(), 1000);
+						std::this_thread::sleep_for(50ms);
+						::pthread_kill(reader, SIGUSR1);
+						std::this_thread::sleep_for(50ms);
+						posixfio::writeAll(pipe.wr, ioPayload.data() + 1000, 1000);
+						pipe.wr.close();
+					});
+					auto rd = readAll(pipe.rd, cmpString.data(), 2000, IoPolicy { .retryInterrupted = retry });
+					writer.join();
+					bool expected = retry?
+						(rd.complete() && rd.count == 2000) :
+						(rd.status == IoStatus::eInterrupted && rd.errcode == EINTR && rd.count == 1000);
+					if(! expected) {
+						::sigaction(SIGUSR1, &oldSa, nullptr);
+						out << "Unexpected result after EINTR (retry = " << retry << "): " << rd.count << " bytes, errno " << rd.errcode << std::endl;
+						return eFailure;
+					}
+				}
+				::sigaction(SIGUSR1, &oldSa, nullptr);
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Pumps many non-blocking pipes on a single thread, with edge-triggered
+		 * readiness: each pipe carries a slice of the IO payload. */
+		utest::ResultType poller_pipes(std::ostream& out) {
+			constexpr size_t pipeCount = 64;
+			constexpr size_t sliceSize = 64 * 1024;
+			try {
+				auto poller = Poller::create();
+				std::vector<Pipe> pipes;
+				std::vector<posixfio::InputBuffer> inputs;
+				std::vector<posixfio::OutputBuffer> outputs;
+				std::vector<size_t> written(pipeCount, 0);
+				std::vector<std::string> received(pipeCount);
+				pipes.reserve(pipeCount);  // Buffers and registrations refer to these descriptors
+				inputs.reserve(pipeCount);
+				outputs.reserve(pipeCount);
+				for(size_t i = 0; i < pipeCount; ++i) {
+					pipes.push_back(Pipe::create2(O_NONBLOCK | O_CLOEXEC));
+					inputs.emplace_back(pipes[i].rd, 1000);
+					outputs.emplace_back(pipes[i].wr, 3000);
+					if(! poller.add(pipes[i].rd, PollEvents(EPOLLIN | EPOLLET), 2 * i)) throw 0;
+					if(! poller.add(pipes[i].wr, PollEvents(EPOLLOUT | EPOLLET), (2 * i) + 1)) throw 0;
+				}
+
+				// Nothing has been written yet
+				PollEvent events[16];
+				if(-1 != inputs[0].fill() || errno != EAGAIN) {
+					out << "An empty non-blocking pipe did not report EAGAIN" << std::endl;
+					return eFailure;
+				}
+
+				size_t open = 2 * pipeCount;
+				while(open > 0) {
+					ssize_t evCount = poller.wait(events, std::size(events), 1000);
+					if(evCount <= 0) {
+						out << "Timed out with " << open << " open pipe ends" << std::endl;
+						return eFailure;
+					}
+					for(ssize_t e = 0; e < evCount; ++e) {
+						size_t i = events[e].token / 2;
+						if(events[e].token % 2 == 0) {
+							if(! events[e].readable()) continue;
+							auto& in = inputs[i];
+							ssize_t rd;
+							while(0 < (rd = in.fill())) {
+								received[i].append(reinterpret_cast<const char*>(in.data()), in.size());
+								in.discard();
+							}
+							if(rd < 0 && errno != EAGAIN) throw 0;
+							if(rd == 0) {
+								if(! poller.remove(pipes[i].rd)) throw 0;
+								-- open;
+							}
+						} else {
+							if(! events[e].writable()) continue;
+							auto& outBuf = outputs[i];
+							const char* slice = ioPayload.data() + (i * sliceSize) % (ioPayload.size() - sliceSize);
+							bool full = false;
+							while(! full && written[i] < sliceSize) {
+								if(outBuf.size() == 0) {
+									size_t n = std::min(outBuf.capacity(), sliceSize - written[i]);
+									auto span = outBuf.reserve(n);
+									if(span.size() < n) throw 0;
+									memcpy(span.data(), slice + written[i], n);
+									outBuf.commit(n);
+									written[i] += n;
+								}
+								if(! outBuf.flush()) {
+									if(errno != EAGAIN) throw 0;
+									full = true;
+								}
+							}
+							if(! full && outBuf.flush()) {
+								if(! poller.remove(pipes[i].wr)) throw 0;
+								outBuf = posixfio::OutputBuffer();
+								pipes[i].wr.close();
+								-- open;
+							}
+						}
+					}
+				}
+
+				for(size_t i = 0; i < pipeCount; ++i) {
+					const char* slice = ioPayload.data() + (i * sliceSize) % (ioPayload.size() - sliceSize);
+					if(received[i].size() != sliceSize || 0 != memcmp(received[i].data(), slice, sliceSize)) {
+						out << "Pipe " << i << " received " << received[i].size() << " mismatching bytes" << std::endl;
+						return eFailure;
+					}
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Recycles blocks on a single thread and across threads, then
+		 * writes and reads the IO payload through pooled buffers. */
+		utest::ResultType buffer_pool(std::ostream& out) {
+			constexpr unsigned threadCount = 8;
+			constexpr size_t iterations = 2000;
+			try {
+				auto pool = BufferPool({ .threadCacheSize = 4 });
+				void* p0 = pool.allocate(5000);
+				pool.deallocate(p0, 5000);
+				void* p1 = pool.allocate(8192);
+				pool.deallocate(p1, 8192);
+				if(p0 != p1 || pool.blockCount() != 1) {
+					out << "Blocks of the same size were not recycled" << std::endl;
+					return eFailure;
+				}
+
+				std::atomic_bool corrupted = false;
+				std::vector<std::thread> threads;
+				for(unsigned t = 0; t < threadCount; ++t) threads.emplace_back([&, t]() {
+					std::vector<std::pair<byte_t*, size_t>> held;
+					for(size_t i = 0; i < iterations; ++i) {
+						size_t size = size_t(1000) << ((i + t) % 8);
+						auto block = reinterpret_cast<byte_t*>(pool.allocate(size));
+						memset(block, int(t), size);
+						held.emplace_back(block, size);
+						// Release the blocks in a different order than they were allocated
+						if(held.size() > 6) {
+							auto [oldBlock, oldSize] = held[i % held.size()];
+							held.erase(held.begin() + (i % held.size()));
+							if(oldBlock[0] != byte_t(t) || oldBlock[oldSize - 1] != byte_t(t)) corrupted = true;
+							pool.deallocate(oldBlock, oldSize);
+						}
+					}
+					for(auto [block, size] : held) pool.deallocate(block, size);
+				});
+				for(auto& thread : threads) thread.join();
+				if(corrupted) {
+					out << "A block was shared by two threads" << std::endl;
+					return eFailure;
+				}
+
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					auto buf = posixfio::OutputBuffer(f, 4096, &pool);
+					if(ssize_t(ioPayload.size()) != buf.writeAll(ioPayload.data(), ioPayload.size())) throw 0;
+				}
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				auto buf = posixfio::InputBuffer(f, 4096, &pool);
+				std::string cmpString;  cmpString.resize(ioPayload.size());
+				if(ssize_t(cmpString.size()) != buf.readAll(cmpString.data(), cmpString.size())) throw 0;
+				auto diffPt = diff(ioPayload, cmpString);
+				if(0 <= diffPt) {
+					out << "File content does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				buf = posixfio::InputBuffer();
+				pool.trim();
+				if(pool.blockCount() != 0) {
+					out << pool.blockCount() << " blocks were not released" << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		/** Reads the IO payload through a MappedInputBuffer, using either `read`
+		 * with varying sizes, `fwd`, or the window itself through `data` and `size`. */
+		template<char mode>
+		utest::ResultType read_mapped(std::ostream& out) {
+			constexpr size_t windowSize = 64 * 1024;
+			constexpr size_t skip = 1000; // Not page-aligned, to test the initial file offset
+			try {
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					if(ssize_t(ioPayload.size()) != writeAll(f, ioPayload.data(), ioPayload.size())) throw 0;
+				}
+				File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				f.lseek(skip, SEEK_SET);
+				auto buf = MappedInputBuffer(f, windowSize);
+				std::string cmpString;  cmpString.reserve(ioPayload.size());
+				if constexpr(mode == 'r') {
+					char chunk[5000];
+					size_t chunkSize = 1;
+					ssize_t rd;
+					while(0 < (rd = buf.readAll(chunk, chunkSize))) {
+						cmpString.append(chunk, rd);
+						chunkSize = (chunkSize * 7) % sizeof(chunk);
+					}
+				} else if constexpr(mode == 'f') {
+					while(1 == buf.fwd()) cmpString.push_back(*buf.data());
+				} else {
+					while(0 < buf.fill() || buf.size() > 0) {
+						if(buf.size() > windowSize) {
+							out << "Window of " << buf.size() << " bytes exceeds its size" << std::endl;
+							return eFailure;
+						}
+						cmpString.append(reinterpret_cast<const char*>(buf.data()), buf.size());
+						buf.discard();
+					}
+				}
+				if(f.lseek(0, SEEK_CUR) != skip) {
+					out << "The file offset was changed" << std::endl;
+					return eFailure;
+				}
+				if(cmpString.size() != ioPayload.size() - skip) {
+					out << "Size mismatch: expected " << ioPayload.size() - skip << ", got " << cmpString.size() << std::endl;
+					return eFailure;
+				}
+				auto diffPt = diff(std::string_view(ioPayload).substr(skip), cmpString);
+				if(0 <= diffPt) {
+					out << "File content does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			return eFailure;
+		}
+
+
+		enum class Endpoint { eFile, ePipe };
+
+		template<Endpoint srcKind, Endpoint dstKind, bool allowKernel, int dstFlags = 0>
+		utest::ResultType transfer_payload(std::ostream& out) {
+			const std::string dstFile = tmpFile + "-dst";
+			try {
+				{
+					File f = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+					if(ssize_t(ioPayload.size()) != writeAll(f, ioPayload.data(), ioPayload.size())) throw 0;
+				}
+				Pipe srcPipe;
+				Pipe dstPipe;
+				File src;
+				File dst;
+				std::thread peer;
+				std::string cmpString;  cmpString.resize(ioPayload.size());
+				ssize_t peerCount = ioPayload.size();
+				if constexpr(srcKind == Endpoint::eFile) {
+					src = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+				} else {
+					srcPipe = Pipe::create();
+					src = std::move(srcPipe.rd);
+					peer = std::thread([&]() {
+						peerCount = writeAll(srcPipe.wr, ioPayload.data(), ioPayload.size());
+						srcPipe.wr.close();
+					});
+				}
+				if constexpr(dstKind == Endpoint::eFile) {
+					dst = alwaysThrowErr(File::open(dstFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | dstFlags, 0600));
+				} else {
+					dstPipe = Pipe::create();
+					dst = std::move(dstPipe.wr);
+					peer = std::thread([&]() {
+						peerCount = readAll(dstPipe.rd, cmpString.data(), cmpString.size());
+					});
+				}
+
+				TransferHints hints;
+				if(! allowKernel) {
+					hints.allowCopyFileRange = false;
+					hints.allowSendfile = false;
+					hints.allowSplice = false;
+				}
+				hints.chunkSize = 100000; // Not a divisor of the payload size
+				// Transferring more bytes than available must stop at EOF
+				auto r = transfer(src, dst, ioPayload.size() + 1000, hints);
+				dst.close();
+				if(peer.joinable()) peer.join();
+				if(r.count != ssize_t(ioPayload.size()) || peerCount != ssize_t(ioPayload.size())) {
+					out << "Transferred " << r.count << " / " << peerCount << " of " << ioPayload.size() << " bytes" << std::endl;
+					return eFailure;
+				}
+				// Which in-kernel copies are refused for O_APPEND files depends on the kernel version
+				bool buffered = (r.strategy == TransferStrategy::eBuffered);
+				bool badStrategy = allowKernel? (buffered && ! (dstFlags & O_APPEND)) : ! buffered;
+				if(r.strategy == TransferStrategy::eNone || badStrategy) {
+					out << "Unexpected transfer strategy " << int(r.strategy) << std::endl;
+					return eFailure;
+				}
+				if constexpr(dstKind == Endpoint::eFile) {
+					File f = alwaysThrowErr(File::open(dstFile.c_str(), O_RDONLY));
+					if(ssize_t(cmpString.size()) != readAll(f, cmpString.data(), cmpString.size())) throw 0;
+				}
+				::unlink(dstFile.c_str());
+				auto diffPt = diff(ioPayload, cmpString);
+				if(0 <= diffPt) {
+					out << "Data does not match at char " << diffPt << std::endl;
+					return eFailure;
+				}
+				return eSuccess;
+			} CATCH_ERRNO_(out)
+			::unlink(dstFile.c_str());
+			return eFailure;
+		}
+
+
+		#ifndef POSIXFIO_NOTHROW
+			/** Errors thrown by `transfer` must refer to the file that caused them. */
+			utest::ResultType transfer_errors(std::ostream& out) {
+				File src = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600));
+				if(ssize_t(ioPayload.size()) != writeAll(src, ioPayload.data(), ioPayload.size())) return eFailure;
+				auto expectError = [&](const char* what, FileView from, FileView to, fd_t culprit, int errcode) {
+					from.lseek(0, SEEK_SET);
+					try {
+						transfer(from, to, ioPayload.size());
+						out << what << ": the transfer succeeded" << std::endl;
+					} catch(FileError& err) {
+						if(err.fd == culprit && err.errcode == errcode) return true;
+						out << what << ": got fd " << err.fd << " ERRNO " << err.errcode << ", expected fd " << culprit << " ERRNO " << errcode << std::endl;
+					}
+					return false;
+				};
+				try {
+					File full = alwaysThrowErr(File::open("/dev/full", O_WRONLY));
+					File readOnly = alwaysThrowErr(File::open(tmpFile.c_str(), O_RDONLY));
+					File writeOnly = alwaysThrowErr(File::open(tmpFile.c_str(), O_WRONLY));
+					if(! expectError("Full destination", src, full, full, ENOSPC)) return eFailure;
+					if(! expectError("Read-only destination", src, readOnly, readOnly, EBADF)) return eFailure;
+					if(! expectError("Write-only source", writeOnly, full, writeOnly, EBADF)) return eFailure;
+
+					// Neither `sendfile` nor `splice` refuse a broken pipe, so no fallback takes place
+					struct sigaction sa = { }, oldSa;
+					sa.sa_handler = SIG_IGN;
+					sigemptyset(&sa.sa_mask);
+					if(0 != ::sigaction(SIGPIPE, &sa, &oldSa)) throw 0;
+					Pipe pipe = Pipe::create();
+					pipe.rd.close();
+					bool brokenPipeOk = expectError("Broken pipe", src, pipe.wr, pipe.wr, EPIPE);
+					::sigaction(SIGPIPE, &oldSa, nullptr);
+					if(! brokenPipeOk) return eFailure;
+				} CATCH_ERRNO_(out)
+				return eSuccess;
+			}
+		#endif
+	#endif
+
+
 	void testPayload(
 			utest::TestBatch& batch, size_t payloadSize,
 			const std::string& wrString, utest::ResultType (*wrFn)(std::ostream&),
@@ -470,6 +1468,43 @@ namespace {
 int main(int, char**) {
 	auto batch = utest::TestBatch(std::cout);
 	testPayloads<220, 2000, 2048, 2500>(batch);
+	#ifdef POSIXFIO_UNIX
+		ioPayload = mkPayload(1 << 20);
+		batch.run("Positional read / write (8 threads)", positional_threads);
+		batch.run("Vectored read / write (pipe)", vectored_pipe);
+		batch.run("Buffer flush with user span", flush_span);
+		batch.run("Buffer flush with user span (non-blocking pipe)", flush_span_nonblocking);
+		batch.run("Buffers with sequential access", access_pattern<AccessPattern::eSequential>);
+		batch.run("Buffers with random access", access_pattern<AccessPattern::eRandom>);
+		batch.run("Buffers with one-time access", access_pattern<AccessPattern::eOnce>);
+		batch.run("Direct I/O buffers", direct_io);
+		batch.run("Buffer pool", buffer_pool);
+		batch.run("Ring buffers", ring_buffers);
+		batch.run("Poller with non-blocking pipes", poller_pipes);
+		batch.run("Transfers with IO policies", io_policy);
+		batch.run("Read lines (64 B buffer)", read_lines<'l', 64>);
+		batch.run("Read lines (4 KiB buffer)", read_lines<'l', 4096>);
+		batch.run("Split lines (64 B buffer)", read_lines<'e', 64>);
+		batch.run("Split lines (4 KiB buffer)", read_lines<'e', 4096>);
+		batch.run("Read until delimiter", read_lines<'u', 4096>);
+		batch.run("Read lines (non-blocking pipe)", read_lines_nonblocking);
+		batch.run("Mapped input buffer, read", read_mapped<'r'>);
+		batch.run("Mapped input buffer, fwd", read_mapped<'f'>);
+		batch.run("Mapped input buffer, zero-copy window", read_mapped<'w'>);
+		batch.run("Transfer file -> file", transfer_payload<Endpoint::eFile, Endpoint::eFile, true>);
+		batch.run("Transfer file -> file (O_APPEND)", transfer_payload<Endpoint::eFile, Endpoint::eFile, true, O_APPEND>);
+		batch.run("Transfer file -> pipe", transfer_payload<Endpoint::eFile, Endpoint::ePipe, true>);
+		batch.run("Transfer pipe -> file", transfer_payload<Endpoint::ePipe, Endpoint::eFile, true>);
+		batch.run("Transfer file -> file (buffered)", transfer_payload<Endpoint::eFile, Endpoint::eFile, false>);
+		#ifndef POSIXFIO_NOTHROW
+			batch.run("Transfer errors", transfer_errors);
+		#endif
+	#endif
+	batch.run("Peek and consume (InputBuffer)", peek_consume<0>);
+	batch.run("Peek and consume (ArrayInputBuffer)", peek_consume<64>);
+	batch.run("Reserve and commit (OutputBuffer)", reserve_commit<0>);
+	batch.run("Reserve and commit (ArrayOutputBuffer)", reserve_commit<64>);
+	batch.run("Delimiter scanning kernels", find_byte_kernels);
 	batch.run("Write read-only file   (EBADF)", fileerror_file_ebadf);
 	batch.run("Read write-only buffer (EBADF)", fileerror_buffer_ebadf);
 	#ifndef POSIXFIO_NOTHROW
@@ -0,0 +1,249 @@
+#include "test_tools.hpp"
+
+#include "../include/unix/posixfio_uring.hpp"
+
+#include <array>
+#include <iostream>
+#include <string>
+#include <random>
+#include <cstring>
+#include <cassert>
+
+
+
+namespace {
+
+	using namespace posixfio;
+
+	constexpr auto eFailure = utest::ResultType::eFailure;
+	constexpr auto eNeutral = utest::ResultType::eNeutral;
+	constexpr auto eSuccess = utest::ResultType::eSuccess;
+
+	const std::string tmpFile = "tmpfile";
+
+	constexpr unsigned chunkCount = 4;
+
+	std::string ioPayload;
+	Ring ring;
+	int ringErrno = 0;
+
+
+	std::string mkPayload() {
+		static constexpr size_t payloadSize = 8192;
+		static size_t state = 5;
+		std::string r;  r.reserve(payloadSize);
+		auto rng = std::minstd_rand(state = (payloadSize ^ state));
+		for(size_t i=0; i < payloadSize; ++i) {
+			r.push_back(char(rng()));
+		}
+		return r;
+	}
+
+
+	/** Collects exactly `count` completions, and checks that none of them failed. */
+	bool collect(std::ostream& out, RingCompletion* dst, unsigned count) {
+		auto got = ring.waitCompletions(dst, count, count);
+		if(got != ssize_t(count)) {
+			out << "Expected " << count << " completions, got " << got << std::endl;
+			return false;
+		}
+		for(unsigned i = 0; i < count; ++i) {
+			if(dst[i].result < 0) {
+				out << "Operation " << dst[i].userData << " failed with errno " << -dst[i].result << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	utest::ResultType create_ring(std::ostream& out) {
+		if(ring) return eSuccess;
+		out << "io_uring is not available (errno " << ringErrno << "), Ring tests will be skipped" << std::endl;
+		return eNeutral;
+	}
+
+
+	utest::ResultType write_file(std::ostream& out) {
+		if(! ring) return eNeutral;
+		try {
+			File f = File::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			size_t chunkSize = ioPayload.size() / chunkCount;
+			for(unsigned i = 0; i < chunkCount; ++i) {
+				bool queued = ring.prepWrite(f, ioPayload.data() + (i * chunkSize), chunkSize, i * chunkSize, i);
+				if(! queued) {
+					out << "Submission queue full after " << i << " operations" << std::endl;
+					return eFailure;
+				}
+			}
+			auto submitted = ring.submit();
+			if(submitted != chunkCount) {
+				out << "Submitted " << submitted << '/' << chunkCount << " operations" << std::endl;
+				return eFailure;
+			}
+			std::array<RingCompletion, chunkCount> cqes;
+			if(! collect(out, cqes.data(), chunkCount)) return eFailure;
+			for(auto& cqe : cqes) {
+				if(size_t(cqe.result) != chunkSize) {
+					out << "Partial write of " << cqe.result << '/' << chunkSize << " bytes" << std::endl;
+					return eFailure;
+				}
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType read_file(std::ostream& out) {
+		if(! ring) return eNeutral;
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			std::string buf;  buf.resize(ioPayload.size());
+			size_t chunkSize = ioPayload.size() / chunkCount;
+			for(unsigned i = 0; i < chunkCount; ++i) {
+				ring.prepRead(f, buf.data() + (i * chunkSize), chunkSize, i * chunkSize, i);
+			}
+			std::array<RingCompletion, chunkCount> cqes;
+			ring.submit(chunkCount);
+			if(! collect(out, cqes.data(), chunkCount)) return eFailure;
+			if(buf != ioPayload) {
+				out << "File != IO payload" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType read_file_fixed(std::ostream& out) {
+		if(! ring) return eNeutral;
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			std::string buf;  buf.resize(ioPayload.size());
+			struct iovec iov = { buf.data(), buf.size() };
+			fd_t fd = f;
+			ring.registerBuffers(&iov, 1);
+			ring.registerFiles(&fd, 1);
+			size_t chunkSize = ioPayload.size() / chunkCount;
+			for(unsigned i = 0; i < chunkCount; ++i) {
+				ring.prepReadFixed(RingFile::registered(0), buf.data() + (i * chunkSize), chunkSize, i * chunkSize, 0, i);
+			}
+			std::array<RingCompletion, chunkCount> cqes;
+			ring.submit();
+			bool success = collect(out, cqes.data(), chunkCount);
+			ring.unregisterFiles();
+			ring.unregisterBuffers();
+			if(! success) return eFailure;
+			if(buf != ioPayload) {
+				out << "File != IO payload" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType fsync_file(std::ostream& out) {
+		if(! ring) return eNeutral;
+		try {
+			File f = File::open(tmpFile.c_str(), O_WRONLY);
+			ring.prepFsync(f, RingFsyncFlags::eNone, 0);
+			ring.prepFsync(f, RingFsyncFlags::eDatasync, 1);
+			std::array<RingCompletion, 2> cqes;
+			ring.submit();
+			if(! collect(out, cqes.data(), cqes.size())) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType openat_close_file(std::ostream& out) {
+		if(! ring) return eNeutral;
+		try {
+			RingCompletion cqe;
+			ring.prepOpenat(AT_FDCWD, tmpFile.c_str(), O_RDONLY, 0, 0);
+			ring.submit();
+			if(! collect(out, &cqe, 1)) return eFailure;
+			File f = cqe.result;
+			char c;
+			if(f.read(&c, 1) != 1 || c != ioPayload.front()) {
+				out << "Opened file does not match the IO payload" << std::endl;
+				return eFailure;
+			}
+			ring.prepClose(f.disown(), 1);
+			ring.submit();
+			if(! collect(out, &cqe, 1)) return eFailure;
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+
+	utest::ResultType full_queue(std::ostream& out) {
+		if(! ring) return eNeutral;
+		try {
+			File f = File::open(tmpFile.c_str(), O_RDONLY);
+			Ring smallRing = Ring::create(2);
+			char c[3];
+			unsigned queued = 0;
+			while(queued < smallRing.sqCapacity()) {
+				if(! smallRing.prepRead(f, c + (queued % 3), 1, 0, queued)) {
+					out << "Submission queue full after " << queued << " operations" << std::endl;
+					return eFailure;
+				}
+				++ queued;
+			}
+			if(smallRing.prepRead(f, c, 1, 0, queued)) {
+				out << "Queued more than " << smallRing.sqCapacity() << " operations" << std::endl;
+				return eFailure;
+			}
+			std::array<RingCompletion, 8> cqes;
+			smallRing.submit();
+			auto got = smallRing.waitCompletions(cqes.data(), cqes.size(), queued);
+			if(got != queued || smallRing.sqSpace() != smallRing.sqCapacity()) {
+				out << "Unexpected queue state after submission" << std::endl;
+				return eFailure;
+			}
+		} catch(FileError& err) {
+			out << "ERRNO " << err.errcode << std::endl;
+			return eFailure;
+		}
+		return eSuccess;
+	}
+
+}
+
+
+
+int main(int, char**) {
+	auto batch = utest::TestBatch(std::cout);
+	try {
+		ring = Ring::create(16);
+	} catch(FileError& err) {
+		ringErrno = err.errcode;
+	}
+	ioPayload = mkPayload();
+	batch
+		.run("Create ring", create_ring)
+		.run("Ring write", write_file)
+		.run("Ring read", read_file)
+		.run("Ring read (registered buffers and files)", read_file_fixed)
+		.run("Ring fsync", fsync_file)
+		.run("Ring openat / close", openat_close_file)
+		.run("Ring full submission queue", full_queue);
+	return batch.failures() == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}